@@ -0,0 +1,226 @@
+/*
+ * Common command line, repeated runs and machine-readable output for the Lace benchmarks.
+ *
+ * A benchmark includes lace.h (or lace14.h) and then this file, adds BENCH_OPTIONS to its getopt string,
+ * passes unknown options to bench_option, and then calls bench_start, bench_run and bench_stop.
+ * The common options are:
+ *   -w <workers>  number of workers (0 for all cores, default 1)
+ *   -q <dqsize>   size of the task deque (default 100000)
+ *   -W <runs>     number of warm-up runs, which are not measured (default 0)
+ *   -r <runs>     number of measured runs (default 1)
+ *   -o <format>   output format: text (default), json or csv
+ * The report has the median and percentiles of the measured runs, and the sum of the worker statistics
+ * (see lace_stats_snapshot) over the measured runs. The text report ends with "Time: <median>" as before.
+ * If the benchmark sets <ops> to the number of operations per run, the report also has the median time per operation.
+ */
+
+#ifndef __LACE_BENCH_H__
+#define __LACE_BENCH_H__
+
+#ifndef __LACE_H__
+#error "include lace.h or lace14.h before bench.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_OPTIONS "w:q:W:r:o:"
+
+#define BENCH_TEXT 0
+#define BENCH_JSON 1
+#define BENCH_CSV  2
+
+typedef struct bench {
+    const char *name;           // name of the benchmark
+    char params[128];           // parameters of the benchmark (e.g. the input size), for the report
+    int workers;
+    int dqsize;
+    int warmup;
+    int repeat;
+    int format;
+    long ops;                   // operations per run, for the time per operation (0 if not applicable)
+    double *times;              // seconds per measured run
+    lace_stats_t stats;         // sum of the statistics of all workers over the measured runs
+} bench_t;
+
+static inline void
+bench_init(bench_t *b, const char *name)
+{
+    memset(b, 0, sizeof(bench_t));
+    b->name = name;
+    b->workers = 1;
+    b->dqsize = 100000;
+    b->repeat = 1;
+}
+
+static inline void
+bench_usage(FILE *out)
+{
+    fprintf(out, "common options: [-w workers] [-q dqsize] [-W warmup runs] [-r measured runs] [-o text|json|csv]\n");
+}
+
+/**
+ * Handle common option <c>; returns 0 if <c> is not a common option.
+ */
+static inline int
+bench_option(bench_t *b, int c, const char *arg)
+{
+    switch (c) {
+        case 'w': b->workers = atoi(arg); return 1;
+        case 'q': b->dqsize = atoi(arg); return 1;
+        case 'W': b->warmup = atoi(arg); return 1;
+        case 'r': b->repeat = atoi(arg) < 1 ? 1 : atoi(arg); return 1;
+        case 'o':
+            if (strcmp(arg, "text") == 0) b->format = BENCH_TEXT;
+            else if (strcmp(arg, "json") == 0) b->format = BENCH_JSON;
+            else if (strcmp(arg, "csv") == 0) b->format = BENCH_CSV;
+            else {
+                fprintf(stderr, "unknown output format %s\n", arg);
+                exit(1);
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static inline double
+bench_wctime(void)
+{
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return (tv.tv_sec + 1E-9 * tv.tv_nsec);
+}
+
+/**
+ * Start Lace with the workers and deque size of the command line.
+ */
+static inline void
+bench_start(bench_t *b)
+{
+    lace_start(b->workers, b->dqsize);
+    b->workers = lace_workers();
+}
+
+static inline void
+bench_stats_sum(lace_stats_t *sum)
+{
+    unsigned int n = lace_workers();
+    lace_stats_t *stats = (lace_stats_t*)calloc(n, sizeof(lace_stats_t));
+    lace_stats_snapshot(stats, n);
+    memset(sum, 0, sizeof(lace_stats_t));
+    for (unsigned int i=0; i<n; i++) {
+        sum->steals += stats[i].steals;
+        sum->failed_steals += stats[i].failed_steals;
+        sum->leaps += stats[i].leaps;
+        sum->splits += stats[i].splits;
+        sum->busy_ns += stats[i].busy_ns;
+        sum->idle_ns += stats[i].idle_ns;
+    }
+    free(stats);
+}
+
+/**
+ * Run the warm-up runs and then the measured runs of <run>, which typically calls RUN.
+ * If <setup> is not NULL, it is called before every run and is not measured, e.g. to restore the input.
+ */
+static inline void
+bench_run(bench_t *b, void (*setup)(void *), void (*run)(void *), void *arg)
+{
+    for (int i=0; i<b->warmup; i++) {
+        if (setup != NULL) setup(arg);
+        run(arg);
+    }
+
+    b->times = (double*)realloc(b->times, sizeof(double) * b->repeat);
+    lace_stats_t before, after;
+    bench_stats_sum(&before);
+    for (int i=0; i<b->repeat; i++) {
+        if (setup != NULL) setup(arg);
+        double t1 = bench_wctime();
+        run(arg);
+        b->times[i] = bench_wctime() - t1;
+    }
+    bench_stats_sum(&after);
+
+    b->stats.steals = after.steals - before.steals;
+    b->stats.failed_steals = after.failed_steals - before.failed_steals;
+    b->stats.leaps = after.leaps - before.leaps;
+    b->stats.splits = after.splits - before.splits;
+    b->stats.busy_ns = after.busy_ns - before.busy_ns;
+    b->stats.idle_ns = after.idle_ns - before.idle_ns;
+}
+
+static int
+bench_compare(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/**
+ * Get the <p>-th percentile (nearest rank) of the <n> sorted values.
+ */
+static inline double
+bench_percentile(const double *sorted, int n, double p)
+{
+    int rank = (int)(p / 100.0 * n + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > n) rank = n;
+    return sorted[rank - 1];
+}
+
+/**
+ * Report the measured runs, then stop Lace.
+ */
+static inline void
+bench_stop(bench_t *b)
+{
+    int n = b->repeat;
+    double *sorted = (double*)malloc(sizeof(double) * n);
+    memcpy(sorted, b->times, sizeof(double) * n);
+    qsort(sorted, n, sizeof(double), bench_compare);
+    double mean = 0;
+    for (int i=0; i<n; i++) mean += sorted[i] / n;
+    double median = n % 2 ? sorted[n/2] : (sorted[n/2-1] + sorted[n/2]) / 2;
+    double p10 = bench_percentile(sorted, n, 10), p90 = bench_percentile(sorted, n, 90);
+    double ns_per_op = b->ops > 0 ? median * 1e9 / b->ops : 0;
+    lace_stats_t *s = &b->stats;
+
+    if (b->format == BENCH_JSON) {
+        printf("{\"benchmark\": \"%s\", \"params\": \"%s\", \"workers\": %d, \"dqsize\": %d, \"warmup\": %d, \"repeat\": %d, ",
+            b->name, b->params, b->workers, b->dqsize, b->warmup, n);
+        printf("\"times\": [");
+        for (int i=0; i<n; i++) printf(i ? ", %f" : "%f", b->times[i]);
+        printf("], \"min\": %f, \"p10\": %f, \"median\": %f, \"p90\": %f, \"max\": %f, \"mean\": %f, ",
+            sorted[0], p10, median, p90, sorted[n-1], mean);
+        if (b->ops > 0) printf("\"ops\": %ld, \"ns_per_op\": %f, ", b->ops, ns_per_op);
+        printf("\"steals\": %llu, \"failed_steals\": %llu, \"leaps\": %llu, \"splits\": %llu, \"busy_ns\": %llu, \"idle_ns\": %llu}\n",
+            (unsigned long long)s->steals, (unsigned long long)s->failed_steals, (unsigned long long)s->leaps,
+            (unsigned long long)s->splits, (unsigned long long)s->busy_ns, (unsigned long long)s->idle_ns);
+    } else if (b->format == BENCH_CSV) {
+        printf("benchmark,params,workers,dqsize,warmup,repeat,min,p10,median,p90,max,mean,ops,ns_per_op,steals,failed_steals,leaps,splits,busy_ns,idle_ns\n");
+        printf("%s,\"%s\",%d,%d,%d,%d,%f,%f,%f,%f,%f,%f,%ld,%f,%llu,%llu,%llu,%llu,%llu,%llu\n",
+            b->name, b->params, b->workers, b->dqsize, b->warmup, n, sorted[0], p10, median, p90, sorted[n-1], mean, b->ops, ns_per_op,
+            (unsigned long long)s->steals, (unsigned long long)s->failed_steals, (unsigned long long)s->leaps,
+            (unsigned long long)s->splits, (unsigned long long)s->busy_ns, (unsigned long long)s->idle_ns);
+    } else {
+        if (n > 1) {
+            printf("Runs: %d (after %d warm-up runs), min %f, p10 %f, p90 %f, max %f\n", n, b->warmup, sorted[0], p10, p90, sorted[n-1]);
+        }
+        printf("Steals: %llu, failed steals: %llu, leaps: %llu, splits: %llu\n",
+            (unsigned long long)s->steals, (unsigned long long)s->failed_steals,
+            (unsigned long long)s->leaps, (unsigned long long)s->splits);
+        if (b->ops > 0) printf("Time per operation: %f ns\n", ns_per_op);
+        printf("Time: %f\n", median);
+    }
+
+    free(sorted);
+    free(b->times);
+    b->times = NULL;
+    lace_stop();
+}
+
+#endif
@@ -168,9 +168,15 @@ if __name__ == "__main__":
     for w in (1,2,max_cores):
         if os.path.isfile('fib-lace'):
             experiments.append(("fib",("./fib-lace", "-w", str(w), "46"), w))
+            experiments.append(("fib-wf",("./fib-lace", "-w", str(w), "-c", "46"), w))
         if os.path.isfile('uts-lace'):
             experiments.append(("uts-t2l",["./uts-lace", "-w", str(w)] + globals()["T2L"].split(), w))
             experiments.append(("uts-t3l",["./uts-lace", "-w", str(w)] + globals()["T3L"].split(), w))
+            experiments.append(("uts-t2l-wf",["./uts-lace", "-w", str(w), "-c"] + globals()["T2L"].split(), w))
+            experiments.append(("uts-t3l-wf",["./uts-lace", "-w", str(w), "-c"] + globals()["T3L"].split(), w))
+        if os.path.isfile('cilksort-lace'):
+            experiments.append(("cilksort",("./cilksort-lace", "-w", str(w), "4100000"), w))
+            experiments.append(("cilksort-wf",("./cilksort-lace", "-w", str(w), "-c", "4100000"), w))
         if os.path.isfile('queens-lace'):
             experiments.append(("queens",("./queens-lace", "-w", str(w), "14"), w))
         if os.path.isfile('matmul-lace'):
@@ -181,6 +187,8 @@ if __name__ == "__main__":
     if os.path.isfile('uts-seq'):
         experiments.append(("uts-t2l-seq",["./uts-seq"] + globals()["T2L"].split(), 1))
         experiments.append(("uts-t3l-seq",["./uts-seq"] + globals()["T3L"].split(), 1))
+    if os.path.isfile('cilksort-seq'):
+        experiments.append(("cilksort-seq",("./cilksort-seq", "4100000"), 1))
     if os.path.isfile('queens-seq'):
         experiments.append(("queens-seq",("./queens-seq", "14"), 1))
     if os.path.isfile('matmul-seq'):
@@ -59,6 +59,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <getopt.h>
+
+#include "bench.h"
 
 typedef long ELM;
 
@@ -68,13 +71,6 @@ typedef long ELM;
 #define QUICKSIZE (2*KILO)
 #define INSERTIONSIZE 20
 
-double wctime() 
-{
-    struct timespec tv;
-    clock_gettime(CLOCK_MONOTONIC, &tv);
-    return (tv.tv_sec + 1E-9 * tv.tv_nsec);
-}
-
 static unsigned long rand_nxt = 0;
 
 static inline unsigned long my_rand(void)
@@ -357,7 +353,19 @@ VOID_TASK_5(cilkmerge, ELM*, low1, ELM*, high1, ELM*, low2, ELM*, high2, ELM*, l
     return;
 }
 
-VOID_TASK_3(cilksort, ELM*, low, ELM*, tmp, long, size)
+/* with -c, the four quarters are sorted work-first: thieves steal the rest of the loop over the quarters */
+int work_first = 0;
+
+VOID_TASK_DECL_3(cilksort, ELM*, ELM*, long);
+
+LACE_WF_FOR_3(cilksort_quarters, i, ELM*, low, ELM*, tmp, long, size)
+{
+    long quarter = size / 4;
+    long len = i == 3 ? size - 3 * quarter : quarter;
+    CALL(cilksort, low + i * quarter, tmp + i * quarter, len);
+}
+
+VOID_TASK_IMPL_3(cilksort, ELM*, low, ELM*, tmp, long, size)
 {
     /*
      * divide the input in four parts of the same size (A, B, C, D)
@@ -383,14 +391,18 @@ VOID_TASK_3(cilksort, ELM*, low, ELM*, tmp, long, size)
     D = C + quarter;
     tmpD = tmpC + quarter;
 
-    SPAWN(cilksort, A, tmpA, quarter);
-    SPAWN(cilksort, B, tmpB, quarter);
-    SPAWN(cilksort, C, tmpC, quarter);
-    SPAWN(cilksort, D, tmpD, size - 3 * quarter);
-    SYNC(cilksort);
-    SYNC(cilksort);
-    SYNC(cilksort);
-    SYNC(cilksort);
+    if (work_first) {
+        CALL(cilksort_quarters, 0, 4, low, tmp, size);
+    } else {
+        SPAWN(cilksort, A, tmpA, quarter);
+        SPAWN(cilksort, B, tmpB, quarter);
+        SPAWN(cilksort, C, tmpC, quarter);
+        SPAWN(cilksort, D, tmpD, size - 3 * quarter);
+        SYNC(cilksort);
+        SYNC(cilksort);
+        SYNC(cilksort);
+        SYNC(cilksort);
+    }
 
     SPAWN(cilkmerge, A, A + quarter - 1, B, B + quarter - 1, tmpA);
     SPAWN(cilkmerge, C, C + quarter - 1, D, low + size - 1, tmpC);
@@ -429,29 +441,46 @@ void fill_array(ELM *arr, unsigned long size)
 
 void usage(char *s)
 {
-    fprintf(stderr, "%s -w <workers> [-q dqsize] <n>\n", s);
+    fprintf(stderr, "%s [-c] <n>\n", s);
+    fprintf(stderr, "Use -c to sort the quarters work-first (thieves steal the continuation)\n");
     fprintf(stderr, "Typical values of n: 10000, 3000000, 4100000\n");
+    bench_usage(stderr);
+}
+
+typedef struct {
+    ELM *input, *array, *tmp;
+    long size;
+} sort_args;
+
+/* every run sorts the same unsorted input */
+void setup(void *arg)
+{
+    sort_args *a = (sort_args*)arg;
+    memcpy(a->array, a->input, a->size * sizeof(ELM));
+}
+
+void run(void *arg)
+{
+    sort_args *a = (sort_args*)arg;
+    RUN(cilksort, a->array, a->tmp, a->size);
 }
 
 int main(int argc, char *argv[])
 {
-    int workers = 1;
-    int dqsize = 100000;
+    bench_t b;
+    bench_init(&b, "cilksort");
 
-    char c;
-    while ((c=getopt(argc, argv, "w:q:h")) != -1) {
+    int c;
+    while ((c=getopt(argc, argv, BENCH_OPTIONS "ch")) != -1) {
         switch (c) {
-            case 'w':
-                workers = atoi(optarg);
-                break;
-            case 'q':
-                dqsize = atoi(optarg);
+            case 'c':
+                work_first = 1;
                 break;
             case 'h':
                 usage(argv[0]);
                 break;
             default:
-                abort();
+                if (!bench_option(&b, c, optarg)) abort();
         }
     }
 
@@ -461,43 +490,40 @@ int main(int argc, char *argv[])
     }
 
     long size = atol(argv[optind]);
-    ELM *array = (ELM*)malloc((1+size) * sizeof(ELM));
-    ELM *tmp = (ELM*)malloc((1+size) * sizeof(ELM));
+    snprintf(b.params, sizeof(b.params), "%ld%s", size, work_first ? " -c" : "");
+    sort_args a;
+    a.size = size;
+    a.input = (ELM*)malloc((1+size) * sizeof(ELM));
+    a.array = (ELM*)malloc((1+size) * sizeof(ELM));
+    a.tmp = (ELM*)malloc((1+size) * sizeof(ELM));
 
     char filename[80];
     sprintf(filename, "cilksort-%ld.data", size);
     FILE *f = fopen(filename, "r");
     if (f != NULL) {
-        if (fread(array, sizeof(ELM), size, f) != (unsigned)size) exit(1);
+        if (fread(a.input, sizeof(ELM), size, f) != (unsigned)size) exit(1);
         fclose(f);
     } else {
-        fill_array(array, size);
+        fill_array(a.input, size);
         f = fopen(filename, "w");
-        fwrite(array, sizeof(ELM), size, f);
+        fwrite(a.input, sizeof(ELM), size, f);
         fclose(f);
     }
 
-    lace_start(workers, dqsize);
+    bench_start(&b);
+    bench_run(&b, setup, run, &a);
 
-    double t1 = wctime();
-    RUN(cilksort, array, tmp, size);
-    double t2 = wctime();
-
-    printf("Time: %f\n", t2-t1);
-
-    /*
-    success = 1;
-    for (i = 0; i < size; ++i)
-        if (array[i] != i)
-            success = 0;
-
-    if (!success)
-        printf("SORTING FAILURE");
-    */
+    for (long i = 0; i < size; ++i) {
+        if (a.array[i] != i) {
+            fprintf(stderr, "SORTING FAILURE\n");
+            exit(1);
+        }
+    }
 
-    lace_stop();
+    bench_stop(&b);
 
-    free(array);
-    free(tmp);
+    free(a.input);
+    free(a.array);
+    free(a.tmp);
     return 0;
 }
@@ -0,0 +1,235 @@
+#include "lace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "bench.h"
+#include "graph.h"
+
+/*
+ * Reachability from vertex 0 in a graph in CSR format, with a visited bitmap that is shared by all workers.
+ * Both searches split their work lazily, like LACE_FOR: a task only spawns part of its frontier when
+ * a thief asks for work, so vertices are handed out in chunks instead of one task per vertex.
+ */
+
+static graph_t g;
+static uint64_t seed;
+static uint64_t *visited;
+
+/**
+ * Mark <v> as visited; returns 1 if this worker was the first to visit it.
+ */
+static inline int
+visit(uint32_t v)
+{
+    uint64_t bit = 1ULL << (v & 63);
+    uint64_t *word = &visited[v >> 6];
+    if (__atomic_load_n(word, __ATOMIC_RELAXED) & bit) return 0;
+    return (__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit) == 0;
+}
+
+/*
+ * Depth-first search from the vertices on <stack>, which the task owns and may grow.
+ * When a thief asks for work, the bottom half of the stack (closest to the root) is spawned as a new task.
+ * Returns the number of vertices visited by this task and its spawned tasks.
+ */
+TASK_3(size_t, dfs, uint32_t*, stack, size_t, sp, size_t, cap)
+{
+    size_t count = 0;
+    int spawned = 0;
+    while (sp > 0) {
+        if (LACE_SPLIT_WANTED() && sp > 1) {
+            size_t half = sp / 2;
+            uint32_t *chunk = (uint32_t*)malloc(sizeof(uint32_t) * half * 2);
+            memcpy(chunk, stack, sizeof(uint32_t) * half);
+            memmove(stack, stack + half, sizeof(uint32_t) * (sp - half));
+            sp -= half;
+            SPAWN(dfs, chunk, half, half * 2);
+            spawned++;
+        }
+        uint32_t v = stack[--sp];
+        for (size_t i=g.offsets[v]; i<g.offsets[v+1]; i++) {
+            uint32_t t = g.targets[i];
+            if (visit(t)) {
+                if (sp == cap) {
+                    cap *= 2;
+                    stack = (uint32_t*)realloc(stack, sizeof(uint32_t) * cap);
+                }
+                stack[sp++] = t;
+                count++;
+            }
+        }
+    }
+    free(stack);
+    while (spawned--) count += SYNC(dfs);
+    return count;
+}
+
+/*
+ * Level-synchronous breadth-first search. Every level visits the neighbours of frontier[from, to) and
+ * collects the new vertices in a local batch, which is appended to the next frontier with one atomic add.
+ */
+#define BFS_BATCH 256
+
+static uint32_t *frontier, *next;
+static size_t next_len;
+
+static void
+bfs_flush(const uint32_t *batch, size_t len)
+{
+    size_t at = __atomic_fetch_add(&next_len, len, __ATOMIC_RELAXED);
+    memcpy(next + at, batch, sizeof(uint32_t) * len);
+}
+
+VOID_TASK_2(bfs_level, size_t, from, size_t, to)
+{
+    uint32_t batch[BFS_BATCH];
+    size_t len = 0;
+    int spawned = 0;
+    while (from < to) {
+        if (LACE_SPLIT_WANTED() && to - from > 1) {
+            size_t mid = from + (to - from) / 2;
+            SPAWN(bfs_level, mid, to);
+            to = mid;
+            spawned++;
+        }
+        uint32_t v = frontier[from++];
+        for (size_t i=g.offsets[v]; i<g.offsets[v+1]; i++) {
+            uint32_t t = g.targets[i];
+            if (visit(t)) {
+                batch[len++] = t;
+                if (len == BFS_BATCH) {
+                    bfs_flush(batch, len);
+                    len = 0;
+                }
+            }
+        }
+    }
+    if (len > 0) bfs_flush(batch, len);
+    while (spawned--) SYNC(bfs_level);
+}
+
+TASK_2(size_t, bfs, uint32_t, root, int*, levels)
+{
+    size_t count = 1, len = 1;
+    visit(root);
+    frontier[0] = root;
+    *levels = 0;
+    while (len > 0) {
+        next_len = 0;
+        CALL(bfs_level, 0, len);
+        uint32_t *tmp = frontier;
+        frontier = next;
+        next = tmp;
+        len = next_len;
+        count += len;
+        (*levels)++;
+    }
+    return count;
+}
+
+/*
+ * The graph, the visited bitmap and the frontiers are initialized by the workers, so that with
+ * first-touch page placement their pages are spread over the NUMA nodes of the workers.
+ */
+LACE_FOR_0(fill_graph, v)
+{
+    graph_fill(&g, v, seed);
+}
+
+LACE_FOR_0(clear_visited, i)
+{
+    visited[i] = 0;
+}
+
+LACE_FOR_0(clear_frontiers, i)
+{
+    frontier[i] = next[i] = 0;
+}
+
+typedef struct {
+    int breadth_first, levels;
+    size_t reached;
+} graph_args;
+
+void setup(void *arg)
+{
+    (void)arg;
+    RUN(clear_visited, 0, (g.n + 63) / 64);
+}
+
+void run(void *arg)
+{
+    graph_args *a = (graph_args*)arg;
+    if (a->breadth_first) {
+        a->reached = RUN(bfs, 0, &a->levels);
+    } else {
+        uint32_t *stack = (uint32_t*)malloc(sizeof(uint32_t) * 64);
+        stack[0] = 0;
+        visited[0] |= 1;
+        a->reached = 1 + RUN(dfs, stack, 1, 64);
+    }
+}
+
+void usage(char *s)
+{
+    fprintf(stderr, "%s [-b] <scale> <degree> [seed]\n", s);
+    fprintf(stderr, "Searches a graph with 2^scale vertices and on average degree+0.5 edges per vertex\n");
+    fprintf(stderr, "Use -b to search breadth-first (level by level) instead of depth-first\n");
+    bench_usage(stderr);
+}
+
+int main(int argc, char **argv)
+{
+    bench_t b;
+    bench_init(&b, "graph");
+    graph_args a = { 0, 0, 0 };
+
+    int c;
+    while ((c=getopt(argc, argv, BENCH_OPTIONS "bh")) != -1) {
+        switch (c) {
+            case 'b':
+                a.breadth_first = 1;
+                break;
+            case 'h':
+                usage(argv[0]);
+                break;
+            default:
+                if (!bench_option(&b, c, optarg)) abort();
+        }
+    }
+
+    if (optind + 1 >= argc) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    int scale = atoi(argv[optind]);
+    int degree = atoi(argv[optind+1]);
+    seed = optind + 2 < argc ? strtoull(argv[optind+2], NULL, 10) : 42;
+    snprintf(b.params, sizeof(b.params), "%d %d%s", scale, degree, a.breadth_first ? " -b" : "");
+
+    bench_start(&b);
+
+    graph_alloc(&g, scale, degree, seed);
+    visited = (uint64_t*)malloc(sizeof(uint64_t) * ((g.n + 63) / 64));
+    frontier = (uint32_t*)malloc(sizeof(uint32_t) * g.n);
+    next = (uint32_t*)malloc(sizeof(uint32_t) * g.n);
+    RUN(fill_graph, 0, g.n);
+    RUN(clear_frontiers, 0, g.n);
+
+    bench_run(&b, setup, run, &a);
+
+    if (b.format == BENCH_TEXT) {
+        if (a.breadth_first) printf("Reached %zu vertices in %d levels.\n", a.reached, a.levels);
+        else printf("Reached %zu vertices.\n", a.reached);
+    }
+    bench_stop(&b);
+
+    free(visited);
+    free(frontier);
+    free(next);
+    graph_free(&g);
+    return 0;
+}
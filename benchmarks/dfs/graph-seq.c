@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "graph.h"
+
+static graph_t g;
+static uint64_t *visited;
+
+static inline int
+visit(uint32_t v)
+{
+    uint64_t bit = 1ULL << (v & 63);
+    if (visited[v >> 6] & bit) return 0;
+    visited[v >> 6] |= bit;
+    return 1;
+}
+
+size_t dfs(uint32_t root)
+{
+    uint32_t *stack = (uint32_t*)malloc(sizeof(uint32_t) * g.n);
+    size_t sp = 0, count = 1;
+    visit(root);
+    stack[sp++] = root;
+    while (sp > 0) {
+        uint32_t v = stack[--sp];
+        for (size_t i=g.offsets[v]; i<g.offsets[v+1]; i++) {
+            uint32_t t = g.targets[i];
+            if (visit(t)) {
+                stack[sp++] = t;
+                count++;
+            }
+        }
+    }
+    free(stack);
+    return count;
+}
+
+size_t bfs(uint32_t root, int *levels)
+{
+    uint32_t *queue = (uint32_t*)malloc(sizeof(uint32_t) * g.n);
+    size_t head = 0, tail = 0;
+    visit(root);
+    queue[tail++] = root;
+    *levels = 0;
+    while (head < tail) {
+        size_t end = tail;
+        while (head < end) {
+            uint32_t v = queue[head++];
+            for (size_t i=g.offsets[v]; i<g.offsets[v+1]; i++) {
+                uint32_t t = g.targets[i];
+                if (visit(t)) queue[tail++] = t;
+            }
+        }
+        (*levels)++;
+    }
+    free(queue);
+    return tail;
+}
+
+double wctime()
+{
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return (tv.tv_sec + 1E-9 * tv.tv_nsec);
+}
+
+void usage(char *s)
+{
+    fprintf(stderr, "%s [-b] <scale> <degree> [seed]\n", s);
+}
+
+int main(int argc, char **argv)
+{
+    int breadth_first = 0;
+
+    int c;
+    while ((c=getopt(argc, argv, "bh")) != -1) {
+        switch (c) {
+            case 'b':
+                breadth_first = 1;
+                break;
+            case 'h':
+                usage(argv[0]);
+                break;
+            default:
+                abort();
+        }
+    }
+
+    if (optind + 1 >= argc) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    int scale = atoi(argv[optind]);
+    int degree = atoi(argv[optind+1]);
+    uint64_t seed = optind + 2 < argc ? strtoull(argv[optind+2], NULL, 10) : 42;
+
+    graph_alloc(&g, scale, degree, seed);
+    for (size_t v=0; v<g.n; v++) graph_fill(&g, v, seed);
+    visited = (uint64_t*)calloc((g.n + 63) / 64, sizeof(uint64_t));
+
+    printf("Running %s on a graph with %zu vertices and %zu edges.\n", breadth_first ? "bfs" : "dfs", g.n, g.m);
+
+    double t1 = wctime();
+    int levels = 0;
+    size_t reached = breadth_first ? bfs(0, &levels) : dfs(0);
+    double t2 = wctime();
+
+    if (breadth_first) printf("Reached %zu vertices in %d levels.\n", reached, levels);
+    else printf("Reached %zu vertices.\n", reached);
+    printf("Time: %f\n", t2-t1);
+
+    free(visited);
+    graph_free(&g);
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Synthetic graphs in CSR format for the graph-seq and graph-lace benchmarks.
+ *
+ * The graph has 2^scale vertices. Every vertex v has between 1 and 2*degree edges, and half of the
+ * edges go to a uniformly random vertex while the other half prefer low vertex numbers, so the
+ * in-degrees are skewed like in state spaces and web graphs. The degree and the targets of v only
+ * depend on v and the seed, so the edges of different vertices can be generated in parallel.
+ */
+
+#ifndef __GRAPH_H__
+#define __GRAPH_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct graph {
+    size_t n;                   // number of vertices
+    size_t m;                   // number of edges
+    size_t *offsets;            // edges of v are targets[offsets[v]] .. targets[offsets[v+1]-1]
+    uint32_t *targets;
+} graph_t;
+
+static inline uint64_t
+graph_hash(uint64_t x)
+{
+    // splitmix64
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline size_t
+graph_degree(size_t v, int degree, uint64_t seed)
+{
+    return 1 + graph_hash(seed ^ (v << 1)) % (2 * degree);
+}
+
+static inline uint32_t
+graph_target(const graph_t *g, size_t v, size_t i, uint64_t seed)
+{
+    uint64_t h = graph_hash(seed ^ (v << 1) ^ 1 ^ (i << 40) ^ (i >> 24));
+    double u = (double)(h >> 11) / (double)(1ULL << 53);
+    if (h & 1) u = u * u;
+    return (uint32_t)(u * (double)g->n);
+}
+
+/**
+ * Allocate the graph and compute the offsets. The targets are filled by graph_fill.
+ */
+static inline void
+graph_alloc(graph_t *g, int scale, int degree, uint64_t seed)
+{
+    if (scale < 1 || scale > 31 || degree < 1) {
+        fprintf(stderr, "invalid graph size\n");
+        exit(1);
+    }
+    g->n = (size_t)1 << scale;
+    g->offsets = (size_t*)malloc(sizeof(size_t) * (g->n + 1));
+    g->offsets[0] = 0;
+    for (size_t v=0; v<g->n; v++) g->offsets[v+1] = g->offsets[v] + graph_degree(v, degree, seed);
+    g->m = g->offsets[g->n];
+    g->targets = (uint32_t*)malloc(sizeof(uint32_t) * g->m);
+    if (g->targets == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+static inline void
+graph_fill(graph_t *g, size_t v, uint64_t seed)
+{
+    for (size_t i=g->offsets[v]; i<g->offsets[v+1]; i++) {
+        g->targets[i] = graph_target(g, v, i - g->offsets[v], seed);
+    }
+}
+
+static inline void
+graph_free(graph_t *g)
+{
+    free(g->offsets);
+    free(g->targets);
+}
+
+#endif
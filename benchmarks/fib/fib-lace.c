@@ -4,6 +4,8 @@
 #include <time.h>
 #include <getopt.h>
 
+#include "bench.h"
+
 TASK_1(int, pfib, int, n)
 {
     if( n < 2 ) {
@@ -17,37 +19,79 @@ TASK_1(int, pfib, int, n)
     }
 }
 
-double wctime() 
+/*
+ * The same computation, where SPAWN_ELIDABLE runs fib(n-1) right away when no worker wants work.
+ */
+TASK_ELIDABLE_1(int, pfib_elide, int, n)
+{
+    if( n < 2 ) {
+        return n;
+    } else {
+        int m,k;
+        SPAWN_ELIDABLE( pfib_elide, n-1 );
+        k = CALL( pfib_elide, n-2 );
+        m = SYNC( pfib_elide );
+        return m+k;
+    }
+}
+
+/*
+ * The same computation, with the two recursive calls as a work-first loop:
+ * the worker computes fib(n-1), while thieves can steal the continuation that computes fib(n-2).
+ */
+#define ADD(a, b) ((a) + (b))
+
+TASK_DECL_1(int, pfib_wf, int);
+
+LACE_WF_REDUCE_1(int, pfib_wf_children, i, 0, ADD, int, n)
+{
+    return CALL( pfib_wf, n-1-(int)i );
+}
+
+TASK_IMPL_1(int, pfib_wf, int, n)
 {
-    struct timespec tv;
-    clock_gettime(CLOCK_MONOTONIC, &tv);
-    return (tv.tv_sec + 1E-9 * tv.tv_nsec);
+    if( n < 2 ) return n;
+    return CALL( pfib_wf_children, 0, 2, n );
+}
+
+typedef struct {
+    int n, m, work_first, elide;
+} fib_args;
+
+void run(void *arg)
+{
+    fib_args *a = (fib_args*)arg;
+    a->m = a->work_first ? RUN(pfib_wf, a->n) : a->elide ? RUN(pfib_elide, a->n) : RUN(pfib, a->n);
 }
 
 void usage(char *s)
 {
-    fprintf(stderr, "%s -w <workers> [-q dqsize] <n>\n", s);
+    fprintf(stderr, "%s [-c|-e] <n>\n", s);
+    fprintf(stderr, "Use -c to run the recursive calls work-first (thieves steal the continuation)\n");
+    fprintf(stderr, "Use -e to spawn with SPAWN_ELIDABLE (tasks run right away when no worker wants work)\n");
+    bench_usage(stderr);
 }
 
 int main(int argc, char **argv)
 {
-    int workers = 1;
-    int dqsize = 100000;
+    bench_t b;
+    bench_init(&b, "fib");
+    fib_args a = { 0, 0, 0, 0 };
 
-    char c;
-    while ((c=getopt(argc, argv, "w:q:h")) != -1) {
+    int c;
+    while ((c=getopt(argc, argv, BENCH_OPTIONS "ceh")) != -1) {
         switch (c) {
-            case 'w':
-                workers = atoi(optarg);
+            case 'c':
+                a.work_first = 1;
                 break;
-            case 'q':
-                dqsize = atoi(optarg);
+            case 'e':
+                a.elide = 1;
                 break;
             case 'h':
                 usage(argv[0]);
                 break;
             default:
-                abort();
+                if (!bench_option(&b, c, optarg)) abort();
         }
     }
 
@@ -56,18 +100,13 @@ int main(int argc, char **argv)
         exit(1);
     }
 
-    lace_start(workers, dqsize);
-
-    int n = atoi(argv[optind]);
+    a.n = atoi(argv[optind]);
+    snprintf(b.params, sizeof(b.params), "%d%s", a.n, a.work_first ? " -c" : a.elide ? " -e" : "");
 
-    double t1 = wctime();
-    int m = RUN(pfib, n);
-    double t2 = wctime();
+    bench_start(&b);
+    bench_run(&b, NULL, run, &a);
 
-    printf("fib(%d) = %d\n", n, m);
-    printf("Time: %f\n", t2-t1);
-
-    lace_stop();
+    if (b.format == BENCH_TEXT) printf("fib(%d) = %d\n", a.n, a.m);
+    bench_stop(&b);
     return 0;
 }
-
@@ -0,0 +1,182 @@
+#!/usr/bin/env python3
+
+"""
+Run the Lace benchmarks over a range of worker counts and collect the results.
+
+Every Lace benchmark is run once per worker count with the common benchmark options
+(see bench.h), i.e. with -W warm-up runs and -r measured runs, and reports its median,
+percentiles and steal counters as JSON. The sequential versions (-seq) are run -r times
+as the baseline for the speedup (seq median / lace median) and the efficiency
+(speedup / workers). The results are written as JSON or CSV.
+The "micro" size runs the scheduler micro-benchmarks of micro-lace instead, which report
+the time per operation and have no sequential version.
+
+With --baseline, the medians are compared to an earlier JSON result file, and the
+harness exits with status 1 if a benchmark became slower than --max-slowdown allows.
+This makes it usable as a regression gate, e.g.:
+
+    ./harness.py -w 1,2,max -r 5 -o base.json
+    ./harness.py -w 1,2,max -r 5 -o new.json --baseline base.json --max-slowdown 0.1
+"""
+
+import argparse
+import csv
+import json
+import multiprocessing
+import os
+import re
+import statistics
+import subprocess
+import sys
+
+# name: (arguments of the benchmark, arguments of the sequential version)
+SIZES = {
+    "small": {
+        "fib": (["32"], ["32"]),
+        "fib-wf": (["-c", "32"], ["32"]),
+        "fib-elide": (["-e", "32"], ["32"]),
+        "uts-t1": ("-t 1 -a 3 -d 10 -b 4 -r 19".split(), "-t 1 -a 3 -d 10 -b 4 -r 19".split()),
+        "uts-t3": ("-t 0 -b 2000 -q 0.124875 -m 8 -r 42".split(), "-t 0 -b 2000 -q 0.124875 -m 8 -r 42".split()),
+        "cilksort": (["1000000"], ["1000000"]),
+        "queens": (["11"], ["11"]),
+        "matmul": (["512"], ["512"]),
+        "matmul-gemm": (["-g", "512"], ["512"]),
+        "graph-dfs": (["20", "8"], ["20", "8"]),
+        "graph-bfs": (["-b", "20", "8"], ["-b", "20", "8"]),
+    },
+    "large": {
+        "fib": (["46"], ["46"]),
+        "fib-wf": (["-c", "46"], ["46"]),
+        "fib-elide": (["-e", "46"], ["46"]),
+        "uts-t2l": ("-t 1 -a 2 -d 23 -b 7 -r 220".split(), "-t 1 -a 2 -d 23 -b 7 -r 220".split()),
+        "uts-t3l": ("-t 0 -b 2000 -q 0.200014 -m 5 -r 7".split(), "-t 0 -b 2000 -q 0.200014 -m 5 -r 7".split()),
+        "cilksort": (["4100000"], ["4100000"]),
+        "queens": (["14"], ["14"]),
+        "matmul": (["2048"], ["2048"]),
+        "matmul-gemm": (["-g", "2048"], ["2048"]),
+        "graph-dfs": (["24", "8"], ["24", "8"]),
+        "graph-bfs": (["-b", "24", "8"], ["-b", "24", "8"]),
+    },
+    "micro": {
+        "micro-spawn": (["spawn"], None),
+        "micro-sync_slow": (["sync_slow"], None),
+        "micro-leapfrog": (["leapfrog"], None),
+        "micro-steal": (["steal"], None),
+        "micro-run": (["run"], None),
+        "micro-resume": (["resume"], None),
+        "micro-newframe": (["newframe"], None),
+        "micro-together": (["together"], None),
+    },
+}
+
+FIELDS = ["name", "benchmark", "params", "workers", "dqsize", "warmup", "repeat",
+          "min", "p10", "median", "p90", "max", "mean", "ops", "ns_per_op", "seq", "speedup", "efficiency",
+          "steals", "failed_steals", "leaps", "splits", "busy_ns", "idle_ns"]
+
+
+def program(bindir, name, suffix):
+    return os.path.join(bindir, re.sub(r"-.*", "", name) + suffix)
+
+
+def run_lace(bindir, name, args, workers, opts):
+    # the common options come first (uts-lace requires this)
+    cmd = [program(bindir, name, "-lace"), "-w", str(workers), "-W", str(opts.warmup),
+           "-r", str(opts.repeat), "-o", "json"] + args
+    out = subprocess.run(cmd, stdout=subprocess.PIPE, universal_newlines=True).stdout
+    lines = [l for l in out.splitlines() if l.startswith("{")]
+    if not lines:
+        # e.g. micro-benchmarks that need more workers
+        print("no result from " + " ".join(cmd), file=sys.stderr)
+        return None
+    result = json.loads(lines[-1])
+    result["name"] = name
+    return result
+
+
+def run_seq(bindir, name, args, opts):
+    if args is None:
+        return None
+    cmd = [program(bindir, name, "-seq")] + args
+    if not os.path.isfile(cmd[0]):
+        return None
+    times = []
+    for _ in range(opts.repeat):
+        out = subprocess.run(cmd, stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+        times += [float(t) for t in re.findall(r"Time:\s*([\d.]+)", out)]
+    return statistics.median(times) if times else None
+
+
+def compare(results, baseline_file, max_slowdown):
+    with open(baseline_file) as f:
+        baseline = {(r["name"], r["params"], r["workers"]): r["median"] for r in json.load(f)}
+    failed = False
+    for r in results:
+        old = baseline.get((r["name"], r["params"], r["workers"]))
+        if old is None or old <= 0:
+            continue
+        change = r["median"] / old - 1
+        status = "ok"
+        if change > max_slowdown:
+            status = "SLOWER"
+            failed = True
+        print("{:<12} {:>3} workers: {:.6f} -> {:.6f} ({:+.1%}) {}".format(
+            r["name"], r["workers"], old, r["median"], change, status), file=sys.stderr)
+    return not failed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-b", "--bench", action="append", help="benchmark to run (default: all of the size)")
+    parser.add_argument("-s", "--size", choices=sorted(SIZES), default="small", help="input sizes (default: small)")
+    parser.add_argument("-w", "--workers", default="1,max", help="comma separated worker counts, 'max' for all cores (default: 1,max)")
+    parser.add_argument("-W", "--warmup", type=int, default=1, help="warm-up runs per benchmark (default: 1)")
+    parser.add_argument("-r", "--repeat", type=int, default=5, help="measured runs per benchmark (default: 5)")
+    parser.add_argument("-f", "--format", choices=["json", "csv"], default="json", help="output format (default: json)")
+    parser.add_argument("-o", "--output", help="output file (default: stdout)")
+    parser.add_argument("--bindir", default=os.path.dirname(os.path.abspath(__file__)), help="directory of the benchmark programs")
+    parser.add_argument("--no-seq", action="store_true", help="do not run the sequential baselines")
+    parser.add_argument("--baseline", help="JSON result file to compare the medians with")
+    parser.add_argument("--max-slowdown", type=float, default=0.1, help="allowed relative slowdown against the baseline (default: 0.1)")
+    opts = parser.parse_args()
+
+    benchmarks = SIZES[opts.size]
+    names = opts.bench or list(benchmarks)
+    for name in names:
+        if name not in benchmarks:
+            parser.error("unknown benchmark {} (choose from {})".format(name, ", ".join(benchmarks)))
+    workers = [multiprocessing.cpu_count() if w == "max" else int(w) for w in opts.workers.split(",")]
+    workers = sorted(set(workers))
+
+    results = []
+    for name in names:
+        args, seq_args = benchmarks[name]
+        seq = None if opts.no_seq else run_seq(opts.bindir, name, seq_args, opts)
+        for w in workers:
+            r = run_lace(opts.bindir, name, args, w, opts)
+            if r is None:
+                continue
+            r["seq"] = seq
+            r["speedup"] = seq / r["median"] if seq and r["median"] > 0 else None
+            r["efficiency"] = r["speedup"] / r["workers"] if r["speedup"] else None
+            print("{:<12} {:>3} workers: median {:.6f}{}".format(name, r["workers"], r["median"],
+                  ", speedup {:.2f}, efficiency {:.2f}".format(r["speedup"], r["efficiency"]) if r["speedup"] else ""),
+                  file=sys.stderr)
+            results.append(r)
+
+    out = open(opts.output, "w") if opts.output else sys.stdout
+    if opts.format == "json":
+        json.dump(results, out, indent=1)
+        out.write("\n")
+    else:
+        writer = csv.DictWriter(out, fieldnames=FIELDS, extrasaction="ignore")
+        writer.writeheader()
+        writer.writerows(results)
+    if opts.output:
+        out.close()
+
+    if opts.baseline and not compare(results, opts.baseline, opts.max_slowdown):
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
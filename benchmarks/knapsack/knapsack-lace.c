@@ -50,7 +50,7 @@ int read_input(const char *filename, struct item *items, int *capacity, int *n)
     if (fscanf(f, "%d", capacity) != 1) return -1;
 
     for (i = 0; i < *n; ++i)
-        if (fscanf(f, "%d %d", &items[i].value, &items[i].weight) != 3) return -1;
+        if (fscanf(f, "%d %d", &items[i].value, &items[i].weight) != 2) return -1;
 
     fclose(f);
 
@@ -109,18 +109,48 @@ TASK_4(int, knapsack, struct item *, e, int, c, int, n, int, v)
     return best;
 }
 
+/*
+ * The same search without the value so far, so that subproblems (first item, capacity, number of items) repeat
+ * and are taken from the operation cache: returns the best value that the items can add with capacity c.
+ * knapsack_memo checks the cache for the subproblem, also for the spawned half.
+ */
+TASK_DECL_3(int, knapsack_m, struct item *, int, int);
+
+TASK_3(int, knapsack_memo, struct item *, e, int, c, int, n)
+{
+    return CALL_MEMO(knapsack_m, e, c, n);
+}
+
+TASK_IMPL_3(int, knapsack_m, struct item *, e, int, c, int, n)
+{
+    if (c < 0)
+        return INT_MIN;
+
+    if (n == 0 || c == 0)
+        return 0;
+
+    SPAWN(knapsack_memo, e + 1, c, n - 1);
+    int with = CALL(knapsack_memo, e + 1, c - e->weight, n - 1);
+    if (with != INT_MIN) with += e->value;
+    int without = SYNC(knapsack_memo);
+
+    return with > without ? with : without;
+}
+
 void usage(char *s)
 {
-    fprintf(stderr, "%s -w <workers> [-q dqsize] <filename>\n", s);
+    fprintf(stderr, "%s -w <workers> [-q dqsize] [-s] [-m entries] <filename>\n", s);
+    fprintf(stderr, "Use -m to reuse the results of subproblems with an operation cache of <entries> entries\n");
 }
 
 int main(int argc, char *argv[])
 {
     int workers = 1;
     int dqsize = 100000;
+    int memo = 0;
 
     char c;
-    while ((c=getopt(argc, argv, "w:q:h")) != -1) {
+    while ((c=getopt(argc, argv, "w:q:sm:h")) != -1) {
         switch (c) {
             case 'w':
                 workers = atoi(optarg);
@@ -128,6 +158,13 @@ int main(int argc, char *argv[])
             case 'q':
                 dqsize = atoi(optarg);
                 break;
+            case 's':
+                lace_set_steal_half(1);
+                break;
+            case 'm':
+                lace_set_cache_size(strtoull(optarg, NULL, 10));
+                memo = 1;
+                break;
             case 'h':
                 usage(argv[0]);
                 break;
@@ -150,7 +187,7 @@ int main(int argc, char *argv[])
         return 1;
 
     double t1 = wctime();
-    sol = RUN(knapsack, items, capacity, n, 0);
+    sol = memo ? RUN(knapsack_memo, items, capacity, n) : RUN(knapsack, items, capacity, n, 0);
     double t2 = wctime();
 
     printf("Best value is %d\n", sol);
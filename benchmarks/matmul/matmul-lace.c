@@ -6,14 +6,9 @@
 
 #include <lace14.h>
 
-#define REAL float
+#include "bench.h"
 
-double wctime() 
-{
-    struct timespec tv;
-    clock_gettime(CLOCK_MONOTONIC, &tv);
-    return (tv.tv_sec + 1E-9 * tv.tv_nsec);
-}
+#define REAL float
 
 void zero(REAL *A, int n)
 {
@@ -113,28 +108,46 @@ VOID_TASK_8(rec_matmul, REAL*, A, REAL*, B, REAL*, C, int, m, int, n, int, p, in
 
 void usage(char *s)
 {
-    fprintf(stderr, "%s -w <workers> [-q dqsize] <n>\n", s);
+    fprintf(stderr, "%s [-g] <n>\n", s);
+    fprintf(stderr, "Use -g to multiply with lace_sgemm (packed tiles) instead of rec_matmul\n");
+    bench_usage(stderr);
+}
+
+typedef struct {
+    REAL *A, *B, *C;
+    int n, gemm;
+} matmul_args;
+
+void setup(void *arg)
+{
+    matmul_args *a = (matmul_args*)arg;
+    zero(a->C, a->n);
+}
+
+void run(void *arg)
+{
+    matmul_args *a = (matmul_args*)arg;
+    if (a->gemm) lace_sgemm(a->n, a->n, a->n, 1, a->A, a->n, a->B, a->n, 0, a->C, a->n);
+    else RUN(rec_matmul, a->A, a->B, a->C, a->n, a->n, a->n, a->n, 0);
 }
 
 int main(int argc, char *argv[])
 {
-    int workers = 1;
-    int dqsize = 100000;
+    bench_t b;
+    bench_init(&b, "matmul");
 
-    char c;
-    while ((c=getopt(argc, argv, "w:q:h")) != -1) {
+    int gemm = 0;
+    int c;
+    while ((c=getopt(argc, argv, BENCH_OPTIONS "gh")) != -1) {
         switch (c) {
-            case 'w':
-                workers = atoi(optarg);
-                break;
-            case 'q':
-                dqsize = atoi(optarg);
+            case 'g':
+                gemm = 1;
                 break;
             case 'h':
                 usage(argv[0]);
                 break;
             default:
-                abort();
+                if (!bench_option(&b, c, optarg)) abort();
         }
     }
 
@@ -144,34 +157,22 @@ int main(int argc, char *argv[])
     }
 
     int n = atoi(argv[optind]);
+    snprintf(b.params, sizeof(b.params), "%d%s", n, gemm ? " -g" : "");
 
     REAL *A  = malloc(n * n * sizeof(REAL));
     REAL *B  = malloc(n * n * sizeof(REAL));
-    REAL *C1 = malloc(n * n * sizeof(REAL));
     REAL *C2 = malloc(n * n * sizeof(REAL));
 
     init(A, n);
     init(B, n);
-    zero(C1, n);
-    zero(C2, n);
 
-    lace_start(workers, dqsize);
-
-    double t1 = wctime();
-    RUN(rec_matmul, A, B, C2, n, n, n, n, 0); 
-    double t2 = wctime();
-
-    printf("Time: %f\n", t2-t1);
-/*
-    iter_matmul(A, B, C1, n);
-    double err = maxerror(C1, C2, n);
+    matmul_args a = { A, B, C2, n, gemm };
 
-    printf("Max error matmul(%d x %d) = %g\n", n, n, err);
-*/
-    lace_stop();
+    bench_start(&b);
+    bench_run(&b, setup, run, &a);
+    bench_stop(&b);
 
     free(C2);
-    free(C1);
     free(B);
     free(A);
     return 0;
@@ -0,0 +1,208 @@
+#include "lace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <getopt.h>
+
+#include "bench.h"
+
+/*
+ * Micro-benchmarks of the scheduler primitives. Each benchmark repeats one operation n times
+ * and reports the time per operation:
+ *   spawn      SPAWN and SYNC of an empty task on the fast path (the task is not stolen)
+ *   sync_slow  SYNC of an empty task that was stolen (includes waiting until it is stolen)
+ *   leapfrog   SYNC of a stolen task whose thief waits for a subtask, which the victim steals back
+ *   steal      stealing n shared empty tasks from one worker by all other workers (per task)
+ *   run        RUN of an empty task from outside Lace (round trip of an external task)
+ *   resume     lace_suspend, lace_resume and RUN of an empty task (wake-up of suspended workers)
+ *   newframe   NEWFRAME of an empty task (interrupting all workers)
+ *   together   TOGETHER of an empty task (all workers run the task between two barriers)
+ * The sync_slow, leapfrog and steal benchmarks need at least 2 workers.
+ */
+
+TASK_1(int, micro_empty, int, i)
+{
+    return i;
+}
+
+VOID_TASK_1(micro_nop, int, i)
+{
+    (void)i;
+}
+
+static inline void
+wait_stolen(Task *t)
+{
+    while (!TASK_IS_STOLEN(t)) sched_yield();
+}
+
+TASK_1(long, micro_spawn, long, n)
+{
+    long s = 0;
+    for (long i=0; i<n; i++) {
+        SPAWN(micro_empty, (int)i);
+        s += SYNC(micro_empty);
+    }
+    return s;
+}
+
+TASK_1(long, micro_sync_slow, long, n)
+{
+    long s = 0;
+    for (long i=0; i<n; i++) {
+        SPAWN(micro_empty, (int)i);
+        LACE_MAKE_ALL_SHARED();
+        wait_stolen(__lace_dq_head - 1);
+        s += SYNC(micro_empty);
+    }
+    return s;
+}
+
+// runs at the thief: wait until the subtask is stolen (by the victim, which is leapfrogging)
+TASK_1(int, micro_leap_child, int, i)
+{
+    SPAWN(micro_empty, i);
+    LACE_MAKE_ALL_SHARED();
+    wait_stolen(__lace_dq_head - 1);
+    return SYNC(micro_empty);
+}
+
+TASK_1(long, micro_leapfrog, long, n)
+{
+    long s = 0;
+    for (long i=0; i<n; i++) {
+        SPAWN(micro_leap_child, (int)i);
+        LACE_MAKE_ALL_SHARED();
+        wait_stolen(__lace_dq_head - 1);
+        s += SYNC(micro_leap_child);
+    }
+    return s;
+}
+
+TASK_1(long, micro_steal, long, n)
+{
+    for (long i=0; i<n; i++) SPAWN(micro_empty, (int)i);
+    LACE_MAKE_ALL_SHARED();
+    // thieves steal from the tail, so all tasks are stolen when the last one is
+    wait_stolen(__lace_dq_head - 1);
+    long s = 0;
+    for (long i=0; i<n; i++) s += SYNC(micro_empty);
+    return s;
+}
+
+TASK_1(long, micro_newframe, long, n)
+{
+    long s = 0;
+    for (long i=0; i<n; i++) s += NEWFRAME(micro_empty, (int)i);
+    return s;
+}
+
+TASK_1(long, micro_together, long, n)
+{
+    for (long i=0; i<n; i++) TOGETHER(micro_nop, (int)i);
+    return n;
+}
+
+typedef struct {
+    const char *name;
+    long n;
+    long res;
+} micro_args;
+
+void run(void *arg)
+{
+    micro_args *a = (micro_args*)arg;
+    long n = a->n, s = 0;
+    if (strcmp(a->name, "spawn") == 0) s = RUN(micro_spawn, n);
+    else if (strcmp(a->name, "sync_slow") == 0) s = RUN(micro_sync_slow, n);
+    else if (strcmp(a->name, "leapfrog") == 0) s = RUN(micro_leapfrog, n);
+    else if (strcmp(a->name, "steal") == 0) s = RUN(micro_steal, n);
+    else if (strcmp(a->name, "newframe") == 0) s = RUN(micro_newframe, n);
+    else if (strcmp(a->name, "together") == 0) s = RUN(micro_together, n);
+    else if (strcmp(a->name, "run") == 0) {
+        for (long i=0; i<n; i++) s += RUN(micro_empty, (int)i);
+    } else if (strcmp(a->name, "resume") == 0) {
+        for (long i=0; i<n; i++) {
+            lace_suspend();
+            lace_resume();
+            s += RUN(micro_empty, (int)i);
+        }
+    }
+    a->res = s;
+}
+
+static const struct {
+    const char *name;
+    long n;             // default number of operations
+    int min_workers;
+} micros[] = {
+    { "spawn", 10000000, 1 },
+    { "sync_slow", 1000, 2 },
+    { "leapfrog", 1000, 2 },
+    { "steal", 10000, 2 },
+    { "run", 100000, 1 },
+    { "resume", 1000, 1 },
+    { "newframe", 1000, 1 },
+    { "together", 1000, 1 },
+};
+
+#define N_MICROS (sizeof(micros) / sizeof(micros[0]))
+
+void usage(char *s)
+{
+    fprintf(stderr, "%s <benchmark> [n]\n", s);
+    fprintf(stderr, "benchmarks:");
+    for (unsigned int i=0; i<N_MICROS; i++) fprintf(stderr, " %s", micros[i].name);
+    fprintf(stderr, "\n");
+    bench_usage(stderr);
+}
+
+int main(int argc, char **argv)
+{
+    bench_t b;
+    bench_init(&b, "micro");
+
+    int c;
+    while ((c=getopt(argc, argv, BENCH_OPTIONS "h")) != -1) {
+        switch (c) {
+            case 'h':
+                usage(argv[0]);
+                break;
+            default:
+                if (!bench_option(&b, c, optarg)) abort();
+        }
+    }
+
+    if (optind == argc) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    unsigned int m;
+    for (m=0; m<N_MICROS; m++) {
+        if (strcmp(argv[optind], micros[m].name) == 0) break;
+    }
+    if (m == N_MICROS) {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    micro_args a = { micros[m].name, micros[m].n, 0 };
+    if (optind + 1 < argc) a.n = atol(argv[optind + 1]);
+    b.ops = a.n;
+    snprintf(b.params, sizeof(b.params), "%s %ld", a.name, a.n);
+
+    bench_start(&b);
+    if (b.workers < micros[m].min_workers) {
+        fprintf(stderr, "%s needs at least %d workers\n", a.name, micros[m].min_workers);
+        lace_stop();
+        exit(1);
+    }
+
+    bench_run(&b, NULL, run, &a);
+
+    if (b.format == BENCH_TEXT) printf("%s: %ld operations\n", a.name, a.n);
+    bench_stop(&b);
+    return 0;
+}
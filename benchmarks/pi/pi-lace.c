@@ -5,7 +5,8 @@
 #include <time.h>
 #include <getopt.h>
 
-static __thread unsigned int seed = 0;
+// the random seed of each worker (worker-local storage)
+static lace_wls_t seed_slot;
 
 /**
  * Simple random number generated (like rand) using the given seed.
@@ -27,9 +28,10 @@ rng(uint32_t *seed, int max)
 TASK_2(uint64_t, pi_mc, long, start, long, cnt)
 {
     if (cnt == 1) {
-        if (seed == 0) seed = LACE_WORKER_ID+1;
-        double x = rng(&seed, RAND_MAX)/(double)RAND_MAX;
-        double y = rng(&seed, RAND_MAX)/(double)RAND_MAX;
+        uint32_t *seed = LACE_WLS(uint32_t, seed_slot);
+        if (*seed == 0) *seed = LACE_WORKER_ID+1;
+        double x = rng(seed, RAND_MAX)/(double)RAND_MAX;
+        double y = rng(seed, RAND_MAX)/(double)RAND_MAX;
         return sqrt(x*x+y*y) < 1.0 ? 1 : 0;
     }
     SPAWN(pi_mc, start, cnt/2);
@@ -77,6 +79,7 @@ int main(int argc, char **argv)
         exit(1);
     }
 
+    seed_slot = lace_wls_register(sizeof(uint32_t));
     lace_start(workers, dqsize);
 
     long n = atol(argv[optind]);
@@ -5,12 +5,7 @@
 #include <getopt.h>
 #include <lace.h>
 
-double wctime() 
-{
-    struct timespec tv;
-    clock_gettime(CLOCK_MONOTONIC, &tv);
-    return (tv.tv_sec + 1E-9 * tv.tv_nsec);
-}
+#include "bench.h"
 
 /*
  * <a> contains array of <n> queen positions.  Returns 1
@@ -65,28 +60,35 @@ TASK_3(long, nqueens, int, n, int, j, char *, a)
 
 void usage(char *s)
 {
-    fprintf(stderr, "%s -w <workers> [-q dqsize] <n>\n", s);
+    fprintf(stderr, "%s <n>\n", s);
+    bench_usage(stderr);
+}
+
+typedef struct {
+    int n;
+    long res;
+} queens_args;
+
+void run(void *arg)
+{
+    queens_args *a = (queens_args*)arg;
+    char *board = (char*)alloca(a->n * sizeof(char));
+    a->res = RUN(nqueens, a->n, 0, board);
 }
 
 int main(int argc, char *argv[])
 {
-    int workers = 1;
-    int dqsize = 100000;
+    bench_t b;
+    bench_init(&b, "queens");
 
-    char c;
-    while ((c=getopt(argc, argv, "w:q:h")) != -1) {
+    int c;
+    while ((c=getopt(argc, argv, BENCH_OPTIONS "h")) != -1) {
         switch (c) {
-            case 'w':
-                workers = atoi(optarg);
-                break;
-            case 'q':
-                dqsize = atoi(optarg);
-                break;
             case 'h':
                 usage(argv[0]);
                 break;
             default:
-                abort();
+                if (!bench_option(&b, c, optarg)) abort();
         }
     }
 
@@ -95,23 +97,16 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
-    lace_start(workers, dqsize);
-
-    int n = atoi(argv[optind]);
-
-    char *a = (char*)alloca(n*sizeof(char));
-
-    printf("running queens %d with %d workers...\n", n, workers);
-
-    double t1 = wctime();
-    long res = RUN(nqueens, n, 0, a);
-    double t2 = wctime();
-
-    printf("Result: Q(%d) = %ld\n", n, res);
+    queens_args a;
+    a.n = atoi(argv[optind]);
+    snprintf(b.params, sizeof(b.params), "%d", a.n);
 
-    printf("Time: %f\n", t2-t1);
+    bench_start(&b);
+    if (b.format == BENCH_TEXT) printf("running queens %d with %d workers...\n", a.n, b.workers);
+    bench_run(&b, NULL, run, &a);
 
-    lace_stop();
+    if (b.format == BENCH_TEXT) printf("Result: Q(%d) = %ld\n", a.n, a.res);
+    bench_stop(&b);
 
     return 0;
 }
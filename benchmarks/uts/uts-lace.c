@@ -20,6 +20,7 @@
 
 #include "uts.h"
 #include "lace.h"
+#include "bench.h"
 
 #define GET_NUM_THREADS  1
 #define GET_THREAD_NUM   0
@@ -67,7 +68,30 @@ typedef struct {
   counter_t maxdepth, size, leaves;
 } Result;
 
-TASK_2(Result, parTreeSearch, int, depth, Node *, parent) {
+static const Result noResult = { 0, 0, 0 };
+
+static Result combineResults(Result a, Result b) {
+  Result r = { a.maxdepth > b.maxdepth ? a.maxdepth : b.maxdepth, a.size + b.size, a.leaves + b.leaves };
+  return r;
+}
+
+// With -c, the children are searched work-first: thieves steal the rest of the loop over the children
+int workFirst = 0;
+
+TASK_DECL_2(Result, parTreeSearch, int, Node *);
+
+LACE_WF_REDUCE_2(Result, searchChildren, i, noResult, combineResults, int, depth, Node *, parent) {
+  Node child;
+  child.type = uts_childType(parent);
+  child.height = parent->height + 1;
+  child.numChildren = -1;    // not yet determined
+  for (int j = 0; j < computeGranularity; j++) {
+    rng_spawn(parent->state.state, child.state.state, (int)i);
+  }
+  return CALL(parTreeSearch, depth+1, &child);
+}
+
+TASK_IMPL_2(Result, parTreeSearch, int, depth, Node *, parent) {
   int numChildren, childType;
   counter_t parentHeight = parent->height;
 
@@ -80,10 +104,14 @@ TASK_2(Result, parTreeSearch, int, depth, Node *, parent) {
   parent->numChildren = numChildren;
   
   // Recurse on the children
-  if (numChildren > 0) {
+  if (numChildren > 0 && workFirst) {
+    r = combineResults(r, CALL(searchChildren, 0, numChildren, depth, parent));
+  } else if (numChildren > 0) {
     int i, j;
+    // the children are on the allocation stack of the worker, released when they are synced
+    lace_mark_t mark = LACE_MARK();
     for (i = 0; i < numChildren; i++) {
-      Node *child = (Node*)alloca(sizeof(Node));
+      Node *child = (Node*)LACE_ALLOC(sizeof(Node));
       child->type = childType;
       child->height = parentHeight + 1;
       child->numChildren = -1;    // not yet determined
@@ -98,6 +126,7 @@ TASK_2(Result, parTreeSearch, int, depth, Node *, parent) {
       r.size += c.size;
       r.leaves += c.leaves;
     }
+    LACE_RELEASE(mark);
   } else {
     r.leaves = 1;
   }
@@ -105,9 +134,9 @@ TASK_2(Result, parTreeSearch, int, depth, Node *, parent) {
   return r;
 }
 
-int _lace_workers = 1;
-int _lace_dqsize = 100000;
+bench_t bench;
 
+/* the common benchmark options come before the UTS options (which also use -q and -r) */
 void lace_parseParams(int* argc_p, char *argv[])
 {
   int argc = *argc_p;
@@ -116,15 +145,16 @@ void lace_parseParams(int* argc_p, char *argv[])
 
   while (1) {
     if (i == argc) break;
-    if (strcmp("-w", argv[i])==0) {
-      i++;
-      if (i == argc) break;
-      _lace_workers = atoi(argv[i]);
+    if (strcmp("-s", argv[i])==0) {
+      lace_set_steal_half(1);
+    }
+    else if (strcmp("-c", argv[i])==0) {
+      workFirst = 1;
     }
-    else if (strcmp("-q", argv[i])==0) {
+    else if (argv[i][0] == '-' && argv[i][1] != 0 && argv[i][2] == 0 && strchr(BENCH_OPTIONS, argv[i][1]) != NULL) {
       i++;
       if (i == argc) break;
-      _lace_dqsize = atoi(argv[i]);
+      bench_option(&bench, argv[i-1][1], argv[i]);
     }
     else break;
     i++;
@@ -135,35 +165,44 @@ void lace_parseParams(int* argc_p, char *argv[])
   *argc_p = argc - i + 1;
 }
 
+Node root;
+Result result;
 
+void run(void *arg) {
+  result = RUN(parTreeSearch, 0, &root);
+  (void)arg;
+}
 
 int main(int argc, char *argv[]) {
-  Node root;
-  double t1, t2;
+  bench_init(&bench, "uts");
 
   lace_parseParams(&argc, argv);
   uts_parseParams(argc, argv);
 
-  uts_printParams();
+  if (bench.format == BENCH_TEXT) uts_printParams();
   uts_initRoot(&root, type);
-  
-  lace_start(_lace_workers, _lace_dqsize);
+  for (int i=1; i<argc; i++) {
+    size_t len = strlen(bench.params);
+    snprintf(bench.params + len, sizeof(bench.params) - len, "%s%s", i > 1 ? " " : "", argv[i]);
+  }
+  if (workFirst) {
+    size_t len = strlen(bench.params);
+    snprintf(bench.params + len, sizeof(bench.params) - len, " -c");
+  }
 
-  printf("Initialized Lace with %d workers, dqsize=%d\n", _lace_workers, _lace_dqsize);
+  bench_start(&bench);
 
-  t1 = uts_wctime();
-  Result r = RUN(parTreeSearch, 0, &root);
-  t2 = uts_wctime();
+  if (bench.format == BENCH_TEXT) printf("Initialized Lace with %d workers, dqsize=%d%s\n", bench.workers, bench.dqsize, workFirst ? ", work-first" : "");
 
-  maxTreeDepth = r.maxdepth;
-  nNodes  = r.size;
-  nLeaves = r.leaves;
+  bench_run(&bench, NULL, run, NULL);
 
-  uts_showStats(GET_NUM_THREADS, 0, t2-t1, nNodes, nLeaves, maxTreeDepth);
+  maxTreeDepth = result.maxdepth;
+  nNodes  = result.size;
+  nLeaves = result.leaves;
 
-  printf("Time: %f\n", t2-t1);
+  if (bench.format == BENCH_TEXT) uts_showStats(GET_NUM_THREADS, 0, bench.times[0], nNodes, nLeaves, maxTreeDepth);
 
-  lace_stop();
+  bench_stop(&bench);
 
   return 0;
 }
@@ -68,7 +68,30 @@ typedef struct {
   counter_t maxdepth, size, leaves;
 } Result;
 
-TASK_2(Result, parTreeSearch, int, depth, Node *, parent) {
+static const Result noResult = { 0, 0, 0 };
+
+static Result combineResults(Result a, Result b) {
+  Result r = { a.maxdepth > b.maxdepth ? a.maxdepth : b.maxdepth, a.size + b.size, a.leaves + b.leaves };
+  return r;
+}
+
+// With -c, the children are searched work-first: thieves steal the rest of the loop over the children
+int workFirst = 0;
+
+TASK_DECL_2(Result, parTreeSearch, int, Node *);
+
+LACE_WF_REDUCE_2(Result, searchChildren, i, noResult, combineResults, int, depth, Node *, parent) {
+  Node child;
+  child.type = uts_childType(parent);
+  child.height = parent->height + 1;
+  child.numChildren = -1;    // not yet determined
+  for (int j = 0; j < computeGranularity; j++) {
+    rng_spawn(parent->state.state, child.state.state, (int)i);
+  }
+  return CALL(parTreeSearch, depth+1, &child);
+}
+
+TASK_IMPL_2(Result, parTreeSearch, int, depth, Node *, parent) {
   int numChildren, childType;
   counter_t parentHeight = parent->height;
 
@@ -81,7 +104,13 @@ TASK_2(Result, parTreeSearch, int, depth, Node *, parent) {
   parent->numChildren = numChildren;
   
   // Recurse on the children
-  if (numChildren > 0) {
+  if (numChildren > 0 && workFirst) {
+    /* Wait a bit */
+    struct timespec tim = (struct timespec){0, 100L*numChildren};
+    nanosleep(&tim, NULL);
+
+    r = combineResults(r, CALL(searchChildren, 0, numChildren, depth, parent));
+  } else if (numChildren > 0) {
     int i, j;
     for (i = 0; i < numChildren; i++) {
       Node *child = (Node*)alloca(sizeof(Node));
@@ -132,6 +161,12 @@ void lace_parseParams(int* argc_p, char *argv[])
       if (i == argc) break;
       _lace_dqsize = atoi(argv[i]);
     }
+    else if (strcmp("-s", argv[i])==0) {
+      lace_set_steal_half(1);
+    }
+    else if (strcmp("-c", argv[i])==0) {
+      workFirst = 1;
+    }
     else break;
     i++;
   }
@@ -155,7 +190,7 @@ int main(int argc, char *argv[]) {
   
   lace_start(_lace_workers, _lace_dqsize);
 
-  printf("Initialized Lace with %d workers, dqsize=%d\n", _lace_workers, _lace_dqsize);
+  printf("Initialized Lace with %d workers, dqsize=%d%s\n", _lace_workers, _lace_dqsize, workFirst ? ", work-first" : "");
 
   t1 = uts_wctime();
   Result r = RUN(parTreeSearch, 0, &root);
@@ -18,6 +18,7 @@
 #define _GNU_SOURCE
 #include <errno.h> // for errno
 #include <sched.h> // for sched_getaffinity
+#include <limits.h> // for INT_MAX
 #include <stdio.h>  // for fprintf
 #include <stdlib.h> // for memalign, malloc
 #include <string.h> // for memset
@@ -29,6 +30,17 @@
 #include <sys/resource.h> // for getrlimit
 #endif
 
+#ifndef _WIN32
+#include <poll.h> // for poll
+#include <unistd.h> // for pipe, read, write
+#include <fcntl.h> // for fcntl
+#endif
+
+#ifdef __linux__
+#include <linux/futex.h> // for FUTEX_WAIT, FUTEX_WAKE
+#include <sys/syscall.h> // for SYS_futex
+#endif
+
 #ifdef _WIN32
 #include <windows.h> // to use GetSystemInfo
 #undef NEWFRAME // otherwise we can't use NEWFRAME Lace macro
@@ -55,34 +67,89 @@ typedef semaphore_t sem_t;
 
 #if LACE_USE_HWLOC
 #include <hwloc.h>
+#endif
 
 /**
- * HWLOC information
+ * Steal-half mode (see lace_set_steal_half)
  */
-static hwloc_topology_t topo;
-static unsigned int n_nodes, n_cores, n_pus;
-#endif
+int lace_steal_half = 0;
 
 /**
- * (public) Worker data
+ * Number of failed steal attempts at a level before trying the next level (see lace_set_steal_locality)
  */
-static Worker **workers = NULL;
+static unsigned int steal_locality = 4;
 
 /**
- * Default sizes for program stack and task deque
+ * Default size for program stack
  */
 static size_t stacksize = 0; // 0 means just take default
-static size_t default_dqsize = 100000;
 
+#if LACE_USE_MMAP
 /**
- * Verbosity flag, set with lace_set_verbosity
+ * With mmap, each worker reserves address space for <max_dqsize> tasks,
+ * but only commits the first <default_dqsize> tasks; the deque grows on demand (see lace_grow_deque)
  */
-static int verbosity = 0;
+#if SIZE_MAX > 0xffffffff
+static size_t max_dqsize = (size_t)1<<24;
+#else
+static size_t max_dqsize = (size_t)1<<16;
+#endif
+static size_t page_size = 4096;
+static pthread_once_t page_size_once = PTHREAD_ONCE_INIT;
+
+static void
+lace_init_page_size(void)
+{
+    page_size = (size_t)sysconf(_SC_PAGESIZE);
+}
+#endif
+
+/**
+ * Huge pages for the worker memory (see lace_set_huge_pages),
+ * and whether suspended workers give unused memory back to the OS (see lace_set_release_memory)
+ */
+static int huge_pages = LACE_HUGE_PAGES_NONE;
+static int release_memory = 0;
+
+/**
+ * Size of the overflow arena of each worker (see lace_arena_alloc).
+ * With mmap, the arena only reserves address space, so it can be large.
+ */
+#if LACE_USE_MMAP && SIZE_MAX > 0xffffffff
+static size_t arena_size = (size_t)1<<26;
+#else
+static size_t arena_size = (size_t)1<<20;
+#endif
+
+/**
+ * Number of entries of the operation cache of each pool (see lace_set_cache_size), 0 or a power of 2.
+ */
+static size_t cache_size = 0;
+
+/**
+ * Size of the worker-local storage of each worker (see lace_wls_register), a multiple of LINE_SIZE,
+ * and the registered reducers, whose views are initialized by lace_init_worker.
+ */
+static size_t wls_size = 0;
+static lace_reducer_t *reducers = NULL;
 
+#if LACE_TRACE
 /**
- * Number of workers
+ * Number of trace events per worker, a power of 2 (see lace_set_trace_size)
  */
-static unsigned int n_workers = 0;
+static size_t trace_size = (size_t)1<<16;
+#endif
+
+/**
+ * Idle policy (see lace_set_backoff)
+ */
+static unsigned int backoff_spins = 32768;
+static unsigned int backoff_yields = 256;
+
+/**
+ * Verbosity flag, set with lace_set_verbosity
+ */
+static int verbosity = 0;
 
 /**
  * Datastructure of the task deque etc for each worker.
@@ -94,44 +161,194 @@ typedef struct {
     Worker worker_public;
     char pad1[PAD(sizeof(Worker), LINE_SIZE)];
     WorkerP worker_private;
-    char pad2[PAD(sizeof(WorkerP), LINE_SIZE)];
+    // aligned instead of padded, as the size of WorkerP may be a multiple of LINE_SIZE
+    _Atomic(void*) __attribute__((aligned(LINE_SIZE))) slab_remote; // objects freed by other threads (see lace_free)
+    _Atomic(uint32_t) park;     // 1 if the worker is parked, 2 if retired (3 when notified)
+    unsigned int ext_queue;     // external task queue of my NUMA node
+    int barrier_sense;          // sense of the last barrier (see lace_barrier)
+    int huge;                   // 1 if the memory is mapped with explicit huge pages
+    char pad3[PAD(sizeof(void*)+sizeof(uint32_t)+sizeof(unsigned int)+2*sizeof(int), LINE_SIZE)];
     Task deque[];
 } worker_data;
 
+typedef struct barrier_node barrier_node_t;
+typedef struct ext_queue ext_queue_t;
+
+/**
+ * A Lace pool: the workers and the other state of one Lace instance (see lace_pool_create).
+ * The fields that other threads write while the workers run are on their own cache lines.
+ */
+struct lace_pool {
+    Worker **workers;           // (public) Worker data
+    WorkerP **workers_p;        // (secret) private Worker data, just for stats collection at end
+    worker_data **workers_memory; // (secret) the memory block allocated for each worker
+    size_t workers_memory_size; // bytes allocated (with mmap: reserved) for each worker's worker data
+    size_t default_dqsize;      // initial size of the task deques
+    size_t wls_size;            // size of the worker-local storage of each worker, between the worker data and the deque
+#if LACE_USE_MMAP
+    size_t reserved_dqsize;     // max_dqsize, or the initial size with explicit huge pages (see lace_start)
+#endif
+    unsigned int n_workers;     // number of workers
+    atomic_uint n_active;       // number of active workers, i.e., workers 0 to n_active-1 (see lace_set_active_workers)
+    unsigned int first_core;    // core of worker 0 (see lace_set_first_core)
+    unsigned int n_pus;         // number of logical processors
+
+    atomic_int quits;           // flag to signal all workers to quit
+    atomic_uint workers_running;
+
+    atomic_int must_suspend;    // suspend and resume (see lace_suspend)
+    sem_t suspend_semaphore;
+    atomic_int awaken_count;
+
+    barrier_node_t *bar;        // the Lace barrier (see lace_barrier)
+
+    lace_cache_entry_t *cache;  // the operation cache (see lace_set_cache_size), or NULL
+    size_t cache_entries;       // number of entries of the cache
+
+    /**
+     * Pool of worker threads for warm restarts (see lace_set_warm_restart).
+     * With warm restart, lace_stop parks the workers and keeps their memory; lace_start reuses them.
+     * The first <size> workers have a thread and memory, of which the first <n_workers> run.
+     */
+    int warm_restart;
+    int parked;                 // 1 if lace_stop kept the pool
+    unsigned int size;
+    atomic_int keep;            // set by lace_stop: workers park after the steal loop instead of exiting
+    atomic_int release;         // set by lace_pool_shutdown: parked workers exit
+    _Atomic(uint32_t) epoch;    // incremented to wake up the parked workers
+    atomic_uint threads;        // number of worker threads that did not exit yet
+
+    /**
+     * Queues of external tasks (one per NUMA node), followed by the queue of high-priority tasks (see RUNHI).
+     * RUN and RUNEX coordination: RUN tasks increase the in-flight counter of the queue of their thread while
+     * they are in flight, RUNEX waits for the sum of the counters to drop to 0 (see lace_ext_in_flight).
+     * The mutex is only used when RUNEX is active.
+     */
+    ext_queue_t *ext_queues;
+    unsigned int n_ext_queues;
+    ext_queue_t *high_queue;
+    pthread_mutex_t external_task_lock;
+    pthread_cond_t external_task_cond;
+    atomic_int external_task_exclusive;
+
+#if LACE_USE_HWLOC
+    hwloc_topology_t topo;      // HWLOC information
+    unsigned int n_nodes, n_cores;
+    uint16_t *steal_order;      // victims of each worker, ordered by level (see lace_init_steal_order)
+    unsigned int *steal_level_end;
+#if defined(__linux__)
+    unsigned int *pu_ext_queue; // map from OS index of each PU to the queue of its NUMA node
+    unsigned int n_pu_ext_queue;
+#endif
+#endif
+
+    _Atomic(Task*) __attribute__((aligned(LINE_SIZE))) newframe; // task of NEWFRAME and TOGETHER
+    _Atomic(unsigned int) __attribute__((aligned(LINE_SIZE))) sleeping; // number of parked workers, read by SPAWN
+    _Atomic(unsigned int) __attribute__((aligned(LINE_SIZE))) high; // number of pending high-priority tasks, read by idle workers
+};
+
+/**
+ * The default pool, used by threads that did not select another pool with lace_set_pool.
+ */
+static lace_pool_t default_pool = {
+    .default_dqsize = 100000,
+    .external_task_lock = PTHREAD_MUTEX_INITIALIZER,
+    .external_task_cond = PTHREAD_COND_INITIALIZER,
+};
+
+#if LACE_USE_HWLOC
 /**
- * (Secret) holds pointers to the memory block allocated for each worker
+ * Get the index of the NUMA node that contains the given cpuset (or 0 if there is none)
  */
-static worker_data **workers_memory = NULL;
+static unsigned int
+lace_node_index(lace_pool_t *p, hwloc_const_cpuset_t cpuset)
+{
+    for (unsigned int i=0; i<p->n_nodes; i++) {
+        hwloc_obj_t node = hwloc_get_obj_by_type(p->topo, HWLOC_OBJ_NODE, i);
+        if (node != NULL && hwloc_bitmap_isincluded(cpuset, node->cpuset)) return i;
+    }
+    return 0;
+}
 
 /**
- * Number of bytes allocated for each worker's worker data.
+ * Get the core of worker <worker>; the workers of a pool are placed from its first core onwards.
  */
-static size_t workers_memory_size = 0;
+static inline unsigned int
+lace_core_of(lace_pool_t *p, unsigned int worker)
+{
+    return (p->first_core + worker) % p->n_cores;
+}
 
 /**
- * (Secret) holds pointer to private Worker data, just for stats collection at end
+ * Victim selection in the steal loop goes through LACE_STEAL_LEVELS levels of distance:
+ * 0: SMT siblings (same core), 1: same L3 cache, 2: same NUMA node, 3: remote NUMA nodes.
+ * For each worker, steal_order holds the other workers ordered by level,
+ * and steal_level_end holds the end of each level in steal_order.
  */
-static WorkerP **workers_p;
+#define LACE_STEAL_LEVELS 4
 
 /**
- * Flag to signal all workers to quit.
+ * Get the distance level between the cores of workers <a> and <b>.
  */
-static atomic_int lace_quits = 0;
-static atomic_uint workers_running = 0;
+static unsigned int
+lace_steal_level(lace_pool_t *p, unsigned int a, unsigned int b)
+{
+    hwloc_obj_t core_a = hwloc_get_obj_by_type(p->topo, HWLOC_OBJ_CORE, lace_core_of(p, a));
+    hwloc_obj_t core_b = hwloc_get_obj_by_type(p->topo, HWLOC_OBJ_CORE, lace_core_of(p, b));
+    if (core_a == core_b) return 0;
+#if HWLOC_API_VERSION >= 0x00020000
+    hwloc_obj_t l3_a = hwloc_get_ancestor_obj_by_type(p->topo, HWLOC_OBJ_L3CACHE, core_a);
+    if (l3_a != NULL && l3_a == hwloc_get_ancestor_obj_by_type(p->topo, HWLOC_OBJ_L3CACHE, core_b)) return 1;
+#endif
+    if (lace_node_index(p, core_a->cpuset) == lace_node_index(p, core_b->cpuset)) return 2;
+    return 3;
+}
 
+/**
+ * Compute steal_order and steal_level_end for all workers.
+ */
+static void
+lace_init_steal_order(lace_pool_t *p, unsigned int n)
+{
+    p->steal_order = malloc(sizeof(uint16_t) * n * n);
+    p->steal_level_end = malloc(sizeof(unsigned int) * n * LACE_STEAL_LEVELS);
+    if (p->steal_order == NULL || p->steal_level_end == NULL) {
+        fprintf(stderr, "Lace error: unable to allocate memory for the victim selection!\n");
+        exit(1);
+    }
+    for (unsigned int w=0; w<n; w++) {
+        uint16_t *order = p->steal_order + w*n;
+        unsigned int *ends = p->steal_level_end + w*LACE_STEAL_LEVELS;
+        unsigned int k = 0;
+        for (unsigned int l=0; l<LACE_STEAL_LEVELS; l++) {
+            // start after w, so workers at the same level do not all prefer the same victims
+            for (unsigned int j=1; j<n; j++) {
+                unsigned int v = (w + j) % n;
+                if (lace_steal_level(p, w, v) == l) order[k++] = v;
+            }
+            ends[l] = k;
+        }
+    }
+}
+#endif
 /**
  * Thread-specific mechanism to access current worker data
  */
 #ifdef __linux__
 static __thread WorkerP *current_worker;
+static __thread lace_pool_t *selected_pool;
 #else
 static pthread_key_t current_worker_key;
-#endif
+static pthread_key_t selected_pool_key;
+static pthread_once_t lace_keys_once = PTHREAD_ONCE_INIT;
 
-/**
- * Global newframe variable used for the implementation of NEWFRAME and TOGETHER
- */
-lace_newframe_t lace_newframe;
+static void
+lace_create_keys(void)
+{
+    pthread_key_create(&current_worker_key, NULL);
+    pthread_key_create(&selected_pool_key, NULL);
+}
+#endif
 
 /**
  * Retrieve whether we are running as a Lace worker
@@ -151,10 +368,63 @@ lace_get_worker()
 #ifdef __linux__
     return current_worker;
 #else
+    pthread_once(&lace_keys_once, lace_create_keys);
     return (WorkerP*)pthread_getspecific(current_worker_key);
 #endif
 }
 
+/**
+ * Get the pool selected by the current thread (NULL for the default pool)
+ */
+static inline lace_pool_t*
+lace_selected_pool(void)
+{
+#ifdef __linux__
+    return selected_pool;
+#else
+    pthread_once(&lace_keys_once, lace_create_keys);
+    return (lace_pool_t*)pthread_getspecific(selected_pool_key);
+#endif
+}
+
+/**
+ * Get the pool that the Lace API operates on: the pool of the current worker,
+ * or otherwise the pool selected by this thread, or otherwise the default pool.
+ */
+static lace_pool_t*
+lace_current_pool(void)
+{
+    WorkerP *w = lace_get_worker();
+    if (w != NULL) return w->pool;
+    lace_pool_t *p = lace_selected_pool();
+    return p != NULL ? p : &default_pool;
+}
+
+lace_pool_t*
+lace_default_pool(void)
+{
+    return &default_pool;
+}
+
+lace_pool_t*
+lace_get_pool(void)
+{
+    return lace_current_pool();
+}
+
+lace_pool_t*
+lace_set_pool(lace_pool_t *pool)
+{
+    lace_pool_t *prev = lace_selected_pool();
+    if (pool == &default_pool) pool = NULL;
+#ifdef __linux__
+    selected_pool = pool;
+#else
+    pthread_setspecific(selected_pool_key, pool);
+#endif
+    return prev;
+}
+
 /**
  * Find the head of the task deque, using the given private Worker data
  */
@@ -200,7 +470,15 @@ lace_get_head(WorkerP *self)
 unsigned int
 lace_workers()
 {
-    return n_workers;
+    lace_pool_t *p = lace_current_pool();
+    return p->n_workers;
+}
+
+unsigned int
+lace_active_workers()
+{
+    lace_pool_t *p = lace_current_pool();
+    return atomic_load_explicit(&p->n_active, memory_order_relaxed);
 }
 
 /**
@@ -213,40 +491,95 @@ lace_get_stacksize()
 }
 
 /**
- * If we are collecting PIE times, then we need some helper functions.
+ * If we are collecting PIE times, then the ticks of gethrtime are converted to nanoseconds.
+ * The tick rate is calibrated once, by the first lace_start.
  */
 #if LACE_PIE_TIMES
-static uint64_t count_at_start, count_at_end;
-static uint64_t us_elapsed_timer;
+static double ns_per_tick = 1.0;
+static pthread_once_t ticks_once = PTHREAD_ONCE_INIT;
 
-static void
-us_elapsed_start(void)
+static uint64_t
+lace_now_ns(void)
 {
     struct timespec ts_now;
     clock_gettime(CLOCK_MONOTONIC, &ts_now);
-    us_elapsed_timer = ts_now.tv_sec * 1000000LL + ts_now.tv_nsec/1000;
+    return (uint64_t)ts_now.tv_sec * 1000000000ULL + ts_now.tv_nsec;
+}
+
+static void
+lace_calibrate_ticks(void)
+{
+#if defined(__aarch64__)
+    // the frequency of the virtual counter is given by the system
+    uint64_t freq;
+    asm volatile ("mrs %0, cntfrq_el0" : "=r"(freq));
+    if (freq != 0) {
+        ns_per_tick = 1e9 / (double)freq;
+        return;
+    }
+#elif !defined(__x86_64__) && !defined(__i386__) && !defined(_M_X64) && !defined(_M_IX86)
+    // gethrtime uses clock_gettime, so ticks are nanoseconds
+    return;
+#endif
+    // count the ticks during 10 ms of wall time
+    uint64_t ns_begin = lace_now_ns(), ticks_begin = gethrtime();
+    uint64_t ns_end;
+    do { ns_end = lace_now_ns(); } while (ns_end - ns_begin < 10000000);
+    uint64_t ticks = gethrtime() - ticks_begin;
+    if (ticks != 0) ns_per_tick = (double)(ns_end - ns_begin) / (double)ticks;
+}
+
+double
+lace_ticks_to_ns(uint64_t ticks)
+{
+    return ticks * ns_per_tick;
 }
+#endif
 
-static long long unsigned
-us_elapsed(void)
+/**
+ * Monotonic clock in nanoseconds, for the worker statistics and the I/O timers.
+ */
+static inline uint64_t
+lace_clock_ns(void)
 {
     struct timespec ts_now;
     clock_gettime(CLOCK_MONOTONIC, &ts_now);
-    uint64_t t = ts_now.tv_sec * 1000000LL + ts_now.tv_nsec/1000;
-    return t - us_elapsed_timer;
+    return (uint64_t)ts_now.tv_sec * 1000000000ULL + ts_now.tv_nsec;
 }
-#endif
 
 /**
  * Lace barrier implementation, that synchronizes on all workers.
+ * This is a combining tree: each node counts the arrivals of up to LACE_BARRIER_FANIN children
+ * (workers for the leaves), and the last child to arrive continues to the parent node.
+ * When the root is complete, the release travels down the tree, so each worker only spins on
+ * the line of its own leaf and a barrier takes O(log n) steps. Leaves group workers with nearby ids,
+ * which are pinned to nearby cores when Lace uses hwloc, so most traffic stays within a socket or cache.
  */
-typedef struct {
-    atomic_int __attribute__((aligned(LINE_SIZE))) count;
-    atomic_int __attribute__((aligned(LINE_SIZE))) leaving;
-    atomic_int __attribute__((aligned(LINE_SIZE))) wait;
-} barrier_t;
+#define LACE_BARRIER_FANIN 4
+
+struct barrier_node {
+    atomic_int __attribute__((aligned(LINE_SIZE))) count; // number of children that arrived
+    atomic_int sense;           // flipped when the barrier is complete below this node
+    int fanin;                  // number of children
+    int parent;                 // index of the parent node, or -1 for the root
+};
 
-barrier_t lace_bar;
+/**
+ * Arrive at barrier node <i> and wait until the barrier is complete.
+ */
+static void
+lace_barrier_arrive(lace_pool_t *p, int i, int sense)
+{
+    barrier_node_t *node = &p->bar[i];
+    if (atomic_fetch_add_explicit(&node->count, 1, memory_order_acq_rel) == node->fanin-1) {
+        // last to arrive: continue at the parent, then release our children
+        atomic_store_explicit(&node->count, 0, memory_order_relaxed);
+        if (node->parent >= 0) lace_barrier_arrive(p, node->parent, sense);
+        atomic_store_explicit(&node->sense, sense, memory_order_release);
+    } else {
+        while (atomic_load_explicit(&node->sense, memory_order_acquire) != sense) {} // wait
+    }
+}
 
 /**
  * Enter the Lace barrier and wait until all workers have entered the Lace barrier.
@@ -254,36 +587,69 @@ barrier_t lace_bar;
 void
 lace_barrier()
 {
-    int wait = lace_bar.wait;
-    if ((int)n_workers == 1+(atomic_fetch_add_explicit(&lace_bar.count, 1, memory_order_relaxed))) {
-        // we know for sure no other thread can be here
-        atomic_store_explicit(&lace_bar.count, 0, memory_order_relaxed);
-        atomic_store_explicit(&lace_bar.leaving, n_workers, memory_order_relaxed);
-        // flip wait
-        atomic_store_explicit(&lace_bar.wait, 1-wait, memory_order_relaxed);
-    } else {
-        while (wait == lace_bar.wait) {} // wait
-    }
-    lace_bar.leaving -= 1;
+    WorkerP *self = lace_get_worker();
+    lace_pool_t *p = self->pool;
+    worker_data *wd = p->workers_memory[self->worker];
+    wd->barrier_sense = 1 - wd->barrier_sense;
+    lace_barrier_arrive(p, self->worker / LACE_BARRIER_FANIN, wd->barrier_sense);
 }
 
 /**
- * Initialize the Lace barrier
+ * Initialize the Lace barrier: the leaves for the workers, then each next level, up to the root.
  */
 static void
-lace_barrier_init()
+lace_barrier_init(lace_pool_t *p)
 {
-    memset(&lace_bar, 0, sizeof(barrier_t));
+    size_t n_bar = 0;
+    for (size_t n = p->n_workers; ; n = (n + LACE_BARRIER_FANIN - 1) / LACE_BARRIER_FANIN) {
+        n_bar += (n + LACE_BARRIER_FANIN - 1) / LACE_BARRIER_FANIN;
+        if (n <= LACE_BARRIER_FANIN) break;
+    }
+
+#if defined(_MSC_VER) || defined(__MINGW64_VERSION_MAJOR)
+    p->bar = _aligned_malloc(n_bar * sizeof(barrier_node_t), LINE_SIZE);
+#elif defined(__MINGW32__)
+    p->bar = __mingw_aligned_malloc(n_bar * sizeof(barrier_node_t), LINE_SIZE);
+#else
+    p->bar = aligned_alloc(LINE_SIZE, n_bar * sizeof(barrier_node_t));
+#endif
+    if (p->bar == NULL) {
+        fprintf(stderr, "Lace error: unable to allocate memory for the barrier!\n");
+        exit(1);
+    }
+
+    // each level has the nodes for the children at the previous level (starting with the workers)
+    size_t first = 0, n_children = p->n_workers;
+    for (;;) {
+        size_t n = (n_children + LACE_BARRIER_FANIN - 1) / LACE_BARRIER_FANIN;
+        for (size_t i=0; i<n; i++) {
+            barrier_node_t *node = &p->bar[first + i];
+            atomic_store_explicit(&node->count, 0, memory_order_relaxed);
+            atomic_store_explicit(&node->sense, 0, memory_order_relaxed);
+            size_t fanin = n_children - i * LACE_BARRIER_FANIN;
+            node->fanin = fanin < LACE_BARRIER_FANIN ? (int)fanin : LACE_BARRIER_FANIN;
+            node->parent = n == 1 ? -1 : (int)(first + n + i / LACE_BARRIER_FANIN);
+        }
+        if (n == 1) break;
+        first += n;
+        n_children = n;
+    }
 }
 
 /**
- * Destroy the Lace barrier (just wait until all are exited)
+ * Destroy the Lace barrier (the workers have exited, so none of them still waits in the barrier)
  */
 static void
-lace_barrier_destroy()
+lace_barrier_destroy(lace_pool_t *p)
 {
-    // wait for all to exit
-    while (lace_bar.leaving != 0) continue;
+#if defined(_MSC_VER) || defined(__MINGW64_VERSION_MAJOR)
+    _aligned_free(p->bar);
+#elif defined(__MINGW32__)
+    __mingw_aligned_free(p->bar);
+#else
+    free(p->bar);
+#endif
+    p->bar = NULL;
 }
 
 /**
@@ -295,23 +661,24 @@ lace_check_memory(void)
 #if LACE_USE_HWLOC
     // get our current worker
     WorkerP *w = lace_get_worker();
-    void* mem = workers_memory[w->worker];
+    lace_pool_t *p = w->pool;
+    void* mem = p->workers_memory[w->worker];
 
     // get pinned PUs
     hwloc_cpuset_t cpuset = hwloc_bitmap_alloc();
-    hwloc_get_cpubind(topo, cpuset, HWLOC_CPUBIND_THREAD);
+    hwloc_get_cpubind(p->topo, cpuset, HWLOC_CPUBIND_THREAD);
 
     // get nodes of pinned PUs
     hwloc_nodeset_t cpunodes = hwloc_bitmap_alloc();
-    hwloc_cpuset_to_nodeset(topo, cpuset, cpunodes);
+    hwloc_cpuset_to_nodeset(p->topo, cpuset, cpunodes);
 
     // get location of memory
     hwloc_nodeset_t memlocation = hwloc_bitmap_alloc();
-#ifdef hwloc_get_area_memlocation
-    hwloc_get_area_memlocation(topo, mem, sizeof(worker_data), memlocation, HWLOC_MEMBIND_BYNODESET);
+#if HWLOC_API_VERSION >= 0x00020000
+    hwloc_get_area_memlocation(p->topo, mem, sizeof(worker_data), memlocation, HWLOC_MEMBIND_BYNODESET);
 #else
     hwloc_membind_policy_t policy;
-    int res = hwloc_get_area_membind_nodeset(topo, mem, sizeof(worker_data), memlocation, &policy, HWLOC_MEMBIND_STRICT);
+    int res = hwloc_get_area_membind_nodeset(p->topo, mem, sizeof(worker_data), memlocation, &policy, HWLOC_MEMBIND_STRICT);
     if (res == -1) {
         fprintf(stdout, "Lace warning: hwloc_get_area_membind_nodeset returned -1!\n");
     }
@@ -341,15 +708,16 @@ lace_check_memory(void)
 #endif
 }
 
-void
-lace_pin_worker(void)
+/**
+ * Pin the current thread, which is worker <worker>, to its logical processor.
+ * This is done before the worker allocates its memory, so the memory is allocated on the NUMA node of the worker.
+ */
+static void
+lace_pin_worker(lace_pool_t *p, unsigned int worker)
 {
 #if LACE_USE_HWLOC
-    // Get our worker
-    unsigned int worker = lace_get_worker()->worker;
-
     // Get our core (hwloc object)
-    hwloc_obj_t pu = hwloc_get_obj_by_type(topo, HWLOC_OBJ_CORE, worker % n_cores);
+    hwloc_obj_t pu = hwloc_get_obj_by_type(p->topo, HWLOC_OBJ_CORE, lace_core_of(p, worker));
 
     // Get our copy of the bitmap
     hwloc_cpuset_t bmp = hwloc_bitmap_dup(pu->cpuset);
@@ -365,7 +733,7 @@ lace_pin_worker(void)
     }
 
     // Select the correct PU on the core (in case of hyperthreading)
-    int idx = worker / n_cores;
+    int idx = worker / p->n_cores;
     if (idx >= count) {
         fprintf(stderr, "Lace warning: more workers than available logical processors!\n");
         idx %= count;
@@ -377,57 +745,129 @@ lace_pin_worker(void)
     hwloc_bitmap_only(bmp, n);
 
     // Pin our thread...
-    if (hwloc_set_cpubind(topo, bmp, HWLOC_CPUBIND_THREAD) == -1) {
+    if (hwloc_set_cpubind(p->topo, bmp, HWLOC_CPUBIND_THREAD) == -1) {
         fprintf(stderr, "Lace warning: hwloc_set_cpubind returned -1!\n");
     }
 
     // Free our copy of the bitmap
     hwloc_bitmap_free(bmp);
+#else
+    (void)p;
+    (void)worker;
+#endif
+}
 
-    // Pin the memory area (using the appropriate hwloc function)
-#ifdef HWLOC_MEMBIND_BYNODESET
-    int res = hwloc_set_area_membind(topo, workers_memory[worker], workers_memory_size, pu->nodeset, HWLOC_MEMBIND_BIND, HWLOC_MEMBIND_STRICT | HWLOC_MEMBIND_MIGRATE | HWLOC_MEMBIND_BYNODESET);
+/**
+ * Bind the memory <mem> of worker <worker> to its NUMA node, before the memory is first used.
+ * Without hwloc, the memory is only placed by first touch, as the worker initializes it.
+ */
+static void
+lace_bind_memory(lace_pool_t *p, unsigned int worker, void *mem)
+{
+#if LACE_USE_HWLOC
+    hwloc_obj_t pu = hwloc_get_obj_by_type(p->topo, HWLOC_OBJ_CORE, lace_core_of(p, worker));
+#if HWLOC_API_VERSION >= 0x00020000
+    int res = hwloc_set_area_membind(p->topo, mem, p->workers_memory_size, pu->nodeset, HWLOC_MEMBIND_BIND, HWLOC_MEMBIND_STRICT | HWLOC_MEMBIND_MIGRATE | HWLOC_MEMBIND_BYNODESET);
 #else
-    int res = hwloc_set_area_membind_nodeset(topo, workers_memory[worker], workers_memory_size, pu->nodeset, HWLOC_MEMBIND_BIND, HWLOC_MEMBIND_STRICT | HWLOC_MEMBIND_MIGRATE);
+    int res = hwloc_set_area_membind_nodeset(p->topo, mem, p->workers_memory_size, pu->nodeset, HWLOC_MEMBIND_BIND, HWLOC_MEMBIND_STRICT | HWLOC_MEMBIND_MIGRATE);
 #endif
     if (res != 0) {
         fprintf(stderr, "Lace error: Unable to bind worker memory to node!\n");
     }
-
-    // Check if everything is on the correct node
-    lace_check_memory();
+#else
+    (void)p;
+    (void)worker;
+    (void)mem;
 #endif
 }
 
-void
-lace_init_worker(unsigned int worker)
+static void lace_arena_free(WorkerP *w);
+
+/**
+ * Allocate the memory of worker <worker>, by the worker itself.
+ * The memory is only visible to other threads in workers_memory when it is initialized (see lace_init_worker).
+ */
+static worker_data*
+lace_alloc_worker(lace_pool_t *p, unsigned int worker)
 {
-    // Allocate our memory
+    worker_data *mem;
 #if LACE_USE_MMAP
-    workers_memory[worker] = mmap(NULL, workers_memory_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-    if (workers_memory[worker] == MAP_FAILED) {
-        fprintf(stderr, "Lace error: Unable to allocate mmapped memory for the Lace worker!\n");
+    int huge = 0;
+#ifdef MAP_HUGETLB
+    if (huge_pages == LACE_HUGE_PAGES_EXPLICIT) {
+        // the huge pages are reserved at once, as mprotect can only commit whole huge pages (see lace_start)
+        mem = mmap(NULL, p->workers_memory_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED) huge = 1;
+        else fprintf(stderr, "Lace warning: Unable to map huge pages for the Lace worker, using normal pages!\n");
+    }
+#endif
+    if (!huge) {
+        // Reserve address space for the largest deque, but only commit the initial part
+#ifdef MAP_NORESERVE
+        mem = mmap(NULL, p->workers_memory_size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+#else
+        mem = mmap(NULL, p->workers_memory_size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+#endif
+        if (mem == MAP_FAILED) {
+            fprintf(stderr, "Lace error: Unable to allocate mmapped memory for the Lace worker!\n");
+            exit(1);
+        }
+    }
+    lace_bind_memory(p, worker, mem);
+#ifdef MADV_HUGEPAGE
+    if (huge_pages == LACE_HUGE_PAGES_TRANSPARENT) madvise(mem, p->workers_memory_size, MADV_HUGEPAGE);
+#endif
+    // commit the worker data for the flag below; lace_init_worker commits the initial deque
+    if (!huge && mprotect(mem, sizeof(worker_data), PROT_READ|PROT_WRITE) != 0) {
+        fprintf(stderr, "Lace error: Unable to commit mmapped memory for the Lace worker!\n");
         exit(1);
     }
+    mem->huge = huge;
 #else
 #if defined(_MSC_VER) || defined(__MINGW64_VERSION_MAJOR)
-    workers_memory[worker] = _aligned_malloc(workers_memory_size, LINE_SIZE);
+    mem = _aligned_malloc(p->workers_memory_size, LINE_SIZE);
 #elif defined(__MINGW32__)
-    workers_memory[worker] = __mingw_aligned_malloc(workers_memory_size, LINE_SIZE);
+    mem = __mingw_aligned_malloc(p->workers_memory_size, LINE_SIZE);
 #else
-    workers_memory[worker] = aligned_alloc(LINE_SIZE, workers_memory_size);
+    mem = aligned_alloc(LINE_SIZE, p->workers_memory_size);
 #endif
-    if (workers_memory[worker] == 0) {
+    if (mem == 0) {
         fprintf(stderr, "Lace error: Unable to allocate memory for the Lace worker!\n");
         exit(1);
     }
-    memset(workers_memory[worker], 0, workers_memory_size);
+    lace_bind_memory(p, worker, mem);
+    memset(mem, 0, p->workers_memory_size);
+#endif
+    return mem;
+}
+
+/**
+ * Initialize worker <worker> with its memory <mem>, when it starts and when a warm restart reuses it.
+ * The overflow arena and the trace buffer are kept when the memory is reused.
+ */
+void
+lace_init_worker(lace_pool_t *p, unsigned int worker, worker_data *mem)
+{
+#if LACE_USE_MMAP
+    // Commit the initial deque, which may be larger than when the memory was reused
+    size_t commit = sizeof(worker_data) + p->wls_size + sizeof(Task) * p->default_dqsize;
+    commit = (commit + page_size - 1) & ~(page_size - 1);
+    if (!mem->huge && mprotect(mem, commit, PROT_READ|PROT_WRITE) != 0) {
+        fprintf(stderr, "Lace error: Unable to commit mmapped memory for the Lace worker!\n");
+        exit(1);
+    }
+    // touch the initial deque now, so it is allocated on the NUMA node of this thread (first touch)
+    for (size_t i=0; i<commit; i+=page_size) ((volatile char*)mem)[i] = ((volatile char*)mem)[i];
 #endif
+    p->workers_memory[worker] = mem;
 
     // Set pointers
-    Worker *wt = workers[worker] = &workers_memory[worker]->worker_public;
-    WorkerP *w = workers_p[worker] = &workers_memory[worker]->worker_private;
-    w->dq = workers_memory[worker]->deque;
+    Worker *wt = p->workers[worker] = &p->workers_memory[worker]->worker_public;
+    WorkerP *w = &p->workers_memory[worker]->worker_private;
+    atomic_store_explicit(&w->interrupt, 0, memory_order_relaxed);
+    p->workers_p[worker] = w;
+    w->wls = (char*)p->workers_memory[worker]->deque;
+    w->dq = (Task*)(w->wls + p->wls_size);
 #ifdef __linux__
     current_worker = w;
 #else
@@ -437,21 +877,68 @@ lace_init_worker(unsigned int worker)
     // Initialize public worker data
     wt->dq = w->dq;
     wt->ts.v = 0;
+    wt->worker = worker;
     wt->allstolen = 0;
     wt->movesplit = 0;
 
     // Initialize private worker data
     w->_public = wt;
-    w->end = w->dq + default_dqsize;
+    w->end = w->dq + p->default_dqsize;
     w->split = w->dq;
     w->allstolen = 0;
     w->worker = worker;
+    w->pool = p;
+    w->sleeping = &p->sleeping;
+    w->cache = p->cache;
+    w->cache_mask = p->cache_entries - 1;
 #if LACE_USE_HWLOC
-    w->pu = worker % n_cores;
+    w->pu = lace_core_of(p, worker);
+    p->workers_memory[worker]->ext_queue = lace_node_index(p, hwloc_get_obj_by_type(p->topo, HWLOC_OBJ_CORE, w->pu)->cpuset);
 #else
     w->pu = -1;
+    p->workers_memory[worker]->ext_queue = 0;
 #endif
+    p->workers_memory[worker]->barrier_sense = 0;
+    atomic_store_explicit(&p->workers_memory[worker]->park, 0, memory_order_relaxed);
     w->rng = (((uint64_t)rand())<<32 | rand());
+    memset(&w->stats, 0, sizeof(lace_stats_ctr));
+    memset(w->wls, 0, p->wls_size);
+    for (lace_reducer_t *r = reducers; r != NULL; r = r->next) r->identity(w->wls + r->slot);
+    // a reused arena is empty, unless its size changed
+    if ((w->arena != NULL && (size_t)(w->arena_end - w->arena) != arena_size) ||
+        (w->stack != NULL && (size_t)(w->stack_end - w->stack) != arena_size)) lace_arena_free(w);
+    w->arena_top = w->arena;
+    w->arena_end = w->arena != NULL ? w->arena + arena_size : NULL;
+    w->arena_last = NULL;
+    w->stack_top = w->stack;
+    w->stack_end = w->stack != NULL ? w->stack + arena_size : NULL;
+#if LACE_CANCEL
+    w->scope = NULL;
+#endif
+
+#if LACE_TRACE
+    if (w->trace != NULL && w->trace_mask != trace_size - 1) {
+        free(w->trace);
+        w->trace = NULL;
+    }
+    if (w->trace == NULL) w->trace = (lace_trace_entry*)calloc(trace_size, sizeof(lace_trace_entry));
+    if (w->trace == NULL) {
+        fprintf(stderr, "Lace error: Unable to allocate memory for the trace!\n");
+        exit(1);
+    }
+    w->trace_mask = trace_size - 1;
+    atomic_store_explicit(&w->trace_head, 0, memory_order_relaxed);
+#endif
+
+#if LACE_PROFILE
+    if (w->profile == NULL) w->profile = (lace_profile_ctr*)malloc((LACE_PROFILE_TYPES + 1) * sizeof(lace_profile_ctr));
+    if (w->profile == NULL) {
+        fprintf(stderr, "Lace error: Unable to allocate memory for the profile!\n");
+        exit(1);
+    }
+    memset(w->profile, 0, (LACE_PROFILE_TYPES + 1) * sizeof(lace_profile_ctr));
+    w->profile_type = NULL;
+#endif
 
 #if LACE_COUNT_EVENTS
     // Initialize counters
@@ -462,96 +949,1004 @@ lace_init_worker(unsigned int worker)
     w->time = gethrtime();
     w->level = 0;
 #endif
-}
 
-static atomic_int must_suspend = 0;
-static sem_t suspend_semaphore;
-static atomic_int lace_awaken_count = 0;
+#if LACE_USE_HWLOC
+    // Check if everything is on the correct node
+    lace_check_memory();
+#endif
 
-void
-lace_suspend()
-{
-    while (1) {
-        int state = atomic_load_explicit(&lace_awaken_count, memory_order_consume);
-        // state "should" be >= 1 !!
-        if (state <= 0) {
-            continue; // ???
-        } else if (state == 1) {
-            int next = -1; // intermediate state
-            if (atomic_compare_exchange_weak(&lace_awaken_count, &state, next) == 1) {
-                while (workers_running != n_workers) {} // they must first run, to avoid rare condition
-                atomic_thread_fence(memory_order_seq_cst);
-                atomic_store_explicit(&must_suspend, 1, memory_order_relaxed);
-                while (workers_running != 0) {}
-                atomic_thread_fence(memory_order_seq_cst);
-                atomic_store_explicit(&must_suspend, 0, memory_order_relaxed);
-                atomic_store_explicit(&lace_awaken_count, 0, memory_order_release);
-                break;
-            }
-        } else {
-            int next = state - 1;
-            if (atomic_compare_exchange_weak(&lace_awaken_count, &state, next) == 1) break;
-        }
-    }
+    // a new frame may have been started before we were in workers_p (see lace_interrupt_workers)
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&p->newframe) != NULL) atomic_fetch_or(&w->interrupt, LACE_INTERRUPT_NEWFRAME);
 }
 
-void
-lace_resume()
+/**
+ * Free memory allocated with the aligned allocation of the platform.
+ */
+static void
+lace_aligned_free(void *ptr)
 {
-    while (1) {
-        int state = atomic_load_explicit(&lace_awaken_count, memory_order_consume);
-        if (state < 0) {
-            continue; // wait until suspending is done
-        } else if (state == 0) {
-            int next = -1; // intermediate state
-            if (atomic_compare_exchange_weak(&lace_awaken_count, &state, next) == 1) {
-                for (unsigned int i=0; i<n_workers; i++) sem_post(&suspend_semaphore);
-                atomic_store_explicit(&lace_awaken_count, 1, memory_order_release);
-                break;
-            }
-        } else {
-            int next = state + 1;
-            if (atomic_compare_exchange_weak(&lace_awaken_count, &state, next) == 1) break;
-        }
-    }
+#if defined(_MSC_VER) || defined(__MINGW64_VERSION_MAJOR)
+    _aligned_free(ptr);
+#elif defined(__MINGW32__)
+    __mingw_aligned_free(ptr);
+#else
+    free(ptr);
+#endif
 }
 
 /**
- * Simple random number generated (like rand) using the given seed.
- * (Used for thread-specific (scalable) random number generation.
+ * Get the program stack size of the workers.
  */
-static inline uint32_t
-rng(uint32_t *seed, int max)
+static size_t
+lace_thread_stacksize(void)
 {
-    uint32_t next = *seed;
+    if (stacksize != 0) return stacksize;
+    // on certain systems, the default stack size is too small (e.g. OSX)
+    // so by default, we just pick the current RLIMIT_STACK or 16M whichever is smallest
+#ifndef _WIN32
+    struct rlimit lim;
+    getrlimit(RLIMIT_STACK, &lim);
+    size_t size = lim.rlim_cur;
+    if (size > 16*1024*1024) size = 16*1024*1024;
+#else
+    size_t size = 16*1024*1024;
+#endif
+    return size;
+}
 
-    next *= 1103515245;
-    next += 12345;
+/**
+ * Allocate <size> bytes for an overflow arena or an allocation stack.
+ * With mmap, this only reserves address space; the pages are allocated on first touch by the worker.
+ */
+static char*
+lace_arena_map(size_t size)
+{
+#if LACE_USE_MMAP
+#ifdef MAP_NORESERVE
+    char *arena = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+#else
+    char *arena = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+#endif
+    if (arena == MAP_FAILED) arena = NULL;
+#elif defined(_MSC_VER) || defined(__MINGW64_VERSION_MAJOR)
+    char *arena = _aligned_malloc(size, LINE_SIZE);
+#elif defined(__MINGW32__)
+    char *arena = __mingw_aligned_malloc(size, LINE_SIZE);
+#else
+    char *arena = aligned_alloc(LINE_SIZE, size);
+#endif
+    return arena;
+}
+
+static void
+lace_arena_unmap(char *arena, size_t size)
+{
+#if LACE_USE_MMAP
+    munmap(arena, size);
+#else
+    (void)size;
+    lace_aligned_free(arena);
+#endif
+}
+
+/**
+ * Called by lace_arena_alloc when the overflow arena has no room for <size> more bytes.
+ * The arena is allocated when a worker first spawns a task that does not fit in a Task.
+ * The arena does not move, since the task data in it may be used by thieves, so it cannot grow.
+ */
+char *
+lace_arena_alloc_slow(WorkerP *w, size_t size)
+{
+    if (w->arena == NULL && size <= arena_size) {
+        char *arena = lace_arena_map(arena_size);
+        if (arena == NULL) {
+            fprintf(stderr, "Lace error: Unable to allocate memory for the task data arena!\n");
+            exit(1);
+        }
+        w->arena = arena;
+        w->arena_end = arena + arena_size;
+        return arena;
+    }
+    fprintf(stderr, "Lace fatal error: Task data arena overflow! Increase it with lace_set_arena_size. Aborting.\n");
+    exit(-1);
+}
+
+/**
+ * Called by lace_stack_alloc when the allocation stack has no room for <size> more bytes.
+ * Like the arena, the stack is allocated on first use and does not move, as other workers may use the memory.
+ */
+char *
+lace_stack_alloc_slow(WorkerP *w, size_t size)
+{
+    if (w->stack != NULL && w->stack_top == NULL && size <= (size_t)(w->stack_end - w->stack)) return w->stack;
+    if (w->stack == NULL && size <= arena_size) {
+        char *stack = lace_arena_map(arena_size);
+        if (stack == NULL) {
+            fprintf(stderr, "Lace error: Unable to allocate memory for the allocation stack!\n");
+            exit(1);
+        }
+        w->stack = stack;
+        w->stack_end = stack + arena_size;
+        return stack;
+    }
+    fprintf(stderr, "Lace fatal error: Allocation stack overflow! Increase it with lace_set_arena_size. Aborting.\n");
+    exit(-1);
+}
+
+/**
+ * Release the overflow arena and the allocation stack of a worker (called by lace_stop,
+ * or when a reused arena has the wrong size).
+ */
+static void
+lace_arena_free(WorkerP *w)
+{
+    if (w->arena != NULL) lace_arena_unmap(w->arena, w->arena_end - w->arena);
+    if (w->stack != NULL) lace_arena_unmap(w->stack, w->stack_end - w->stack);
+    w->arena = NULL;
+    w->stack = NULL;
+}
+
+/**
+ * Header of a slab of LACE_SLAB_SIZE bytes, aligned to LACE_SLAB_SIZE, so lace_free finds the header of an object.
+ * A slab holds objects of one size class of its owner.
+ */
+typedef struct lace_slab {
+    struct lace_slab *next;     // next slab of the owner
+    WorkerP *owner;             // owner of the slab
+    _Atomic(void*) *remote;     // list of objects freed by other threads of the owner
+    unsigned int size_class;
+    char pad[PAD(4*sizeof(void*)+sizeof(unsigned int), LINE_SIZE)];
+    uintptr_t tag;              // 0, so the first object is not mistaken for a large object (see lace_large_tag)
+} lace_slab;
+
+/**
+ * Objects that are larger than LACE_SLAB_MAX or that are allocated outside Lace workers come from malloc,
+ * behind a header of LINE_SIZE bytes. The last word of the header is the tag of the object, which lace_free
+ * checks to tell these objects apart from slab objects, which are preceded by the slab header or by another
+ * object of their size class.
+ */
+#define LACE_LARGE_MAGIC ((uintptr_t)0x6c61636520626967ULL)
+
+static inline uintptr_t
+lace_large_tag(void *ptr)
+{
+    return (uintptr_t)ptr ^ LACE_LARGE_MAGIC;
+}
+
+static lace_slab*
+lace_slab_alloc(void)
+{
+#if defined(_MSC_VER) || defined(__MINGW64_VERSION_MAJOR)
+    lace_slab *slab = _aligned_malloc(LACE_SLAB_SIZE, LACE_SLAB_SIZE);
+#elif defined(__MINGW32__)
+    lace_slab *slab = __mingw_aligned_malloc(LACE_SLAB_SIZE, LACE_SLAB_SIZE);
+#else
+    lace_slab *slab = aligned_alloc(LACE_SLAB_SIZE, LACE_SLAB_SIZE);
+#endif
+    if (slab == NULL) {
+        fprintf(stderr, "Lace error: Unable to allocate memory for a slab!\n");
+        exit(1);
+    }
+    slab->tag = 0;
+    return slab;
+}
+
+/**
+ * Get objects of size class <k> for worker <w> when its free list is empty (used by lace_malloc).
+ * First takes all objects that other threads freed, then carves a new slab.
+ */
+static void*
+lace_slab_refill(WorkerP *w, unsigned int k)
+{
+    void *o = atomic_exchange(&w->pool->workers_memory[w->worker]->slab_remote, NULL);
+    while (o != NULL) {
+        void *next = *(void**)o;
+        lace_slab *slab = (lace_slab*)((uintptr_t)o & ~(uintptr_t)(LACE_SLAB_SIZE - 1));
+        *(void**)o = w->slab_free[slab->size_class];
+        w->slab_free[slab->size_class] = o;
+        o = next;
+    }
+    if (w->slab_free[k] != NULL) return w->slab_free[k];
+
+    // objects are carved in reverse order, so they are handed out in address order
+    lace_slab *slab = lace_slab_alloc();
+    slab->next = w->slabs;
+    slab->owner = w;
+    slab->remote = &w->pool->workers_memory[w->worker]->slab_remote;
+    slab->size_class = k;
+    w->slabs = slab;
+    size_t size = (size_t)16 << k;
+    void *head = NULL;
+    for (char *obj = (char*)slab + LACE_SLAB_SIZE - size; obj >= (char*)(slab + 1); obj -= size) {
+        *(void**)obj = head;
+        head = obj;
+    }
+    w->slab_free[k] = head;
+    return head;
+}
+
+void*
+lace_malloc(size_t size)
+{
+    WorkerP *w = lace_get_worker();
+    if (w == NULL || size > LACE_SLAB_MAX) {
+        char *mem = malloc(LINE_SIZE + size);
+        if (mem == NULL) {
+            fprintf(stderr, "Lace error: Unable to allocate memory!\n");
+            exit(1);
+        }
+        void *ptr = mem + LINE_SIZE;
+        ((uintptr_t*)ptr)[-1] = lace_large_tag(ptr);
+        return ptr;
+    }
+    unsigned int k = 0;
+    while (((size_t)16 << k) < size) k++;
+    void *o = w->slab_free[k];
+    if (o == NULL) o = lace_slab_refill(w, k);
+    w->slab_free[k] = *(void**)o;
+    return o;
+}
+
+void
+lace_free(void *ptr)
+{
+    if (ptr == NULL) return;
+    if (((uintptr_t*)ptr)[-1] == lace_large_tag(ptr)) {
+        ((uintptr_t*)ptr)[-1] = 0;
+        free((char*)ptr - LINE_SIZE);
+        return;
+    }
+    lace_slab *slab = (lace_slab*)((uintptr_t)ptr & ~(uintptr_t)(LACE_SLAB_SIZE - 1));
+    if (slab->owner == lace_get_worker()) {
+        *(void**)ptr = slab->owner->slab_free[slab->size_class];
+        slab->owner->slab_free[slab->size_class] = ptr;
+    } else {
+        void *head = atomic_load_explicit(slab->remote, memory_order_relaxed);
+        do {
+            *(void**)ptr = head;
+        } while (!atomic_compare_exchange_weak_explicit(slab->remote, &head, ptr, memory_order_release, memory_order_relaxed));
+    }
+}
+
+/**
+ * Release all slabs of a worker (called by lace_stop when the pool is released).
+ */
+static void
+lace_slab_free_all(WorkerP *w)
+{
+    while (w->slabs != NULL) {
+        lace_slab *next = w->slabs->next;
+        lace_aligned_free(w->slabs);
+        w->slabs = next;
+    }
+    for (unsigned int k=0; k<LACE_SLAB_CLASSES; k++) w->slab_free[k] = NULL;
+}
+
+/**
+ * Wait until *addr is no longer <val>, or until woken up (may return spuriously).
+ * Wake up <n> threads waiting on addr.
+ */
+#ifdef __linux__
+static inline void
+lace_futex_wait(_Atomic(uint32_t) *addr, uint32_t val)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void
+lace_futex_wake(_Atomic(uint32_t) *addr, int n)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+#else
+static pthread_mutex_t futex_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t futex_cond = PTHREAD_COND_INITIALIZER;
+
+static inline void
+lace_futex_wait(_Atomic(uint32_t) *addr, uint32_t val)
+{
+    pthread_mutex_lock(&futex_lock);
+    if (atomic_load(addr) == val) pthread_cond_wait(&futex_cond, &futex_lock);
+    pthread_mutex_unlock(&futex_lock);
+}
+
+static inline void
+lace_futex_wake(_Atomic(uint32_t) *addr, int n)
+{
+    pthread_mutex_lock(&futex_lock);
+    pthread_cond_broadcast(&futex_cond);
+    pthread_mutex_unlock(&futex_lock);
+    (void)addr;
+    (void)n;
+}
+#endif
+
+/**
+ * Set the idle policy of Lace workers.
+ */
+void
+lace_set_backoff(unsigned int spins, unsigned int yields)
+{
+    backoff_spins = spins;
+    backoff_yields = yields;
+}
+
+/**
+ * Set whether the task deques use huge pages.
+ */
+void
+lace_set_huge_pages(int policy)
+{
+    huge_pages = policy;
+}
+
+/**
+ * Enable or disable releasing unused memory when Lace is suspended.
+ */
+void
+lace_set_release_memory(int enabled)
+{
+    release_memory = enabled;
+}
+
+/**
+ * Enable or disable steal-half mode.
+ */
+void
+lace_set_steal_half(int enabled)
+{
+    lace_steal_half = enabled ? 1 : 0;
+}
+
+/**
+ * Set the victim selection policy of Lace workers.
+ */
+void
+lace_set_steal_locality(unsigned int attempts)
+{
+    steal_locality = attempts;
+}
+
+/**
+ * Unpark worker <i> if it is parked. Returns 1 if the worker was woken up.
+ */
+static inline int
+lace_unpark(lace_pool_t *p, unsigned int i)
+{
+    worker_data *wd = p->workers_memory[i];
+    if (wd == NULL || atomic_load_explicit(&wd->park, memory_order_relaxed) == 0) return 0;
+    uint32_t expected = 1;
+    if (!atomic_compare_exchange_strong(&wd->park, &expected, 0)) return 0;
+    atomic_fetch_sub(&p->sleeping, 1);
+    lace_futex_wake(&wd->park, 1);
+    return 1;
+}
+
+static void
+lace_pool_wake_one(lace_pool_t *p)
+{
+    // the work was published with relaxed (or release) stores; pairs with the fence in lace_park, so that
+    // either the parking worker sees the work, or we see that it sleeps
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&p->sleeping) == 0) return;
+    for (unsigned int i=0; i<p->n_workers; i++) {
+        if (lace_unpark(p, i)) return;
+    }
+}
+
+void
+lace_wake_one(WorkerP *w)
+{
+    lace_pool_wake_one(w->pool);
+}
+
+/**
+ * Notify the retired workers that they must check if they are active, suspend, quit or join a new frame.
+ */
+static void
+lace_notify_retired(lace_pool_t *p)
+{
+    for (unsigned int i=0; i<p->n_workers; i++) {
+        worker_data *wd = p->workers_memory[i];
+        if (wd == NULL) continue;
+        uint32_t expected = 2;
+        if (atomic_compare_exchange_strong(&wd->park, &expected, 3)) lace_futex_wake(&wd->park, 1);
+    }
+}
+
+static void
+lace_wake_all(lace_pool_t *p)
+{
+    lace_notify_retired(p);
+    if (atomic_load(&p->sleeping) == 0) return;
+    for (unsigned int i=0; i<p->n_workers; i++) lace_unpark(p, i);
+}
+
+static int lace_has_work(lace_pool_t *p, atomic_int *quit);
+
+/**
+ * Park the current worker until it is woken up by lace_wake_one or lace_wake_all.
+ * The worker first announces that it parks, then checks once more for work.
+ */
+static void
+lace_park(WorkerP *self, atomic_int *quit)
+{
+    lace_pool_t *p = self->pool;
+    worker_data *wd = p->workers_memory[self->worker];
+    atomic_store(&wd->park, 1);
+    atomic_fetch_add(&p->sleeping, 1);
+    // pairs with the fence in lace_pool_wake_one and lace_spawn_publish (store, then load on both sides)
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (lace_has_work(p, quit)) {
+        // cancel parking, unless someone already woke us up
+        uint32_t expected = 1;
+        if (atomic_compare_exchange_strong(&wd->park, &expected, 0)) atomic_fetch_sub(&p->sleeping, 1);
+        return;
+    }
+
+    while (atomic_load_explicit(&wd->park, memory_order_acquire) != 0) lace_futex_wait(&wd->park, 1);
+}
+
+/**
+ * Let a retired worker sleep until it is activated again, or until it must quit, suspend or join a new frame.
+ * The worker first announces that it sleeps, then checks the conditions, so it cannot miss a notification.
+ */
+static void
+lace_retire(WorkerP *self, atomic_int *quit)
+{
+    lace_pool_t *p = self->pool;
+    worker_data *wd = p->workers_memory[self->worker];
+    atomic_store(&wd->park, 2);
+    while (self->worker >= atomic_load(&p->n_active) && atomic_load(quit) == 0 &&
+           atomic_load(&p->must_suspend) == 0 && atomic_load(&p->newframe) == NULL) {
+        lace_futex_wait(&wd->park, 2);
+        uint32_t expected = 3;
+        atomic_compare_exchange_strong(&wd->park, &expected, 2);
+    }
+    atomic_store(&wd->park, 0);
+}
+
+void
+lace_set_active_workers(unsigned int k)
+{
+    lace_pool_t *p = lace_current_pool();
+    if (k < 1) k = 1;
+    if (k > p->n_workers) k = p->n_workers;
+    atomic_store(&p->n_active, k);
+    // wake up workers that are activated again
+    lace_notify_retired(p);
+}
+
+static int lace_ext_in_flight(lace_pool_t *p);
+
+void
+lace_suspend()
+{
+    lace_pool_t *p = lace_current_pool();
+    while (1) {
+        int state = atomic_load_explicit(&p->awaken_count, memory_order_consume);
+        // state "should" be >= 1 !!
+        if (state <= 0) {
+            continue; // ???
+        } else if (state == 1) {
+            int next = -1; // intermediate state
+            if (atomic_compare_exchange_weak(&p->awaken_count, &state, next) == 1) {
+                // RUN tasks that entered while the workers were awake must complete (see lace_ext_enter_awake)
+                while (lace_ext_in_flight(p) != 0) {}
+                while (p->workers_running != p->n_workers) {} // they must first run, to avoid rare condition
+                atomic_thread_fence(memory_order_seq_cst);
+                atomic_store_explicit(&p->must_suspend, 1, memory_order_relaxed);
+                lace_wake_all(p);
+                while (p->workers_running != 0) {}
+                atomic_thread_fence(memory_order_seq_cst);
+                atomic_store_explicit(&p->must_suspend, 0, memory_order_relaxed);
+                atomic_store_explicit(&p->awaken_count, 0, memory_order_release);
+                break;
+            }
+        } else {
+            int next = state - 1;
+            if (atomic_compare_exchange_weak(&p->awaken_count, &state, next) == 1) break;
+        }
+    }
+}
+
+void
+lace_resume()
+{
+    lace_pool_t *p = lace_current_pool();
+    while (1) {
+        int state = atomic_load_explicit(&p->awaken_count, memory_order_consume);
+        if (state < 0) {
+            continue; // wait until suspending is done
+        } else if (state == 0) {
+            int next = -1; // intermediate state
+            if (atomic_compare_exchange_weak(&p->awaken_count, &state, next) == 1) {
+                for (unsigned int i=0; i<p->n_workers; i++) sem_post(&p->suspend_semaphore);
+                atomic_store_explicit(&p->awaken_count, 1, memory_order_release);
+                break;
+            }
+        } else {
+            int next = state + 1;
+            if (atomic_compare_exchange_weak(&p->awaken_count, &state, next) == 1) break;
+        }
+    }
+}
+
+/**
+ * Simple random number generated (like rand) using the given seed.
+ * (Used for thread-specific (scalable) random number generation.
+ */
+static inline uint32_t
+rng(uint32_t *seed, int max)
+{
+    uint32_t next = *seed;
+
+    next *= 1103515245;
+    next += 12345;
 
     *seed = next;
 
-    return next % max;
+    return next % max;
+}
+
+/**
+ * "External" task management
+ */
+
+/**
+ * Bounded lock-free multi-producer multi-consumer queue of external tasks.
+ * Each cell has a sequence number that tells producers and consumers whose turn it is.
+ * When Lace uses hwloc, there is one queue per NUMA node.
+ */
+#define EXT_QUEUE_SIZE 1024
+
+typedef struct {
+    _Atomic(size_t) seq;
+    lace_future_t *et;
+} ext_cell_t;
+
+struct ext_queue {
+    _Atomic(size_t) __attribute__((aligned(LINE_SIZE))) enqueue_pos;
+    _Atomic(size_t) __attribute__((aligned(LINE_SIZE))) dequeue_pos;
+    // RUN tasks in flight that entered here (see lace_ext_enter); only the sum over the queues is meaningful,
+    // as RUN_ASYNC tasks leave via the queue of the worker that ran them
+    atomic_int __attribute__((aligned(LINE_SIZE))) in_flight;
+    ext_cell_t __attribute__((aligned(LINE_SIZE))) cells[EXT_QUEUE_SIZE];
+};
+
+static void
+ext_queue_init(ext_queue_t *q)
+{
+    for (size_t i=0; i<EXT_QUEUE_SIZE; i++) atomic_store_explicit(&q->cells[i].seq, i, memory_order_relaxed);
+    atomic_store_explicit(&q->enqueue_pos, 0, memory_order_relaxed);
+    atomic_store_explicit(&q->dequeue_pos, 0, memory_order_relaxed);
+    atomic_store_explicit(&q->in_flight, 0, memory_order_relaxed);
+}
+
+/**
+ * Add the external task <et> to the queue. Returns 0 if the queue is full.
+ */
+static int
+ext_queue_push(ext_queue_t *q, lace_future_t *et)
+{
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    ext_cell_t *cell;
+    for (;;) {
+        cell = &q->cells[pos & (EXT_QUEUE_SIZE-1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos+1, memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+    cell->et = et;
+    atomic_store_explicit(&cell->seq, pos+1, memory_order_release);
+    return 1;
+}
+
+/**
+ * Take the oldest task from the queue. Returns NULL if the queue is empty.
+ */
+static lace_future_t*
+ext_queue_pop(ext_queue_t *q)
+{
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    ext_cell_t *cell;
+    for (;;) {
+        cell = &q->cells[pos & (EXT_QUEUE_SIZE-1)];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos+1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos+1, memory_order_relaxed, memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+    lace_future_t *et = cell->et;
+    atomic_store_explicit(&cell->seq, pos+EXT_QUEUE_SIZE, memory_order_release);
+    return et;
+}
+
+static inline int
+ext_queue_nonempty(ext_queue_t *q)
+{
+    return atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed) != atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+}
+
+/**
+ * Check if any of the external task queues has tasks.
+ */
+static inline int
+lace_ext_pending(lace_pool_t *p)
+{
+    for (unsigned int i=0; i<p->n_ext_queues; i++) {
+        if (ext_queue_nonempty(&p->ext_queues[i])) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Select the queue for a task submitted by the current thread, i.e., the queue of its NUMA node.
+ */
+static inline ext_queue_t*
+lace_ext_queue_of_thread(lace_pool_t *p)
+{
+#if LACE_USE_HWLOC && defined(__linux__)
+    int cpu = sched_getcpu();
+    if (cpu >= 0 && (unsigned int)cpu < p->n_pu_ext_queue) return &p->ext_queues[p->pu_ext_queue[cpu]];
+#endif
+    return &p->ext_queues[0];
+}
+
+/**
+ * Offer an external task to the Lace workers via queue <q>.
+ */
+static void
+lace_ext_submit_to(lace_pool_t *p, ext_queue_t *q, lace_future_t *fut)
+{
+    atomic_store_explicit(&fut->task->thief, 0, memory_order_relaxed);
+    atomic_store_explicit(&fut->state, 0, memory_order_relaxed);
+
+    while (!ext_queue_push(q, fut)) sched_yield(); // queue is full
+    lace_pool_wake_one(p);
+}
+
+/**
+ * Offer an external task to the Lace workers.
+ */
+static void
+lace_ext_submit(lace_pool_t *p, lace_future_t *fut)
+{
+    lace_ext_submit_to(p, lace_ext_queue_of_thread(p), fut);
+}
+
+/**
+ * A future that waits for another future (see lace_run_task_after).
+ */
+struct _lace_succ {
+    struct _lace_succ *next;
+    lace_future_t *fut;
+};
+
+static int lace_steal_external(WorkerP *self, Task *dq_head);
+static void lace_df_release(WorkerP *self, Task *dq_head, struct _lace_succ *succ);
+
+int
+lace_future_poll(lace_future_t *fut)
+{
+    return atomic_load_explicit(&fut->state, memory_order_acquire) == 1;
+}
+
+void
+lace_future_wait(lace_future_t *fut)
+{
+    WorkerP *self = lace_get_worker();
+    if (self != 0) {
+        // help the other workers until the task is done, also with external tasks,
+        // as the task may be a dataflow task that is not in a deque
+        Task *head = lace_get_head(self);
+        while (!lace_future_poll(fut)) {
+            if (!lace_steal_external(self, head)) lace_steal_random_CALL(self, head);
+        }
+        return;
+    }
+
+    // spin a little before sleeping
+    for (int i=0; i<256; i++) {
+        if (lace_future_poll(fut)) return;
+    }
+    uint32_t state = 0;
+    if (atomic_compare_exchange_strong(&fut->state, &state, 2) || state == 2) {
+        while (atomic_load_explicit(&fut->state, memory_order_acquire) != 1) lace_futex_wait(&fut->state, 2);
+    }
+}
+
+/**
+ * The I/O thread waits for the file descriptors and timers of all lace_io_t futures with poll.
+ * It is started when it is first needed and keeps running (idle) until the program exits.
+ * Submitting a lace_io_t writes to a pipe to interrupt poll, so the new future is included.
+ */
+#ifndef _WIN32
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static lace_io_t *io_pending = NULL;
+static int io_pipe[2] = { -1, -1 };
+
+static void
+lace_io_complete(lace_io_t *io)
+{
+    lace_future_t *fut = &io->fut;
+    struct _lace_succ *succ = atomic_exchange(&fut->succ, LACE_SUCC_DONE);
+    // after this, the waiter may return, so <io> is no longer valid
+    if (atomic_exchange(&fut->state, 1) == 2) lace_futex_wake(&fut->state, INT_MAX);
+    lace_df_release(NULL, NULL, succ);
+}
+
+static void*
+lace_io_thread(void *arg)
+{
+    struct pollfd *fds = NULL;
+    size_t fds_size = 0;
+
+    for (;;) {
+        // collect the file descriptors and the first deadline
+        pthread_mutex_lock(&io_lock);
+        size_t n = 1;
+        for (lace_io_t *io = io_pending; io != NULL; io = io->next) n++;
+        if (n > fds_size) {
+            fds_size = 2 * n;
+            fds = (struct pollfd*)realloc(fds, sizeof(struct pollfd) * fds_size);
+            if (fds == NULL) {
+                fprintf(stderr, "Lace error: Unable to allocate memory for the I/O thread!\n");
+                exit(1);
+            }
+        }
+        fds[0] = (struct pollfd){ io_pipe[0], POLLIN, 0 };
+        n = 1;
+        uint64_t deadline = UINT64_MAX;
+        for (lace_io_t *io = io_pending; io != NULL; io = io->next) {
+            if (io->fd >= 0) {
+                io->slot = (int)n;
+                fds[n++] = (struct pollfd){ io->fd, io->events, 0 };
+            }
+            if (io->deadline < deadline) deadline = io->deadline;
+        }
+        pthread_mutex_unlock(&io_lock);
+
+        uint64_t now = lace_clock_ns();
+#ifdef __linux__
+        struct timespec ts, *timeout = NULL;
+        if (deadline != UINT64_MAX) {
+            uint64_t wait = deadline > now ? deadline - now : 0;
+            ts = (struct timespec){ (time_t)(wait / 1000000000ULL), (long)(wait % 1000000000ULL) };
+            timeout = &ts;
+        }
+        ppoll(fds, n, timeout, NULL);
+#else
+        int timeout = -1;
+        if (deadline != UINT64_MAX) {
+            uint64_t wait = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+            timeout = wait > INT_MAX ? INT_MAX : (int)wait;
+        }
+        poll(fds, n, timeout);
+#endif
+
+        if (fds[0].revents) {
+            char buf[64];
+            while (read(io_pipe[0], buf, sizeof(buf)) > 0) {}
+        }
+
+        // take the futures that are ready, then complete them outside the lock
+        lace_io_t *ready = NULL;
+        pthread_mutex_lock(&io_lock);
+        now = lace_clock_ns();
+        lace_io_t **link = &io_pending;
+        while (*link != NULL) {
+            lace_io_t *io = *link;
+            short revents = io->slot > 0 ? fds[io->slot].revents : 0;
+            if (revents != 0 || io->deadline <= now) {
+                io->revents = revents;
+                *link = io->next;
+                io->next = ready;
+                ready = io;
+            } else {
+                io->slot = 0;
+                link = &io->next;
+            }
+        }
+        pthread_mutex_unlock(&io_lock);
+
+        while (ready != NULL) {
+            lace_io_t *next = ready->next;
+            lace_io_complete(ready);
+            ready = next;
+        }
+    }
+    (void)arg;
+    return NULL;
+}
+
+static void
+lace_io_start(void)
+{
+    if (pipe(io_pipe) != 0) {
+        fprintf(stderr, "Lace error: Unable to create the pipe of the I/O thread!\n");
+        exit(1);
+    }
+    fcntl(io_pipe[0], F_SETFL, fcntl(io_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(io_pipe[1], F_SETFL, fcntl(io_pipe[1], F_GETFL) | O_NONBLOCK);
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, lace_io_thread, NULL) != 0) {
+        fprintf(stderr, "Lace error: Unable to create the I/O thread!\n");
+        exit(1);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static pthread_once_t io_once = PTHREAD_ONCE_INIT;
+
+void
+lace_io_submit(lace_io_t *io, int fd, short events, int64_t timeout_ns)
+{
+    lace_future_t *fut = &io->fut;
+    fut->task = NULL;
+    fut->async = 0;
+    fut->cb = NULL;
+    fut->arg = NULL;
+    atomic_store_explicit(&fut->succ, NULL, memory_order_relaxed);
+    atomic_store_explicit(&fut->deps, 0, memory_order_relaxed);
+    atomic_store_explicit(&fut->state, 0, memory_order_relaxed);
+    io->fd = fd;
+    io->events = events;
+    io->revents = 0;
+    io->slot = 0;
+    io->deadline = timeout_ns < 0 ? UINT64_MAX : lace_clock_ns() + (uint64_t)timeout_ns;
+
+    // no need for the I/O thread if the file descriptor is ready already
+    if (fd >= 0) {
+        struct pollfd pfd = { fd, events, 0 };
+        if (poll(&pfd, 1, 0) > 0) {
+            io->revents = pfd.revents;
+            lace_io_complete(io);
+            return;
+        }
+    } else if (timeout_ns == 0) {
+        lace_io_complete(io);
+        return;
+    }
+
+    pthread_once(&io_once, lace_io_start);
+    pthread_mutex_lock(&io_lock);
+    io->next = io_pending;
+    io_pending = io;
+    pthread_mutex_unlock(&io_lock);
+    char c = 0;
+    if (write(io_pipe[1], &c, 1) < 0) {} // a full pipe wakes up the I/O thread as well
+}
+
+short
+lace_io_wait(int fd, short events, int64_t timeout_ns)
+{
+    lace_io_t io;
+    lace_io_submit(&io, fd, events, timeout_ns);
+    lace_future_wait(&io.fut);
+    return io.revents;
+}
+
+void
+lace_sleep(int64_t ns)
+{
+    lace_io_wait(-1, 0, ns < 0 ? 0 : ns);
+}
+#endif
+
+/**
+ * Offer an external task to the Lace workers and wait until it is completed.
+ */
+static void
+lace_ext_submit_and_wait(lace_pool_t *p, Task *task)
+{
+    lace_future_t fut;
+    fut.task = task;
+    fut.async = 0;
+    fut.cb = NULL;
+    lace_ext_submit(p, &fut);
+    lace_future_wait(&fut);
+}
+
+/**
+ * Set the interrupt flag <flag> of all workers, which they check in YIELD_NEWFRAME.
+ * A worker that is not yet in workers_p checks the newframe of its pool itself (see lace_init_worker).
+ */
+static void
+lace_interrupt_workers(lace_pool_t *p, uint32_t flag)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    for (unsigned int i=0; i<p->n_workers; i++) {
+        WorkerP *w = p->workers_p[i];
+        if (w != NULL) atomic_fetch_or(&w->interrupt, flag);
+    }
 }
 
 /**
- * "External" task management
+ * Offer a high-priority external task to the Lace workers and wait until it is completed.
+ * The counter is increased before the task is in the queue, so workers never see a negative count.
  */
+static void
+lace_ext_submit_high_and_wait(lace_pool_t *p, Task *task)
+{
+    lace_future_t fut;
+    fut.task = task;
+    fut.async = 0;
+    fut.cb = NULL;
+    atomic_fetch_add(&p->high, 1);
+    lace_ext_submit_to(p, p->high_queue, &fut);
+    lace_interrupt_workers(p, LACE_INTERRUPT_HIGH);
+    lace_future_wait(&fut);
+}
 
 /**
- * Global "external" task
+ * Get the number of RUN tasks in flight, the sum of the counters of the queues.
  */
-typedef struct _ExtTask {
-    Task *task;
-    sem_t sem;
-} ExtTask;
+static int
+lace_ext_in_flight(lace_pool_t *p)
+{
+    int n = 0;
+    for (unsigned int i=0; i<p->n_ext_queues; i++) n += atomic_load(&p->ext_queues[i].in_flight);
+    return n;
+}
 
-static _Atomic(ExtTask*) external_task = NULL;
+static void
+lace_ext_leave(lace_pool_t *p, ext_queue_t *q)
+{
+    atomic_fetch_sub(&q->in_flight, 1);
+    if (atomic_load(&p->external_task_exclusive)) {
+        // if exclusive is set, then RUNEX may wait for the last task in flight
+        pthread_mutex_lock(&p->external_task_lock);
+        pthread_cond_broadcast(&p->external_task_cond);
+        pthread_mutex_unlock(&p->external_task_lock);
+    }
+}
 
-static pthread_mutex_t external_task_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t external_task_cond = PTHREAD_COND_INITIALIZER;
+static void
+lace_ext_enter(lace_pool_t *p, ext_queue_t *q)
+{
+    for (;;) {
+        if (atomic_load(&p->external_task_exclusive) == 0) {
+            atomic_fetch_add(&q->in_flight, 1);
+            if (atomic_load(&p->external_task_exclusive) == 0) return;
+            lace_ext_leave(p, q);
+        }
+        // if "exclusive" is set, then we wait until we can continue
+        pthread_mutex_lock(&p->external_task_lock);
+        while (p->external_task_exclusive) pthread_cond_wait(&p->external_task_cond, &p->external_task_lock);
+        pthread_mutex_unlock(&p->external_task_lock);
+    }
+}
 
-static int external_task_counter = 0;
-static int external_task_exclusive = 0;
+/**
+ * Enter as a RUN task via queue <q> if the workers are not suspended; otherwise return 0 without entering.
+ * This avoids the shared lace_resume/lace_suspend round trip for every RUN: lace_suspend first marks the
+ * pool as suspending and then waits until no RUN task is in flight, so the workers stay awake for us.
+ */
+static int
+lace_ext_enter_awake(lace_pool_t *p, ext_queue_t *q)
+{
+    lace_ext_enter(p, q);
+    if (atomic_load(&p->awaken_count) > 0 && atomic_load(&p->must_suspend) == 0) return 1;
+    lace_ext_leave(p, q);
+    return 0;
+}
 
 void
 lace_run_task(Task *task)
@@ -561,35 +1956,50 @@ lace_run_task(Task *task)
     if (self != 0) {
         task->f(self, lace_get_head(self), task);
     } else {
+        lace_pool_t *p = lace_current_pool();
+        ext_queue_t *q = lace_ext_queue_of_thread(p);
+
+        if (lace_ext_enter_awake(p, q)) {
+            lace_ext_submit_and_wait(p, task);
+            lace_ext_leave(p, q);
+            return;
+        }
+
         // if needed, wake up the workers
         lace_resume();
 
-        ExtTask et;
-        et.task = task;
-        atomic_store_explicit(&et.task->thief, 0, memory_order_relaxed);
-        sem_init(&et.sem, 0, 0);
-
-        pthread_mutex_lock(&external_task_lock);
-        while (external_task_exclusive) {
-            // if "exclusive" is set, then we wait until we can continue
-            pthread_cond_wait(&external_task_cond, &external_task_lock);
-        }
-        external_task_counter++;
-        pthread_mutex_unlock(&external_task_lock);
+        lace_ext_enter(p, q);
+        lace_ext_submit_and_wait(p, task);
+        lace_ext_leave(p, q);
 
-        ExtTask *exp = 0;
-        while (atomic_compare_exchange_weak(&external_task, &exp, &et) != 1) {}
+        // allow Lace workers to sleep again
+        lace_suspend();
+    }
+}
 
-        sem_wait(&et.sem);
-        sem_destroy(&et.sem);
+void
+lace_run_task_high(Task *task)
+{
+    // check if we are really not in a Lace thread
+    WorkerP* self = lace_get_worker();
+    if (self != 0) {
+        task->f(self, lace_get_head(self), task);
+    } else {
+        lace_pool_t *p = lace_current_pool();
+        ext_queue_t *q = lace_ext_queue_of_thread(p);
 
-        pthread_mutex_lock(&external_task_lock);
-        external_task_counter--;
-        if (external_task_exclusive && external_task_counter == 0) {
-            // if counter is 0 and exclusive is set, then we should wake up the threads
-            pthread_cond_broadcast(&external_task_cond);
+        if (lace_ext_enter_awake(p, q)) {
+            lace_ext_submit_high_and_wait(p, task);
+            lace_ext_leave(p, q);
+            return;
         }
-        pthread_mutex_unlock(&external_task_lock);
+
+        // if needed, wake up the workers
+        lace_resume();
+
+        lace_ext_enter(p, q);
+        lace_ext_submit_high_and_wait(p, task);
+        lace_ext_leave(p, q);
 
         // allow Lace workers to sleep again
         lace_suspend();
@@ -604,62 +2014,243 @@ lace_run_task_exclusive(Task *task)
     if (self != 0) {
         task->f(self, lace_get_head(self), task);
     } else {
+        lace_pool_t *p = lace_current_pool();
+
         // if needed, wake up the workers
         lace_resume();
 
-        ExtTask et;
-        et.task = task;
-        atomic_store_explicit(&et.task->thief, 0, memory_order_relaxed);
-        sem_init(&et.sem, 0, 0);
-
-        pthread_mutex_lock(&external_task_lock);
-        while (external_task_exclusive) {
+        pthread_mutex_lock(&p->external_task_lock);
+        while (p->external_task_exclusive) {
             // if "exclusive" is set, then we wait until we can continue
-            pthread_cond_wait(&external_task_cond, &external_task_lock);
+            pthread_cond_wait(&p->external_task_cond, &p->external_task_lock);
         }
-        external_task_exclusive = 1;
-        while (external_task_counter > 0) {
+        atomic_store(&p->external_task_exclusive, 1);
+        while (lace_ext_in_flight(p) > 0) {
             // wait until all other tasks are done
-            pthread_cond_wait(&external_task_cond, &external_task_lock);
+            pthread_cond_wait(&p->external_task_cond, &p->external_task_lock);
         }
-        pthread_mutex_unlock(&external_task_lock);
-
-        ExtTask *exp = 0;
-        while (atomic_compare_exchange_weak(&external_task, &exp, &et) != 1) {}
+        pthread_mutex_unlock(&p->external_task_lock);
 
-        sem_wait(&et.sem);
-        sem_destroy(&et.sem);
+        lace_ext_submit_and_wait(p, task);
 
-        pthread_mutex_lock(&external_task_lock);
-        external_task_exclusive = 0;
+        pthread_mutex_lock(&p->external_task_lock);
+        atomic_store(&p->external_task_exclusive, 0);
         // wake up any waiters
-        pthread_cond_broadcast(&external_task_cond);
-        pthread_mutex_unlock(&external_task_lock);
+        pthread_cond_broadcast(&p->external_task_cond);
+        pthread_mutex_unlock(&p->external_task_lock);
 
         // allow Lace workers to sleep again
         lace_suspend();
     }
 }
 
-static inline void
-lace_steal_external(WorkerP *self, Task *dq_head) 
+static void lace_exec_external(WorkerP *self, Task *dq_head, lace_future_t *et);
+
+/**
+ * Offer the dataflow task of <fut>, whose prerequisites are completed, to the workers of its pool.
+ * The prerequisite may have been completed by the I/O thread or by a worker of another pool.
+ * A worker that finds the queue full runs the task itself, as it cannot wait for other workers to take tasks.
+ */
+static void
+lace_df_submit(WorkerP *self, Task *dq_head, lace_future_t *fut)
+{
+    // unlike lace_ext_submit, keep the state, as a thread may already wait for the future
+    atomic_store_explicit(&fut->task->thief, 0, memory_order_relaxed);
+    lace_pool_t *p = fut->pool;
+    if (self == NULL || self->pool != p) {
+        ext_queue_t *q = lace_ext_queue_of_thread(p);
+        while (!ext_queue_push(q, fut)) sched_yield(); // queue is full
+        lace_pool_wake_one(p);
+        return;
+    }
+    if (ext_queue_push(&p->ext_queues[p->workers_memory[self->worker]->ext_queue], fut)) lace_pool_wake_one(p);
+    else lace_exec_external(self, dq_head, fut);
+}
+
+/**
+ * Tell the futures in <succ> that one of their prerequisites is completed, and offer the tasks that are ready.
+ */
+static void
+lace_df_release(WorkerP *self, Task *dq_head, struct _lace_succ *succ)
+{
+    while (succ != NULL) {
+        struct _lace_succ *next = succ->next;
+        if (atomic_fetch_sub(&succ->fut->deps, 1) == 1) lace_df_submit(self, dq_head, succ->fut);
+        free(succ);
+        succ = next;
+    }
+}
+
+void
+lace_run_task_after(lace_future_t *fut, lace_future_t **deps, unsigned int n_deps)
+{
+    fut->task = &fut->t;
+    fut->async = LACE_ASYNC_DATAFLOW;
+    fut->cb = NULL;
+    fut->arg = NULL;
+    // the task runs in the pool of the caller, also when the last prerequisite is completed elsewhere
+    fut->pool = lace_current_pool();
+    atomic_store_explicit(&fut->state, 0, memory_order_relaxed);
+    atomic_store_explicit(&fut->succ, NULL, memory_order_relaxed);
+    // the extra count keeps the task from being offered while the prerequisites are added
+    atomic_store_explicit(&fut->deps, n_deps + 1, memory_order_relaxed);
+
+    for (unsigned int i=0; i<n_deps; i++) {
+        struct _lace_succ *l = (struct _lace_succ*)malloc(sizeof(struct _lace_succ));
+        if (l == NULL) {
+            fprintf(stderr, "Lace error: Unable to allocate memory for a dataflow dependency!\n");
+            exit(1);
+        }
+        l->fut = fut;
+        struct _lace_succ *head = atomic_load_explicit(&deps[i]->succ, memory_order_acquire);
+        do {
+            if (head == LACE_SUCC_DONE) break;
+            l->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&deps[i]->succ, &head, l, memory_order_acq_rel, memory_order_acquire));
+        if (head == LACE_SUCC_DONE) {
+            // already completed
+            free(l);
+            atomic_fetch_sub(&fut->deps, 1);
+        }
+    }
+
+    if (atomic_fetch_sub(&fut->deps, 1) == 1) {
+        WorkerP *self = lace_get_worker();
+        lace_df_submit(self, self != NULL ? lace_get_head(self) : NULL, fut);
+    }
+}
+
+void
+lace_run_task_async(lace_future_t *fut, lace_future_cb cb, void *arg)
+{
+    fut->task = &fut->t;
+    fut->async = LACE_ASYNC_RUN;
+    fut->cb = cb;
+    fut->arg = arg;
+    atomic_store_explicit(&fut->succ, NULL, memory_order_relaxed);
+
+    WorkerP* self = lace_get_worker();
+    if (self != 0) {
+        Task *head = lace_get_head(self);
+        fut->task->f(self, head, fut->task);
+        atomic_store_explicit(&fut->task->thief, THIEF_COMPLETED, memory_order_relaxed);
+        struct _lace_succ *succ = atomic_exchange(&fut->succ, LACE_SUCC_DONE);
+        // the callback runs before completion, as the submitter may free the future after completion
+        if (cb != NULL) cb(fut, arg);
+        atomic_store_explicit(&fut->state, 1, memory_order_release);
+        lace_df_release(self, head, succ);
+    } else {
+        // the task counts as a RUN task until it is completed (see lace_exec_external)
+        lace_pool_t *p = lace_current_pool();
+        ext_queue_t *q = lace_ext_queue_of_thread(p);
+        lace_ext_enter(p, q);
+        lace_ext_submit_to(p, q, fut);
+    }
+}
+
+/**
+ * Execute the given external task and signal its submitter.
+ */
+static void
+lace_exec_external(WorkerP *self, Task *dq_head, lace_future_t *et)
+{
+    lace_pool_t *p = self->pool;
+    Task *task = et->task;
+    int async = et->async;
+    lace_future_cb cb = async ? et->cb : NULL;
+    void *arg = async ? et->arg : NULL;
+    atomic_store_explicit(&task->thief, self->_public, memory_order_relaxed);
+    lace_time_event(self, 1);
+    LACE_EXEC_IN_SCOPE(self, dq_head, task, NULL); // external tasks are not in a scope
+    lace_time_event(self, 2);
+    atomic_store_explicit(&task->thief, THIEF_COMPLETED, memory_order_relaxed);
+    // the futures that wait for this one are taken before it is completed, as it is then no longer ours
+    struct _lace_succ *succ = async ? atomic_exchange(&et->succ, LACE_SUCC_DONE) : NULL;
+    // the callback runs before completion; after completion, the submitter may free <et>
+    if (cb != NULL) cb(et, arg);
+    if (atomic_exchange(&et->state, 1) == 2) lace_futex_wake(&et->state, INT_MAX);
+    if (async == LACE_ASYNC_RUN) lace_ext_leave(p, &p->ext_queues[p->workers_memory[self->worker]->ext_queue]);
+    lace_df_release(self, dq_head, succ);
+    lace_time_event(self, 8);
+}
+
+/**
+ * Take a task from the external task queues, starting with the queue of our own NUMA node.
+ */
+static int
+lace_steal_external(WorkerP *self, Task *dq_head)
+{
+    lace_pool_t *p = self->pool;
+    unsigned int home = p->workers_memory[self->worker]->ext_queue;
+    for (unsigned int i=0; i<p->n_ext_queues; i++) {
+        ext_queue_t *q = &p->ext_queues[(home + i) % p->n_ext_queues];
+        if (!ext_queue_nonempty(q)) continue;
+        lace_future_t *et = ext_queue_pop(q);
+        if (et != NULL) {
+            lace_exec_external(self, dq_head, et);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Take a high-priority task and execute it, if there is one (see RUNHI).
+ */
+int
+lace_steal_high(WorkerP *self, Task *dq_head)
+{
+    lace_pool_t *p = self->pool;
+    lace_future_t *et = ext_queue_pop(p->high_queue);
+    if (et == NULL) return 0;
+    atomic_fetch_sub(&p->high, 1);
+    lace_exec_external(self, dq_head, et);
+    return 1;
+}
+
+/**
+ * Check if there is anything for an idle worker to do (used before parking).
+ */
+static int
+lace_has_work(lace_pool_t *p, atomic_int *quit)
 {
-    ExtTask *stolen_task = atomic_exchange(&external_task, NULL);
-    if (stolen_task != 0) {
-        // execute task
-        stolen_task->task->thief = self->_public;
-        atomic_store_explicit(&stolen_task->task->thief, self->_public, memory_order_relaxed);
-        lace_time_event(self, 1);
-        // atomic_thread_fence(memory_order_relaxed);
-        stolen_task->task->f(self, dq_head, stolen_task->task);
-        // atomic_thread_fence(memory_order_relaxed);
-        lace_time_event(self, 2);
-        // atomic_thread_fence(memory_order_relaxed);
-        atomic_store_explicit(&stolen_task->task->thief, THIEF_COMPLETED, memory_order_relaxed);
-        // atomic_thread_fence(memory_order_relaxed);
-        sem_post(&stolen_task->sem);
-        lace_time_event(self, 8);
+    if (atomic_load(quit) != 0) return 1;
+    if (atomic_load(&p->must_suspend) != 0) return 1;
+    if (atomic_load(&p->newframe) != NULL) return 1;
+    if (lace_ext_pending(p)) return 1;
+    if (atomic_load(&p->high) != 0) return 1;
+    for (unsigned int i=0; i<p->n_workers; i++) {
+        Worker *victim = p->workers[i];
+        if (victim == NULL || victim->allstolen) continue;
+        TailSplitNA ts;
+        ts.v = atomic_load_explicit(&victim->ts.v, memory_order_relaxed);
+        if (ts.ts.tail < ts.ts.split) return 1;
     }
+    return 0;
+}
+
+/**
+ * Execute a task that was claimed by a batch steal, on behalf of the thief.
+ */
+VOID_TASK_1(lace_proxy, Task*, t)
+{
+    LACE_EXEC_IN_SCOPE(__lace_worker, __lace_dq_head, t, atomic_load_explicit(&t->scope, memory_order_relaxed));
+    atomic_store_explicit(&t->thief, THIEF_COMPLETED, memory_order_release);
+}
+
+/**
+ * Execute the <k> tasks starting at <first> that were claimed by one steal (steal-half mode).
+ * All of them are marked as stolen by us, the oldest task is executed directly,
+ * and the others are spawned as proxy tasks, so other workers can steal them from us.
+ * The victim leapfrogs on us as usual, since we are the thief of all <k> tasks.
+ */
+VOID_TASK_2(lace_steal_batch, Task*, first, unsigned int, k)
+{
+    for (unsigned int i=0; i<k; i++) atomic_store_explicit(&first[i].thief, __lace_worker->_public, memory_order_relaxed);
+    for (unsigned int i=1; i<k; i++) SPAWN(lace_proxy, &first[i]);
+    LACE_EXEC_IN_SCOPE(__lace_worker, __lace_dq_head, first, atomic_load_explicit(&first->scope, memory_order_relaxed));
+    atomic_store_explicit(&first->thief, THIEF_COMPLETED, memory_order_release);
+    for (unsigned int i=1; i<k; i++) SYNC(lace_proxy);
 }
 
 /**
@@ -669,21 +2260,75 @@ VOID_TASK_0(lace_steal_random)
 {
     YIELD_NEWFRAME();
 
-    if (unlikely(atomic_load_explicit(&external_task, memory_order_acquire) != 0)) {
+    lace_pool_t *p = __lace_worker->pool;
+    if (unlikely(lace_ext_pending(p))) {
         lace_steal_external(__lace_worker, __lace_dq_head);
-    } else if (n_workers > 1) {
-        Worker *victim = workers[(__lace_worker->worker + 1 + rng(&__lace_worker->seed, n_workers-1)) % n_workers];
+    } else if (p->n_workers > 1) {
+        // only steal from active workers; a retired worker may still be finishing its tasks
+        unsigned int n = atomic_load_explicit(&p->n_active, memory_order_relaxed);
+        unsigned int id = __lace_worker->worker;
+        if (id < n && n == 1) return;
+        Worker *victim = id < n ? p->workers[(id + 1 + rng(&__lace_worker->seed, n-1)) % n] : p->workers[rng(&__lace_worker->seed, n)];
 
         PR_COUNTSTEALS(__lace_worker, CTR_steal_tries);
         Worker *res = lace_steal(__lace_worker, __lace_dq_head, victim);
         if (res == LACE_STOLEN) {
             PR_COUNTSTEALS(__lace_worker, CTR_steals);
-        } else if (res == LACE_BUSY) {
-            PR_COUNTSTEALS(__lace_worker, CTR_steal_busy);
+            LACE_STAT_ADD(__lace_worker, steals, 1);
+        } else {
+            if (res == LACE_BUSY) PR_COUNTSTEALS(__lace_worker, CTR_steal_busy);
+            LACE_STAT_ADD(__lace_worker, failed_steals, 1);
         }
     }
 }
 
+/**
+ * Give the unused part of the task deque (from <head>), of the overflow arena and of the allocation stack of worker <w> back to the OS.
+ * The pages are mapped again, filled with zeroes, when they are used again.
+ */
+static void
+lace_release_memory(WorkerP *w, Task *head)
+{
+#if LACE_USE_MMAP && defined(MADV_DONTNEED)
+    lace_pool_t *p = w->pool;
+    if (p->workers_memory[w->worker]->huge) return;
+    uintptr_t mask = ~(uintptr_t)(page_size - 1);
+    uintptr_t from = ((uintptr_t)head + page_size - 1) & mask;
+    uintptr_t to = (uintptr_t)w->end & mask;
+    if (from < to) madvise((void*)from, to - from, MADV_DONTNEED);
+    if (w->arena != NULL) {
+        from = ((uintptr_t)w->arena_top + page_size - 1) & mask;
+        to = (uintptr_t)w->arena_end & mask;
+        if (from < to) madvise((void*)from, to - from, MADV_DONTNEED);
+    }
+    if (w->stack != NULL) {
+        from = ((uintptr_t)w->stack_top + page_size - 1) & mask;
+        to = (uintptr_t)w->stack_end & mask;
+        if (from < to) madvise((void*)from, to - from, MADV_DONTNEED);
+    }
+#else
+    (void)w;
+    (void)head;
+#endif
+}
+
+/**
+ * Wait until Lace is resumed (used by lace_steal_loop when Lace is suspended).
+ */
+static void
+lace_worker_suspend(WorkerP *w, Task *head)
+{
+    lace_pool_t *p = w->pool;
+    LACE_TRACE_EVENT(w, LACE_TRACE_SUSPEND_BEGIN, 0);
+    if (release_memory) lace_release_memory(w, head);
+    p->workers_running -= 1;
+    sem_wait(&p->suspend_semaphore);
+    lace_barrier(); // ensure we're all back before continuing
+    p->workers_running += 1;
+    LACE_TRACE_EVENT(w, LACE_TRACE_SUSPEND_END, 0);
+    (void)w; // only used when tracing
+}
+
 /**
  * Main Lace worker implementation.
  * Steal from random victims until "quit" is set.
@@ -691,10 +2336,11 @@ VOID_TASK_0(lace_steal_random)
 VOID_TASK_1(lace_steal_loop, atomic_int*, quit)
 {
     // Determine who I am
+    lace_pool_t *p = __lace_worker->pool;
     const int worker_id = __lace_worker->worker;
 
     // Prepare self, victim
-    Worker ** const self = &workers[worker_id];
+    Worker ** const self = &p->workers[worker_id];
     Worker ** victim = self;
 
 #if LACE_PIE_TIMES
@@ -702,79 +2348,188 @@ VOID_TASK_1(lace_steal_loop, atomic_int*, quit)
 #endif
 
     uint32_t seed = worker_id;
-    unsigned int n = n_workers;
     int i=0;
+    unsigned int fails=0;
+    // start of the current idle (or busy) period, for the statistics
+    uint64_t mark = gethrtime();
+#if LACE_USE_HWLOC
+    const uint16_t *order = p->steal_order + worker_id*p->n_workers;
+    const unsigned int *ends = p->steal_level_end + worker_id*LACE_STEAL_LEVELS;
+    unsigned int level = 0;
+    unsigned int level_tries = 0;
+#endif
 
     while(*quit == 0) {
-        if (n > 1) {
-            // Select victim
+        uint64_t now = gethrtime();
+        LACE_STAT_ADD(__lace_worker, idle_ticks, now - mark);
+        mark = now;
+        int worked = 0;
+
+        const unsigned int active = atomic_load_explicit(&p->n_active, memory_order_relaxed);
+        if (unlikely((unsigned int)worker_id >= active)) {
+            lace_retire(__lace_worker, quit);
+            if (atomic_load_explicit(&__lace_worker->interrupt, memory_order_relaxed) != 0) lace_interrupted(__lace_worker, __lace_dq_head);
+            if (atomic_load_explicit(&p->must_suspend, memory_order_acquire)) lace_worker_suspend(__lace_worker, __lace_dq_head);
+            fails = 0;
+            // time while retired is neither idle nor busy
+            mark = gethrtime();
+            continue;
+        }
+
+        // high-priority tasks go first
+        if (unlikely(atomic_load_explicit(&p->high, memory_order_relaxed) != 0)) {
+            if (lace_steal_high(__lace_worker, __lace_dq_head)) {
+                worked = 1;
+                fails = 0;
+            }
+        }
+
+        if (active > 1) {
+            // Select victim (only active workers)
+#if LACE_USE_HWLOC
+            if (steal_locality != 0) {
+                // skip empty levels, then pick a random victim at the current level
+                while (ends[level] == (level ? ends[level-1] : 0)) level = (level+1) % LACE_STEAL_LEVELS;
+                unsigned int start = level ? ends[level-1] : 0;
+                victim = p->workers + order[start + rng(&seed, ends[level]-start)];
+            } else
+#endif
             if( i>0 ) {
                 i--;
                 victim++;
                 if (victim == self) victim++;
-                if (victim >= workers + n) victim = workers;
+                if (victim >= p->workers + active) victim = p->workers;
                 if (victim == self) victim++;
             } else {
                 i = rng(&seed, 40); // compute random i 0..40
-                victim = workers + (rng(&seed, n-1) + worker_id + 1) % n;
+                victim = p->workers + (rng(&seed, active-1) + worker_id + 1) % active;
             }
 
             PR_COUNTSTEALS(__lace_worker, CTR_steal_tries);
-            Worker *res = lace_steal(__lace_worker, __lace_dq_head, *victim);
+#if LACE_USE_HWLOC
+            if (steal_locality != 0) PR_COUNTSTEALS(__lace_worker, CTR_level_tries+level);
+#endif
+            Worker *res = victim < p->workers + active ? lace_steal(__lace_worker, __lace_dq_head, *victim) : LACE_NOWORK;
             if (res == LACE_STOLEN) {
                 PR_COUNTSTEALS(__lace_worker, CTR_steals);
-            } else if (res == LACE_BUSY) {
-                PR_COUNTSTEALS(__lace_worker, CTR_steal_busy);
+                LACE_STAT_ADD(__lace_worker, steals, 1);
+                worked = 1;
+                fails = 0;
+#if LACE_USE_HWLOC
+                if (steal_locality != 0) PR_COUNTSTEALS(__lace_worker, CTR_level_steals+level);
+                level = 0;
+                level_tries = 0;
+#endif
+            } else {
+                if (res == LACE_BUSY) PR_COUNTSTEALS(__lace_worker, CTR_steal_busy);
+                LACE_STAT_ADD(__lace_worker, failed_steals, 1);
+            }
+#if LACE_USE_HWLOC
+            if (res != LACE_STOLEN && ++level_tries >= steal_locality) {
+                // move on to the next level (after remote nodes, start again with SMT siblings)
+                level_tries = 0;
+                level = (level+1) % LACE_STEAL_LEVELS;
             }
+#endif
         }
 
         YIELD_NEWFRAME();
 
-        if (unlikely(atomic_load_explicit(&external_task, memory_order_acquire) != 0)) {
-            lace_steal_external(__lace_worker, __lace_dq_head);
+        if (unlikely(lace_ext_pending(p))) {
+            if (lace_steal_external(__lace_worker, __lace_dq_head)) {
+                worked = 1;
+                fails = 0;
+            }
+        }
+
+        if (worked) {
+            now = gethrtime();
+            LACE_STAT_ADD(__lace_worker, busy_ticks, now - mark);
+            mark = now;
         }
 
-        if (unlikely(atomic_load_explicit(&must_suspend, memory_order_acquire))) {
-            workers_running -= 1;
-            sem_wait(&suspend_semaphore);
-            lace_barrier(); // ensure we're all back before continuing
-            workers_running += 1;
+        if (unlikely(atomic_load_explicit(&p->must_suspend, memory_order_acquire))) {
+            lace_worker_suspend(__lace_worker, __lace_dq_head);
+            fails = 0;
+            // time while suspended is neither idle nor busy
+            mark = gethrtime();
+        }
+
+        // idle policy: spin, then yield, then park
+        if (backoff_spins != 0 && ++fails > backoff_spins) {
+            if (fails <= backoff_spins + backoff_yields) {
+                sched_yield();
+            } else {
+                lace_park(__lace_worker, quit);
+                fails = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Park a worker after lace_stop with warm restart, until lace_start reuses it (returns 1)
+ * or the pool is released (returns 0). Without warm restart, the worker exits at once.
+ */
+static int
+lace_pool_wait(lace_pool_t *p, unsigned int worker, uint32_t *epoch)
+{
+    if (!atomic_load(&p->keep)) return 0;
+    while (1) {
+        uint32_t e = atomic_load(&p->epoch);
+        if (e != *epoch) {
+            *epoch = e;
+            if (atomic_load(&p->release)) return 0;
+            if (worker < p->n_workers) return 1;
         }
+        lace_futex_wait(&p->epoch, e);
     }
 }
 
 /**
  * Initialize the current thread as a Lace thread, and perform work-stealing
- * as worker <worker> until lace_exit() is called.
+ * as worker <worker> until lace_stop() is called, again for every warm restart.
  */
+typedef struct {
+    lace_pool_t *pool;
+    unsigned int worker;
+} worker_thread_arg;
+
 static void*
-lace_worker_thread(void* arg)
+lace_worker_thread(void* _arg)
 {
-    int worker = (int)(size_t)arg;
+    worker_thread_arg *arg = (worker_thread_arg*)_arg;
+    lace_pool_t *p = arg->pool;
+    unsigned int worker = arg->worker;
+    free(arg);
+    uint32_t epoch = atomic_load(&p->epoch);
 
-    // Initialize data structures
-    lace_init_worker(worker);
+    // Pin CPU, then allocate data structures (on the NUMA node of the CPU)
+    lace_pin_worker(p, worker);
+    worker_data *mem = lace_alloc_worker(p, worker);
 
-    // Pin CPU
-    lace_pin_worker();
+    do {
+        lace_init_worker(p, worker, mem);
 
-    // Wait for the first time we are resumed
-    sem_wait(&suspend_semaphore);
+        // Wait for the first time we are resumed
+        sem_wait(&p->suspend_semaphore);
 
-    // Signal that we are running
-    workers_running += 1;
+        // Signal that we are running
+        p->workers_running += 1;
 
-    // Run the steal loop
-    WorkerP *__lace_worker = lace_get_worker();
-    Task *__lace_dq_head = lace_get_head(__lace_worker);
-    lace_steal_loop_WORK(__lace_worker, __lace_dq_head, &lace_quits);
+        // Run the steal loop
+        WorkerP *__lace_worker = lace_get_worker();
+        Task *__lace_dq_head = lace_get_head(__lace_worker);
+        lace_steal_loop_WORK(__lace_worker, __lace_dq_head, &p->quits);
 
-    // Time worker exit event
-    lace_time_event(__lace_worker, 9);
+        // Time worker exit event
+        lace_time_event(__lace_worker, 9);
 
-    // Signal that we stopped
-    workers_running -= 1;
+        // Signal that we stopped
+        p->workers_running -= 1;
+    } while (lace_pool_wait(p, worker, &epoch));
 
+    atomic_fetch_sub(&p->threads, 1);
     return NULL;
 }
 
@@ -787,13 +2542,236 @@ lace_set_verbosity(int level)
     verbosity = level;
 }
 
+/**
+ * The steal loop measures the busy and idle time of the workers in ticks of gethrtime, which is much cheaper
+ * than clock_gettime. The ticks are converted with the tick rate measured over the first 10 ms after the first
+ * lace_start, so lace_start has no calibration delay. The rate is then fixed, so the converted times of
+ * successive snapshots only increase.
+ */
+static uint64_t stats_start_ns, stats_start_ticks;
+static double stats_ns_per_tick = 1.0;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_once_t stats_rate_once = PTHREAD_ONCE_INIT;
+
+static void
+lace_stats_clock_init(void)
+{
+    stats_start_ns = lace_clock_ns();
+    stats_start_ticks = gethrtime();
+}
+
+static void
+lace_stats_rate_init(void)
+{
+    uint64_t ns;
+    do { ns = lace_clock_ns(); } while (ns - stats_start_ns < 10000000);
+    uint64_t ticks = gethrtime() - stats_start_ticks;
+    if (ticks != 0) stats_ns_per_tick = (double)(ns - stats_start_ns) / (double)ticks;
+}
+
+static double
+lace_stats_ns_per_tick(void)
+{
+    pthread_once(&stats_once, lace_stats_clock_init);
+    pthread_once(&stats_rate_once, lace_stats_rate_init);
+    return stats_ns_per_tick;
+}
+
+/**
+ * Copy the statistics of the workers
+ */
+unsigned int
+lace_stats_snapshot(lace_stats_t *stats, unsigned int n)
+{
+    lace_pool_t *p = lace_current_pool();
+    double ns_per_tick = lace_stats_ns_per_tick();
+    if (n > p->n_workers) n = p->n_workers;
+    for (unsigned int i=0; i<n; i++) {
+        // the statistics are zero in newly allocated worker memory; the worker may not have started yet
+        WorkerP *w = p->workers_p[i];
+        if (w == NULL) {
+            memset(&stats[i], 0, sizeof(lace_stats_t));
+            continue;
+        }
+        lace_stats_ctr *c = &w->stats;
+        stats[i].steals = atomic_load_explicit(&c->steals, memory_order_relaxed);
+        stats[i].failed_steals = atomic_load_explicit(&c->failed_steals, memory_order_relaxed);
+        stats[i].leaps = atomic_load_explicit(&c->leaps, memory_order_relaxed);
+        stats[i].splits = atomic_load_explicit(&c->splits, memory_order_relaxed);
+        stats[i].busy_ns = (uint64_t)(atomic_load_explicit(&c->busy_ticks, memory_order_relaxed) * ns_per_tick);
+        stats[i].idle_ns = (uint64_t)(atomic_load_explicit(&c->idle_ticks, memory_order_relaxed) * ns_per_tick);
+    }
+    return p->n_workers;
+}
+
+lace_wls_t
+lace_wls_register(size_t size)
+{
+    lace_wls_t slot = wls_size;
+    wls_size += (size + LINE_SIZE - 1) & ~(LINE_SIZE - 1);
+    return slot;
+}
+
+void*
+lace_wls_get(unsigned int worker, lace_wls_t slot)
+{
+    WorkerP *w = lace_current_pool()->workers_p[worker];
+    return w != NULL ? w->wls + slot : NULL;
+}
+
+void
+lace_reducer_init(lace_reducer_t *r, size_t size, void (*identity)(void*), void (*combine)(void*, void*))
+{
+    r->slot = lace_wls_register(size);
+    r->size = size;
+    r->identity = identity;
+    r->combine = combine;
+    r->next = reducers;
+    reducers = r;
+}
+
+void
+lace_reducer_reduce(lace_reducer_t *r, void *result)
+{
+    lace_pool_t *p = lace_current_pool();
+    r->identity(result);
+    for (unsigned int i=0; i<p->n_workers; i++) {
+        // a worker that did not start yet has no view
+        if (p->workers_p[i] == NULL) continue;
+        void *view = p->workers_p[i]->wls + r->slot;
+        r->combine(result, view);
+        r->identity(view);
+    }
+}
+
+static void lace_i64_zero(void *v) { *(int64_t*)v = 0; }
+static void lace_i64_max_value(void *v) { *(int64_t*)v = INT64_MAX; }
+static void lace_i64_min_value(void *v) { *(int64_t*)v = INT64_MIN; }
+static void lace_i64_add(void *l, void *r) { *(int64_t*)l += *(int64_t*)r; }
+static void lace_i64_min(void *l, void *r) { if (*(int64_t*)r < *(int64_t*)l) *(int64_t*)l = *(int64_t*)r; }
+static void lace_i64_max(void *l, void *r) { if (*(int64_t*)r > *(int64_t*)l) *(int64_t*)l = *(int64_t*)r; }
+static void lace_double_zero(void *v) { *(double*)v = 0; }
+static void lace_double_add(void *l, void *r) { *(double*)l += *(double*)r; }
+
+static void
+lace_list_empty(void *v)
+{
+    lace_list_t *l = (lace_list_t*)v;
+    l->head = l->tail = NULL;
+}
+
+static void
+lace_list_concat(void *left, void *right)
+{
+    lace_list_t *l = (lace_list_t*)left, *r = (lace_list_t*)right;
+    if (r->head == NULL) return;
+    if (l->tail != NULL) l->tail->next = r->head;
+    else l->head = r->head;
+    l->tail = r->tail;
+}
+
+void lace_reducer_init_sum(lace_reducer_t *r) { lace_reducer_init(r, sizeof(int64_t), lace_i64_zero, lace_i64_add); }
+void lace_reducer_init_min(lace_reducer_t *r) { lace_reducer_init(r, sizeof(int64_t), lace_i64_max_value, lace_i64_min); }
+void lace_reducer_init_max(lace_reducer_t *r) { lace_reducer_init(r, sizeof(int64_t), lace_i64_min_value, lace_i64_max); }
+void lace_reducer_init_sum_double(lace_reducer_t *r) { lace_reducer_init(r, sizeof(double), lace_double_zero, lace_double_add); }
+void lace_reducer_init_list(lace_reducer_t *r) { lace_reducer_init(r, sizeof(lace_list_t), lace_list_empty, lace_list_concat); }
+
 /**
  * Set the program stack size of Lace threads
  */
 void
-lace_set_stacksize(size_t new_stacksize)
+lace_set_stacksize(size_t new_stacksize)
+{
+    stacksize = new_stacksize;
+}
+
+/**
+ * Set the size of the overflow arena of Lace workers
+ */
+void
+lace_set_arena_size(size_t new_arena_size)
+{
+    arena_size = new_arena_size;
+}
+
+/**
+ * Set the number of entries of the operation cache, rounded down to a power of 2
+ */
+void
+lace_set_cache_size(size_t entries)
+{
+    cache_size = 0;
+    if (entries != 0) for (cache_size = 1; cache_size <= entries / 2; cache_size *= 2) {}
+}
+
+/**
+ * Allocate the operation cache of pool <p> with the current cache size, or keep it if it has that size.
+ * The cache is zeroed by the workers in lace_start (see lace_cache_init_part).
+ */
+static void
+lace_cache_alloc(lace_pool_t *p)
+{
+    if (p->cache_entries == cache_size) return;
+    if (p->cache != NULL) lace_arena_unmap((char*)p->cache, p->cache_entries * sizeof(lace_cache_entry_t));
+    p->cache = NULL;
+    p->cache_entries = 0;
+    if (cache_size == 0) return;
+    p->cache = (lace_cache_entry_t*)lace_arena_map(cache_size * sizeof(lace_cache_entry_t));
+    if (p->cache == NULL) {
+        fprintf(stderr, "Lace error: unable to allocate memory for the operation cache!\n");
+        exit(1);
+    }
+    p->cache_entries = cache_size;
+}
+
+/**
+ * Get the part [*from, *to) of the operation cache of pool <p> that worker <i> clears.
+ */
+static void
+lace_cache_part(lace_pool_t *p, size_t i, lace_cache_entry_t **from, lace_cache_entry_t **to)
+{
+    size_t n = p->cache_entries, k = p->n_workers;
+    size_t first = n / k * i + (i < n % k ? i : n % k);
+    *from = p->cache + first;
+    *to = *from + n / k + (i < n % k ? 1 : 0);
+}
+
+/**
+ * Zero the part of the operation cache of the current worker; all workers run this together in lace_start,
+ * before any task uses the cache, so with mmap its pages are spread over their NUMA nodes.
+ */
+VOID_TASK_0(lace_cache_init_part)
+{
+    lace_cache_entry_t *from, *to;
+    lace_cache_part(__lace_worker->pool, __lace_worker->worker, &from, &to);
+    memset(from, 0, (to - from) * sizeof(lace_cache_entry_t));
+}
+
+/**
+ * Clear the part of the operation cache of the current worker; all workers run this together.
+ * Other workers may still use the cache, so each entry is cleared with the sequence lock, like lace_cache_put:
+ * <status> keeps counting, so a reader that started before the entry was cleared sees that it changed.
+ * An entry that another worker is writing is skipped, as if that write happened after the clear.
+ */
+VOID_TASK_0(lace_cache_clear_part)
+{
+    lace_cache_entry_t *from, *to;
+    lace_cache_part(__lace_worker->pool, __lace_worker->worker, &from, &to);
+    for (lace_cache_entry_t *e = from; e != to; e++) {
+        uint64_t s = atomic_load_explicit(&e->status, memory_order_relaxed);
+        if (s & 1) continue;
+        if (!atomic_compare_exchange_strong_explicit(&e->status, &s, s + 1, memory_order_relaxed, memory_order_relaxed)) continue;
+        atomic_thread_fence(memory_order_release);
+        atomic_store_explicit(&e->op, 0, memory_order_relaxed); // no operation is 0, so lookups miss
+        atomic_store_explicit(&e->status, s + 2, memory_order_release);
+    }
+}
+
+void
+lace_cache_clear(void)
 {
-    stacksize = new_stacksize;
+    if (lace_current_pool()->cache == NULL) return;
+    TOGETHER(lace_cache_clear_part);
 }
 
 unsigned int
@@ -814,6 +2792,108 @@ lace_get_pu_count(void)
     return n_pus;
 }
 
+/**
+ * Release the pool: let the parked workers exit, then free the memory of all workers.
+ * The running workers must have left the steal loop (see lace_stop).
+ */
+static void
+lace_pool_shutdown(lace_pool_t *p)
+{
+    atomic_store(&p->release, 1);
+    atomic_fetch_add(&p->epoch, 1);
+    lace_futex_wake(&p->epoch, INT_MAX);
+    while (atomic_load(&p->threads) != 0) {}
+    atomic_store(&p->release, 0);
+
+    for (unsigned int i=0; i<p->size; i++) {
+        lace_arena_free(p->workers_p[i]);
+        lace_slab_free_all(p->workers_p[i]);
+#if LACE_TRACE
+        free(p->workers_p[i]->trace);
+#endif
+#if LACE_PROFILE
+        free(p->workers_p[i]->profile);
+#endif
+#if LACE_USE_MMAP
+        munmap(p->workers_memory[i], p->workers_memory_size);
+#else
+        lace_aligned_free(p->workers_memory[i]);
+#endif
+    }
+
+    lace_aligned_free(p->workers);
+    lace_aligned_free(p->workers_p);
+    lace_aligned_free(p->workers_memory);
+
+    p->workers = 0;
+    p->workers_p = 0;
+    p->workers_memory = 0;
+    p->size = 0;
+    p->parked = 0;
+
+    if (p->cache != NULL) lace_arena_unmap((char*)p->cache, p->cache_entries * sizeof(lace_cache_entry_t));
+    p->cache = NULL;
+    p->cache_entries = 0;
+
+#if LACE_USE_HWLOC
+    hwloc_topology_destroy(p->topo);
+#endif
+}
+
+/**
+ * Enable or disable warm restarts; disabling releases a parked pool.
+ */
+void
+lace_set_warm_restart(int enabled)
+{
+    lace_pool_t *p = lace_current_pool();
+    p->warm_restart = enabled ? 1 : 0;
+    if (!p->warm_restart && p->parked) lace_pool_shutdown(p);
+}
+
+lace_pool_t*
+lace_pool_create(void)
+{
+    // the size of lace_pool_t is a multiple of LINE_SIZE, due to its aligned fields
+#if defined(_MSC_VER) || defined(__MINGW64_VERSION_MAJOR)
+    lace_pool_t *p = _aligned_malloc(sizeof(lace_pool_t), LINE_SIZE);
+#elif defined(__MINGW32__)
+    lace_pool_t *p = __mingw_aligned_malloc(sizeof(lace_pool_t), LINE_SIZE);
+#else
+    lace_pool_t *p = aligned_alloc(LINE_SIZE, sizeof(lace_pool_t));
+#endif
+    if (p == NULL) {
+        fprintf(stderr, "Lace error: unable to allocate memory for the Lace pool!\n");
+        exit(1);
+    }
+    memset(p, 0, sizeof(lace_pool_t));
+    p->default_dqsize = default_pool.default_dqsize;
+    pthread_mutex_init(&p->external_task_lock, NULL);
+    pthread_cond_init(&p->external_task_cond, NULL);
+    return p;
+}
+
+void
+lace_pool_destroy(lace_pool_t *p)
+{
+    if (p == NULL || p == &default_pool) return;
+    if (p->size != 0 && !p->parked) {
+        fprintf(stderr, "Lace error: trying to destroy a running Lace pool!\n");
+        exit(1);
+    }
+    if (p->parked) lace_pool_shutdown(p);
+    if (lace_selected_pool() == p) lace_set_pool(NULL);
+    pthread_mutex_destroy(&p->external_task_lock);
+    pthread_cond_destroy(&p->external_task_cond);
+    lace_aligned_free(p);
+}
+
+void
+lace_set_first_core(unsigned int core)
+{
+    lace_current_pool()->first_core = core;
+}
+
 /**
  * Initialize Lace for work-stealing with <n> workers, where
  * each worker gets a task deque with <dqsize> elements.
@@ -821,66 +2901,140 @@ lace_get_pu_count(void)
 void
 lace_start(unsigned int _n_workers, size_t dqsize)
 {
-#if LACE_USE_HWLOC
-    // Initialize topology and information about cpus
-    hwloc_topology_init(&topo);
-    hwloc_topology_load(topo);
+    lace_pool_t *p = lace_current_pool();
+    if (dqsize != 0) p->default_dqsize = dqsize;
+    else dqsize = p->default_dqsize;
+
+    // Compute memory size for each worker
+    size_t memory_size;
+#if LACE_USE_MMAP
+    pthread_once(&page_size_once, lace_init_page_size);
+    size_t reserve = max_dqsize < dqsize ? dqsize : max_dqsize;
+    if (reserve > UINT32_MAX) reserve = UINT32_MAX; // tail and split are 32-bit indices
+    // with explicit huge pages, the deques are reserved at once and do not grow
+    if (huge_pages == LACE_HUGE_PAGES_EXPLICIT) reserve = dqsize;
+    memory_size = sizeof(worker_data) + wls_size + sizeof(Task) * reserve;
+    // explicit huge pages are mapped in whole huge pages (of the usual 2 MB)
+    if (huge_pages == LACE_HUGE_PAGES_EXPLICIT) memory_size = (memory_size + ((size_t)2<<20) - 1) & ~(((size_t)2<<20) - 1);
+#else
+    memory_size = sizeof(worker_data) + wls_size + sizeof(Task) * dqsize;
+#endif
+    p->wls_size = wls_size;
+
+    // A parked pool is reused if the memory of its workers has the same size, otherwise it is released first
+    if (p->size != 0 && memory_size != p->workers_memory_size) lace_pool_shutdown(p);
+    p->workers_memory_size = memory_size;
+#if LACE_USE_MMAP
+    p->reserved_dqsize = reserve;
+#endif
 
-    n_nodes = hwloc_get_nbobjs_by_type(topo, HWLOC_OBJ_NODE);
-    n_cores = hwloc_get_nbobjs_by_type(topo, HWLOC_OBJ_CORE);
-    n_pus = hwloc_get_nbobjs_by_type(topo, HWLOC_OBJ_PU);
+#if LACE_USE_HWLOC
+    // Initialize topology and information about cpus (a parked pool keeps its topology)
+    if (p->size == 0) {
+        hwloc_topology_init(&p->topo);
+        hwloc_topology_load(p->topo);
+
+        p->n_nodes = hwloc_get_nbobjs_by_type(p->topo, HWLOC_OBJ_NODE);
+        p->n_cores = hwloc_get_nbobjs_by_type(p->topo, HWLOC_OBJ_CORE);
+        p->n_pus = hwloc_get_nbobjs_by_type(p->topo, HWLOC_OBJ_PU);
+    }
 #else
-    unsigned int n_pus = lace_get_pu_count();
+    p->n_pus = lace_get_pu_count();
 #endif
 
     // Initialize globals
-    n_workers = _n_workers == 0 ? n_pus : _n_workers;
-    if (dqsize != 0) default_dqsize = dqsize;
-    else dqsize = default_dqsize;
-    lace_quits = 0;
-    atomic_store_explicit(&workers_running, 0, memory_order_relaxed);
+    p->n_workers = _n_workers == 0 ? p->n_pus : _n_workers;
+    atomic_store(&p->n_active, p->n_workers);
+#if LACE_USE_HWLOC
+    lace_init_steal_order(p, p->n_workers);
+    p->n_ext_queues = p->n_nodes > 0 ? p->n_nodes : 1;
+#if defined(__linux__)
+    // map each PU to the external task queue of its NUMA node
+    p->n_pu_ext_queue = 0;
+    for (unsigned int i=0; i<p->n_pus; i++) {
+        hwloc_obj_t pu = hwloc_get_obj_by_type(p->topo, HWLOC_OBJ_PU, i);
+        if (pu->os_index >= p->n_pu_ext_queue) p->n_pu_ext_queue = pu->os_index + 1;
+    }
+    p->pu_ext_queue = calloc(p->n_pu_ext_queue, sizeof(unsigned int));
+    for (unsigned int i=0; i<p->n_pus; i++) {
+        hwloc_obj_t pu = hwloc_get_obj_by_type(p->topo, HWLOC_OBJ_PU, i);
+        p->pu_ext_queue[pu->os_index] = lace_node_index(p, pu->cpuset);
+    }
+#endif
+#else
+    p->n_ext_queues = 1;
+#endif
+    p->quits = 0;
+    atomic_store_explicit(&p->workers_running, 0, memory_order_relaxed);
 
     // Initialize Lace barrier
-    lace_barrier_init();
+    lace_barrier_init(p);
 
     // Create suspend semaphore
-    memset(&suspend_semaphore, 0, sizeof(sem_t));
-    sem_init(&suspend_semaphore, 0, 0);
+    memset(&p->suspend_semaphore, 0, sizeof(sem_t));
+    sem_init(&p->suspend_semaphore, 0, 0);
 
-    must_suspend = 0;
-    lace_awaken_count = 0;
+    p->must_suspend = 0;
+    p->awaken_count = 0;
+    atomic_store_explicit(&p->sleeping, 0, memory_order_relaxed);
 
-    // Allocate array with all workers
+    // Allocate array with all workers, unless the parked pool already has room for them
     // first make sure that the amount to allocate (n_workers times pointer) is a multiple of LINE_SIZE
-    size_t to_allocate = n_workers * sizeof(void*);
+    Worker **old_workers = p->workers;
+    WorkerP **old_workers_p = p->workers_p;
+    worker_data **old_workers_memory = p->workers_memory;
+    size_t to_allocate = (p->n_workers > p->size ? p->n_workers : p->size) * sizeof(void*);
     to_allocate = (to_allocate+LINE_SIZE-1) & (~(LINE_SIZE-1));
 #if defined(_MSC_VER) || defined(__MINGW64_VERSION_MAJOR)
-    workers = _aligned_malloc(to_allocate, LINE_SIZE);
-    workers_p = _aligned_malloc(to_allocate, LINE_SIZE);
-    workers_memory = _aligned_malloc(to_allocate, LINE_SIZE);
+    if (p->n_workers > p->size) {
+        p->workers = _aligned_malloc(to_allocate, LINE_SIZE);
+        p->workers_p = _aligned_malloc(to_allocate, LINE_SIZE);
+        p->workers_memory = _aligned_malloc(to_allocate, LINE_SIZE);
+    }
+    p->ext_queues = _aligned_malloc((p->n_ext_queues + 1) * sizeof(ext_queue_t), LINE_SIZE);
 #elif defined(__MINGW32__)
-    workers = __mingw_aligned_malloc(to_allocate, LINE_SIZE);
-    workers_p = __mingw_aligned_malloc(to_allocate, LINE_SIZE);
-    workers_memory = __mingw_aligned_malloc(to_allocate, LINE_SIZE);
+    if (p->n_workers > p->size) {
+        p->workers = __mingw_aligned_malloc(to_allocate, LINE_SIZE);
+        p->workers_p = __mingw_aligned_malloc(to_allocate, LINE_SIZE);
+        p->workers_memory = __mingw_aligned_malloc(to_allocate, LINE_SIZE);
+    }
+    p->ext_queues = __mingw_aligned_malloc((p->n_ext_queues + 1) * sizeof(ext_queue_t), LINE_SIZE);
 #else
-    workers = aligned_alloc(LINE_SIZE, to_allocate);
-    workers_p = aligned_alloc(LINE_SIZE, to_allocate);
-    workers_memory = aligned_alloc(LINE_SIZE, to_allocate);
+    if (p->n_workers > p->size) {
+        p->workers = aligned_alloc(LINE_SIZE, to_allocate);
+        p->workers_p = aligned_alloc(LINE_SIZE, to_allocate);
+        p->workers_memory = aligned_alloc(LINE_SIZE, to_allocate);
+    }
+    p->ext_queues = aligned_alloc(LINE_SIZE, (p->n_ext_queues + 1) * sizeof(ext_queue_t));
 #endif
-    if (workers == 0 || workers_p == 0 || workers_memory == 0) {
+    if (p->workers == 0 || p->workers_p == 0 || p->workers_memory == 0 || p->ext_queues == 0) {
         fprintf(stderr, "Lace error: unable to allocate memory for the workers!\n");
         exit(1);
     }
 
-    // Ensure worker array is set to 0 initially
-    memset(workers, 0, n_workers*sizeof(Worker*));
+    if (p->n_workers > p->size) {
+        // Ensure worker arrays are set to 0 initially, then copy the workers of the parked pool
+        memset(p->workers, 0, p->n_workers*sizeof(Worker*));
+        memset(p->workers_memory, 0, p->n_workers*sizeof(worker_data*));
+        memset(p->workers_p, 0, p->n_workers*sizeof(WorkerP*));
+        if (p->size != 0) {
+            memcpy(p->workers, old_workers, p->size*sizeof(Worker*));
+            memcpy(p->workers_memory, old_workers_memory, p->size*sizeof(worker_data*));
+            memcpy(p->workers_p, old_workers_p, p->size*sizeof(WorkerP*));
+            lace_aligned_free(old_workers);
+            lace_aligned_free(old_workers_p);
+            lace_aligned_free(old_workers_memory);
+        }
+    }
 
-    // Compute memory size for each worker
-    workers_memory_size = sizeof(worker_data) + sizeof(Task) * dqsize;
+    // Initialize the external task queues, followed by the queue of high-priority tasks
+    for (unsigned int i=0; i<=p->n_ext_queues; i++) ext_queue_init(&p->ext_queues[i]);
+    p->high_queue = &p->ext_queues[p->n_ext_queues];
+    atomic_store_explicit(&p->high, 0, memory_order_relaxed);
 
 #ifndef __linux__
-    // Create pthread key
-    pthread_key_create(&current_worker_key, NULL);
+    // Create the pthread keys (shared by all pools)
+    pthread_once(&lace_keys_once, lace_create_keys);
 #endif
 
     // Prepare structures for thread creation
@@ -888,54 +3042,63 @@ lace_start(unsigned int _n_workers, size_t dqsize)
     pthread_attr_init(&worker_attr);
 
     // Set the stack size
-    if (stacksize != 0) {
-        pthread_attr_setstacksize(&worker_attr, stacksize);
-    } else {
-	// on certain systems, the default stack size is too small (e.g. OSX)
-	// so by default, we just pick the current RLIMIT_STACK or 16M whichever is smallest
-#ifndef _WIN32
-	struct rlimit lim;
-	getrlimit(RLIMIT_STACK, &lim);
-	size_t size = lim.rlim_cur;
-	if (size > 16*1024*1024) size = 16*1024*1024;
-#else
-	size_t size = 16*1024*1024;
-#endif
-        pthread_attr_setstacksize(&worker_attr, size);
-    }
+    pthread_attr_setstacksize(&worker_attr, lace_thread_stacksize());
 
     if (verbosity) {
 #if LACE_USE_HWLOC
-        fprintf(stdout, "Initializing Lace, %u nodes, %u cores, %u logical processors, %d workers.\n", n_nodes, n_cores, n_pus, n_workers);
+        fprintf(stdout, "Initializing Lace, %u nodes, %u cores, %u logical processors, %d workers.\n", p->n_nodes, p->n_cores, p->n_pus, p->n_workers);
 #else
-        fprintf(stdout, "Initializing Lace, %u available cores, %d workers.\n", n_pus, n_workers);
+        fprintf(stdout, "Initializing Lace, %u available cores, %d workers.\n", p->n_pus, p->n_workers);
 #endif
     }
 
     // Prepare lace_init structure
-    atomic_store_explicit(&lace_newframe.t, NULL, memory_order_relaxed);
+    atomic_store_explicit(&p->newframe, NULL, memory_order_relaxed);
+
+    // Allocate the operation cache before the workers initialize, cleared below when they run
+    lace_cache_alloc(p);
 
 #if LACE_PIE_TIMES
-    // Initialize counters for pie times
-    us_elapsed_start();
-    count_at_start = gethrtime();
+    // Calibrate the ticks of the pie times
+    pthread_once(&ticks_once, lace_calibrate_ticks);
 #endif
+    pthread_once(&stats_once, lace_stats_clock_init);
 
     /* Report startup if verbose */
     if (verbosity) {
-        fprintf(stdout, "Lace startup, creating %d worker threads with program stack %zu bytes.\n", n_workers, stacksize);
+        unsigned int reused = p->n_workers < p->size ? p->n_workers : p->size;
+        fprintf(stdout, "Lace startup, reusing %u and creating %u worker threads with program stack %zu bytes.\n", reused, p->n_workers - reused, stacksize);
     }
 
-    /* Spawn all workers */
-    for (unsigned int i=0; i<n_workers; i++) {
+    /* Wake up the parked workers that are reused (see lace_pool_wait), then spawn the other workers */
+    if (p->size != 0) {
+        atomic_fetch_add(&p->epoch, 1);
+        lace_futex_wake(&p->epoch, INT_MAX);
+    }
+    for (unsigned int i=p->size; i<p->n_workers; i++) {
         pthread_t res;
-        pthread_create(&res, &worker_attr, lace_worker_thread, (void*)(size_t)i);
+        worker_thread_arg *arg = malloc(sizeof(worker_thread_arg));
+        if (arg == NULL) {
+            fprintf(stderr, "Lace error: unable to allocate memory for a worker thread!\n");
+            exit(1);
+        }
+        arg->pool = p;
+        arg->worker = i;
+        atomic_fetch_add(&p->threads, 1);
+        pthread_create(&res, &worker_attr, lace_worker_thread, arg);
     }
+    if (p->n_workers > p->size) p->size = p->n_workers;
+    p->parked = 0;
 
     /* Make sure we start resumed */
     lace_resume();
 
+    /* Wait until all workers are initialized, so their data can be read, e.g. by lace_profile_get */
+    while (p->workers_running != p->n_workers) {}
+
     pthread_attr_destroy(&worker_attr);
+
+    if (p->cache != NULL) TOGETHER(lace_cache_init_part);
 }
 
 
@@ -950,23 +3113,21 @@ void
 lace_count_reset()
 {
 #if LACE_COUNT_EVENTS
+    lace_pool_t *p = lace_current_pool();
     unsigned int i;
     size_t j;
 
-    for (i=0;i<n_workers;i++) {
+    for (i=0;i<p->n_workers;i++) {
         for (j=0;j<CTR_MAX;j++) {
-            workers_p[i]->ctr[j] = 0;
+            p->workers_p[i]->ctr[j] = 0;
         }
     }
 
 #if LACE_PIE_TIMES
-    for (i=0;i<n_workers;i++) {
-        workers_p[i]->time = gethrtime();
-        if (i != 0) workers_p[i]->level = 0;
+    for (i=0;i<p->n_workers;i++) {
+        p->workers_p[i]->time = gethrtime();
+        if (i != 0) p->workers_p[i]->level = 0;
     }
-
-    us_elapsed_start();
-    count_at_start = gethrtime();
 #endif
 #endif
 }
@@ -978,44 +3139,54 @@ void
 lace_count_report_file(FILE *file)
 {
 #if LACE_COUNT_EVENTS
+    lace_pool_t *p = lace_current_pool();
     unsigned int i;
     size_t j;
 
     for (j=0;j<CTR_MAX;j++) ctr_all[j] = 0;
-    for (i=0;i<n_workers;i++) {
-        uint64_t *wctr = workers_p[i]->ctr;
+    for (i=0;i<p->n_workers;i++) {
+        uint64_t *wctr = p->workers_p[i]->ctr;
         for (j=0;j<CTR_MAX;j++) {
             ctr_all[j] += wctr[j];
         }
     }
 
 #if LACE_COUNT_TASKS
-    for (i=0;i<n_workers;i++) {
-        fprintf(file, "Tasks (%d): %zu\n", i, workers_p[i]->ctr[CTR_tasks]);
+    for (i=0;i<p->n_workers;i++) {
+        fprintf(file, "Tasks (%d): %zu\n", i, p->workers_p[i]->ctr[CTR_tasks]);
     }
     fprintf(file, "Tasks (sum): %zu\n", ctr_all[CTR_tasks]);
     fprintf(file, "\n");
 #endif
 
 #if LACE_COUNT_STEALS
-    for (i=0;i<n_workers;i++) {
+    for (i=0;i<p->n_workers;i++) {
         fprintf(file, "Steals (%d): %zu good/%zu busy of %zu tries; leaps: %zu good/%zu busy of %zu tries\n", i,
-            workers_p[i]->ctr[CTR_steals], workers_p[i]->ctr[CTR_steal_busy],
-            workers_p[i]->ctr[CTR_steal_tries], workers_p[i]->ctr[CTR_leaps],
-            workers_p[i]->ctr[CTR_leap_busy], workers_p[i]->ctr[CTR_leap_tries]);
+            p->workers_p[i]->ctr[CTR_steals], p->workers_p[i]->ctr[CTR_steal_busy],
+            p->workers_p[i]->ctr[CTR_steal_tries], p->workers_p[i]->ctr[CTR_leaps],
+            p->workers_p[i]->ctr[CTR_leap_busy], p->workers_p[i]->ctr[CTR_leap_tries]);
     }
     fprintf(file, "Steals (sum): %zu good/%zu busy of %zu tries; leaps: %zu good/%zu busy of %zu tries\n", 
         ctr_all[CTR_steals], ctr_all[CTR_steal_busy],
         ctr_all[CTR_steal_tries], ctr_all[CTR_leaps],
         ctr_all[CTR_leap_busy], ctr_all[CTR_leap_tries]);
     fprintf(file, "\n");
+
+#if LACE_USE_HWLOC
+    fprintf(file, "Steals per level (sum): smt %zu/%zu, l3 %zu/%zu, node %zu/%zu, remote %zu/%zu (good/tries)\n",
+        ctr_all[CTR_level_steals], ctr_all[CTR_level_tries],
+        ctr_all[CTR_level_steals+1], ctr_all[CTR_level_tries+1],
+        ctr_all[CTR_level_steals+2], ctr_all[CTR_level_tries+2],
+        ctr_all[CTR_level_steals+3], ctr_all[CTR_level_tries+3]);
+    fprintf(file, "\n");
+#endif
 #endif
 
 #if LACE_COUNT_STEALS && LACE_COUNT_TASKS
-    for (i=0;i<n_workers;i++) {
-        if ((workers_p[i]->ctr[CTR_steals]+workers_p[i]->ctr[CTR_leaps]) > 0) {
+    for (i=0;i<p->n_workers;i++) {
+        if ((p->workers_p[i]->ctr[CTR_steals]+p->workers_p[i]->ctr[CTR_leaps]) > 0) {
             fprintf(file, "Tasks per steal (%d): %zu\n", i,
-                workers_p[i]->ctr[CTR_tasks]/(workers_p[i]->ctr[CTR_steals]+workers_p[i]->ctr[CTR_leaps]));
+                p->workers_p[i]->ctr[CTR_tasks]/(p->workers_p[i]->ctr[CTR_steals]+p->workers_p[i]->ctr[CTR_leaps]));
         }
     }
     if ((ctr_all[CTR_steals]+ctr_all[CTR_leaps]) > 0) {
@@ -1025,9 +3196,9 @@ lace_count_report_file(FILE *file)
 #endif
 
 #if LACE_COUNT_SPLITS
-    for (i=0;i<n_workers;i++) {
+    for (i=0;i<p->n_workers;i++) {
         fprintf(file, "Splits (%d): %zu shrinks, %zu grows, %zu outgoing requests\n", i,
-            workers_p[i]->ctr[CTR_split_shrink], workers_p[i]->ctr[CTR_split_grow], workers_p[i]->ctr[CTR_split_req]);
+            p->workers_p[i]->ctr[CTR_split_shrink], p->workers_p[i]->ctr[CTR_split_grow], p->workers_p[i]->ctr[CTR_split_req]);
     }
     fprintf(file, "Splits (sum): %zu shrinks, %zu grows, %zu outgoing requests\n",
         ctr_all[CTR_split_shrink], ctr_all[CTR_split_grow], ctr_all[CTR_split_req]);
@@ -1035,39 +3206,35 @@ lace_count_report_file(FILE *file)
 #endif
 
 #if LACE_PIE_TIMES
-    count_at_end = gethrtime();
-
-    uint64_t count_per_ms = (count_at_end - count_at_start) / (us_elapsed() / 1000);
-    double dcpm = (double)count_per_ms;
-
     uint64_t sum_count;
     sum_count = ctr_all[CTR_init] + ctr_all[CTR_wapp] + ctr_all[CTR_lapp] + ctr_all[CTR_wsteal] + ctr_all[CTR_lsteal]
               + ctr_all[CTR_close] + ctr_all[CTR_wstealsucc] + ctr_all[CTR_lstealsucc] + ctr_all[CTR_wsignal]
               + ctr_all[CTR_lsignal];
 
-    fprintf(file, "Measured clock (tick) frequency: %.2f GHz\n", count_per_ms / 1000000.0);
-    fprintf(file, "Aggregated time per pie slice, total time: %.2f CPU seconds\n\n", sum_count / (1000*dcpm));
-
-    for (i=0;i<n_workers;i++) {
-        fprintf(file, "Startup time (%d):    %10.2f ms\n", i, workers_p[i]->ctr[CTR_init] / dcpm);
-        fprintf(file, "Steal work (%d):      %10.2f ms\n", i, workers_p[i]->ctr[CTR_wapp] / dcpm);
-        fprintf(file, "Leap work (%d):       %10.2f ms\n", i, workers_p[i]->ctr[CTR_lapp] / dcpm);
-        fprintf(file, "Steal overhead (%d):  %10.2f ms\n", i, (workers_p[i]->ctr[CTR_wstealsucc]+workers_p[i]->ctr[CTR_wsignal]) / dcpm);
-        fprintf(file, "Leap overhead (%d):   %10.2f ms\n", i, (workers_p[i]->ctr[CTR_lstealsucc]+workers_p[i]->ctr[CTR_lsignal]) / dcpm);
-        fprintf(file, "Steal search (%d):    %10.2f ms\n", i, (workers_p[i]->ctr[CTR_wsteal]-workers_p[i]->ctr[CTR_wstealsucc]-workers_p[i]->ctr[CTR_wsignal]) / dcpm);
-        fprintf(file, "Leap search (%d):     %10.2f ms\n", i, (workers_p[i]->ctr[CTR_lsteal]-workers_p[i]->ctr[CTR_lstealsucc]-workers_p[i]->ctr[CTR_lsignal]) / dcpm);
-        fprintf(file, "Exit time (%d):       %10.2f ms\n", i, workers_p[i]->ctr[CTR_close] / dcpm);
+    fprintf(file, "Calibrated clock (tick) frequency: %.3f GHz\n", 1.0 / ns_per_tick);
+    fprintf(file, "Aggregated time per pie slice, total time: %.2f CPU seconds\n\n", lace_ticks_to_ns(sum_count) / 1e9);
+
+    for (i=0;i<p->n_workers;i++) {
+        uint64_t *ctr = p->workers_p[i]->ctr;
+        fprintf(file, "Startup time (%d):    %14.0f ns\n", i, lace_ticks_to_ns(ctr[CTR_init]));
+        fprintf(file, "Steal work (%d):      %14.0f ns\n", i, lace_ticks_to_ns(ctr[CTR_wapp]));
+        fprintf(file, "Leap work (%d):       %14.0f ns\n", i, lace_ticks_to_ns(ctr[CTR_lapp]));
+        fprintf(file, "Steal overhead (%d):  %14.0f ns\n", i, lace_ticks_to_ns(ctr[CTR_wstealsucc]+ctr[CTR_wsignal]));
+        fprintf(file, "Leap overhead (%d):   %14.0f ns\n", i, lace_ticks_to_ns(ctr[CTR_lstealsucc]+ctr[CTR_lsignal]));
+        fprintf(file, "Steal search (%d):    %14.0f ns\n", i, lace_ticks_to_ns(ctr[CTR_wsteal]-ctr[CTR_wstealsucc]-ctr[CTR_wsignal]));
+        fprintf(file, "Leap search (%d):     %14.0f ns\n", i, lace_ticks_to_ns(ctr[CTR_lsteal]-ctr[CTR_lstealsucc]-ctr[CTR_lsignal]));
+        fprintf(file, "Exit time (%d):       %14.0f ns\n", i, lace_ticks_to_ns(ctr[CTR_close]));
         fprintf(file, "\n");
     }
 
-    fprintf(file, "Startup time (sum):    %10.2f ms\n", ctr_all[CTR_init] / dcpm);
-    fprintf(file, "Steal work (sum):      %10.2f ms\n", ctr_all[CTR_wapp] / dcpm);
-    fprintf(file, "Leap work (sum):       %10.2f ms\n", ctr_all[CTR_lapp] / dcpm);
-    fprintf(file, "Steal overhead (sum):  %10.2f ms\n", (ctr_all[CTR_wstealsucc]+ctr_all[CTR_wsignal]) / dcpm);
-    fprintf(file, "Leap overhead (sum):   %10.2f ms\n", (ctr_all[CTR_lstealsucc]+ctr_all[CTR_lsignal]) / dcpm);
-    fprintf(file, "Steal search (sum):    %10.2f ms\n", (ctr_all[CTR_wsteal]-ctr_all[CTR_wstealsucc]-ctr_all[CTR_wsignal]) / dcpm);
-    fprintf(file, "Leap search (sum):     %10.2f ms\n", (ctr_all[CTR_lsteal]-ctr_all[CTR_lstealsucc]-ctr_all[CTR_lsignal]) / dcpm);
-    fprintf(file, "Exit time (sum):       %10.2f ms\n", ctr_all[CTR_close] / dcpm);
+    fprintf(file, "Startup time (sum):    %14.0f ns\n", lace_ticks_to_ns(ctr_all[CTR_init]));
+    fprintf(file, "Steal work (sum):      %14.0f ns\n", lace_ticks_to_ns(ctr_all[CTR_wapp]));
+    fprintf(file, "Leap work (sum):       %14.0f ns\n", lace_ticks_to_ns(ctr_all[CTR_lapp]));
+    fprintf(file, "Steal overhead (sum):  %14.0f ns\n", lace_ticks_to_ns(ctr_all[CTR_wstealsucc]+ctr_all[CTR_wsignal]));
+    fprintf(file, "Leap overhead (sum):   %14.0f ns\n", lace_ticks_to_ns(ctr_all[CTR_lstealsucc]+ctr_all[CTR_lsignal]));
+    fprintf(file, "Steal search (sum):    %14.0f ns\n", lace_ticks_to_ns(ctr_all[CTR_wsteal]-ctr_all[CTR_wstealsucc]-ctr_all[CTR_wsignal]));
+    fprintf(file, "Leap search (sum):     %14.0f ns\n", lace_ticks_to_ns(ctr_all[CTR_lsteal]-ctr_all[CTR_lstealsucc]-ctr_all[CTR_lsignal]));
+    fprintf(file, "Exit time (sum):       %14.0f ns\n", lace_ticks_to_ns(ctr_all[CTR_close]));
     fprintf(file, "\n" );
 #endif
 #endif
@@ -1078,56 +3245,53 @@ lace_count_report_file(FILE *file)
 /**
  * End Lace. All Workers are signaled to quit.
  * This function waits until all threads are done, then returns.
+ * With warm restart, the workers are parked and keep their memory, for the next lace_start.
  */
 void lace_stop()
 {
+    lace_pool_t *p = lace_current_pool();
     // Workers need to be awake for this
     lace_resume();
 
     // Do not stop if not all workers are running yet
-    while (workers_running != n_workers) {}
+    while (p->workers_running != p->n_workers) {}
 
-    lace_quits = 1;
+    atomic_store(&p->keep, p->warm_restart);
+    p->quits = 1;
+    lace_wake_all(p);
 
-    while (workers_running != 0) {}
+    while (p->workers_running != 0) {}
 
 #if LACE_COUNT_EVENTS
     lace_count_report_file(stdout);
 #endif
 
+#if LACE_PROFILE
+    lace_profile_report(stdout);
+#endif
+
     // finally, destroy the barriers
-    lace_barrier_destroy();
-    sem_destroy(&suspend_semaphore);
+    lace_barrier_destroy(p);
+    sem_destroy(&p->suspend_semaphore);
 
-    for (unsigned int i=0; i<n_workers; i++) {
-#if LACE_USE_MMAP
-        munmap(workers_memory[i], workers_memory_size);
-#elif defined(_MSC_VER) || defined(__MINGW64_VERSION_MAJOR)
-	_aligned_free(workers_memory[i]);
-#elif defined(__MINGW32__)
-	__mingw_aligned_free(workers_memory[i]);
-#else
-        free(workers_memory[i]);
+    lace_aligned_free(p->ext_queues);
+    p->ext_queues = 0;
+    p->high_queue = 0;
+
+#if LACE_USE_HWLOC
+    free(p->steal_order);
+    free(p->steal_level_end);
+    p->steal_order = 0;
+    p->steal_level_end = 0;
 #endif
-    }
 
-#if defined(_MSC_VER) || defined(__MINGW64_VERSION_MAJOR)
-    _aligned_free(workers);
-    _aligned_free(workers_p);
-    _aligned_free(workers_memory);
-#elif defined(__MINGW32__)
-    __mingw_aligned_free(workers);
-    __mingw_aligned_free(workers_p);
-    __mingw_aligned_free(workers_memory);
-#else
-    free(workers);
-    free(workers_p);
-    free(workers_memory);
+#if LACE_USE_HWLOC && defined(__linux__)
+    free(p->pu_ext_queue);
+    p->pu_ext_queue = 0;
 #endif
 
-    workers = 0;
-    workers_p = 0;
-    workers_memory = 0;
+    if (p->warm_restart) p->parked = 1;
+    else lace_pool_shutdown(p);
 }
 
 /**
@@ -1144,6 +3308,9 @@ lace_exec_in_new_frame(WorkerP *__lace_worker, Task *__lace_dq_head, Task *root)
     TailSplitNA old;
     uint8_t old_as;
 
+    // all workers have a copy of the task, and no new frame can start until the barrier below
+    atomic_fetch_and(&__lace_worker->interrupt, ~(uint32_t)LACE_INTERRUPT_NEWFRAME);
+
     // save old tail, split, allstolen and initiate new frame
     {
         Worker *wt = __lace_worker->_public;
@@ -1168,7 +3335,9 @@ lace_exec_in_new_frame(WorkerP *__lace_worker, Task *__lace_dq_head, Task *root)
     lace_barrier();
 
     // execute task
-    root->f(__lace_worker, __lace_dq_head, root);
+    LACE_TRACE_EVENT(__lace_worker, LACE_TRACE_NEWFRAME_BEGIN, 0);
+    LACE_EXEC_IN_SCOPE(__lace_worker, __lace_dq_head, root, NULL); // the new frame is not in a scope
+    LACE_TRACE_EVENT(__lace_worker, LACE_TRACE_NEWFRAME_END, 0);
 
     // wait until all workers are back (else they may steal from previous frame)
     lace_barrier();
@@ -1192,7 +3361,7 @@ lace_yield(WorkerP *__lace_worker, Task *__lace_dq_head)
 {
     // make a local copy of the task
     Task _t;
-    memcpy(&_t, lace_newframe.t, sizeof(Task));
+    memcpy(&_t, __lace_worker->pool->newframe, sizeof(Task));
 
     // wait until all workers have made a local copy
     lace_barrier();
@@ -1200,6 +3369,22 @@ lace_yield(WorkerP *__lace_worker, Task *__lace_dq_head)
     lace_exec_in_new_frame(__lace_worker, __lace_dq_head, &_t);
 }
 
+/**
+ * Handle the pending interrupts of the worker (see YIELD_NEWFRAME).
+ * The flag for high-priority tasks is cleared before the queue is emptied, so no task is missed.
+ * The flag for a new frame is cleared by lace_exec_in_new_frame.
+ */
+void
+lace_interrupted(WorkerP *__lace_worker, Task *__lace_dq_head)
+{
+    uint32_t flags = atomic_load_explicit(&__lace_worker->interrupt, memory_order_acquire);
+    if (flags & LACE_INTERRUPT_HIGH) {
+        atomic_fetch_and(&__lace_worker->interrupt, ~(uint32_t)LACE_INTERRUPT_HIGH);
+        while (lace_steal_high(__lace_worker, __lace_dq_head)) {}
+    }
+    if (flags & LACE_INTERRUPT_NEWFRAME) lace_yield(__lace_worker, __lace_dq_head);
+}
+
 /**
  * Root task for the TOGETHER method.
  * Ensures after executing, to steal random tasks until done.
@@ -1218,8 +3403,10 @@ VOID_TASK_2(lace_together_root, Task*, t, atomic_int*, finished)
 
 VOID_TASK_1(lace_wrap_together, Task*, task)
 {
+    lace_pool_t *p = __lace_worker->pool;
+
     /* synchronization integer (decrease by 1 when done...) */
-    atomic_int done = n_workers;
+    atomic_int done = p->n_workers;
 
     /* wrap task in lace_together_root */
     Task _t2;
@@ -1232,15 +3419,19 @@ VOID_TASK_1(lace_wrap_together, Task*, task)
     /* now try to be the one who sets it! */
     while (1) {
         Task *expected = 0;
-        if (atomic_compare_exchange_weak(&lace_newframe.t, &expected, &_t2)) break;
+        if (atomic_compare_exchange_weak(&p->newframe, &expected, &_t2)) break;
         lace_yield(__lace_worker, __lace_dq_head);
     }
 
+    // interrupt all workers, and parked workers must join the new frame
+    lace_interrupt_workers(p, LACE_INTERRUPT_NEWFRAME);
+    lace_wake_all(p);
+
     // wait until other workers have made a local copy
     lace_barrier();
 
     // reset the newframe struct
-    atomic_store_explicit(&lace_newframe.t, NULL, memory_order_relaxed);
+    atomic_store_explicit(&p->newframe, NULL, memory_order_relaxed);
 
     lace_exec_in_new_frame(__lace_worker, __lace_dq_head, &_t2);
 }
@@ -1249,10 +3440,13 @@ VOID_TASK_2(lace_newframe_root, Task*, t, atomic_int*, done)
 {
     t->f(__lace_worker, __lace_dq_head, t);
     *done = 1;
+    lace_wake_all(__lace_worker->pool);
 }
 
 VOID_TASK_1(lace_wrap_newframe, Task*, task)
 {
+    lace_pool_t *p = __lace_worker->pool;
+
     /* synchronization integer (set to 1 when done...) */
     atomic_int done = 0;
 
@@ -1266,15 +3460,19 @@ VOID_TASK_1(lace_wrap_newframe, Task*, task)
     /* now try to be the one who sets it! */
     while (1) {
         Task *expected = 0;
-        if (atomic_compare_exchange_weak(&lace_newframe.t, &expected, &_s)) break;
+        if (atomic_compare_exchange_weak(&p->newframe, &expected, &_s)) break;
         lace_yield(__lace_worker, __lace_dq_head);
     }
 
+    // interrupt all workers, and parked workers must join the new frame
+    lace_interrupt_workers(p, LACE_INTERRUPT_NEWFRAME);
+    lace_wake_all(p);
+
     // wait until other workers have made a local copy
     lace_barrier();
 
     // reset the newframe struct, then wrap and run ours
-    atomic_store_explicit(&lace_newframe.t, NULL, memory_order_relaxed);
+    atomic_store_explicit(&p->newframe, NULL, memory_order_relaxed);
 
     /* wrap task in lace_newframe_root */
     Task _t2;
@@ -1311,6 +3509,525 @@ lace_run_newframe(Task *t)
 
 /**
  * Called by _SPAWN functions when the Task stack is full.
+ * With mmap, commits more of the reserved deque (doubling its size), otherwise aborts.
+ * The deque does not move, so thieves and the tail/split indices are not affected.
+ */
+void
+lace_grow_deque(WorkerP *w)
+{
+#if LACE_USE_MMAP
+    lace_pool_t *p = w->pool;
+    size_t size = w->end - w->dq;
+    if (size < p->reserved_dqsize) {
+        size_t grow = size < p->reserved_dqsize - size ? size : p->reserved_dqsize - size;
+        char *base = (char*)p->workers_memory[w->worker];
+        size_t from = ((char*)w->end - base) & ~(page_size - 1);
+        size_t to = ((char*)(w->end + grow) - base + page_size - 1) & ~(page_size - 1);
+        if (to > p->workers_memory_size) to = p->workers_memory_size;
+        if (mprotect(base + from, to - from, PROT_READ|PROT_WRITE) == 0) {
+            w->end += grow;
+            return;
+        }
+    }
+#else
+    (void)w;
+#endif
+    lace_abort_stack_overflow();
+}
+
+#if LACE_TRACE
+void
+lace_set_trace_size(size_t events)
+{
+    trace_size = 1;
+    while (trace_size < events) trace_size <<= 1;
+}
+
+/**
+ * Copy the valid part of the trace of worker <w> to <times> and <infos> (of trace_size entries each)
+ * and return the number of events.
+ * Events that the worker overwrote while copying are skipped, as with a sequence lock.
+ */
+static size_t
+lace_trace_copy(WorkerP *w, uint64_t *times, uint64_t *infos)
+{
+    uint64_t head = atomic_load_explicit(&w->trace_head, memory_order_acquire);
+    uint64_t first = head > trace_size ? head - trace_size : 0;
+    for (uint64_t i=first; i<head; i++) {
+        lace_trace_entry *e = &w->trace[i & w->trace_mask];
+        times[i-first] = atomic_load_explicit(&e->time, memory_order_relaxed);
+        infos[i-first] = atomic_load_explicit(&e->info, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t now = atomic_load_explicit(&w->trace_head, memory_order_relaxed);
+    uint64_t skip = now > trace_size && now - trace_size > first ? now - trace_size - first : 0;
+    if (skip > head - first) skip = head - first;
+    memmove(times, times+skip, (head-first-skip)*sizeof(uint64_t));
+    memmove(infos, infos+skip, (head-first-skip)*sizeof(uint64_t));
+    return head-first-skip;
+}
+
+void
+lace_trace_dump(FILE *file)
+{
+    lace_pool_t *p = lace_current_pool();
+    static const char *names[] = { "spawn", "steal", "steal", "leap", "leap", "sync_slow", "newframe", "newframe", "suspend", "suspend" };
+    static const char *phases[] = { "i", "B", "E", "B", "E", "i", "B", "E", "B", "E" };
+    static const char *args[] = { "slot", "victim", NULL, "thief", NULL, "slot", NULL, NULL, NULL, NULL };
+
+    uint64_t *times = (uint64_t*)malloc(trace_size * sizeof(uint64_t) * p->n_workers);
+    uint64_t *infos = (uint64_t*)malloc(trace_size * sizeof(uint64_t) * p->n_workers);
+    size_t *counts = (size_t*)calloc(p->n_workers, sizeof(size_t));
+    if (times == NULL || infos == NULL || counts == NULL) {
+        fprintf(stderr, "Lace error: Unable to allocate memory for the trace!\n");
+        exit(1);
+    }
+
+    // copy the traces first, then use the earliest event as time 0
+    uint64_t start = UINT64_MAX;
+    for (unsigned int i=0; i<p->n_workers; i++) {
+        counts[i] = lace_trace_copy(p->workers_p[i], times + i*trace_size, infos + i*trace_size);
+        if (counts[i] != 0 && times[i*trace_size] < start) start = times[i*trace_size];
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    int first = 1;
+    for (unsigned int i=0; i<p->n_workers; i++) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}", first ? "" : ",\n", i, i);
+        first = 0;
+        int depth = 0; // skip end events of which the begin event was overwritten
+        for (size_t j=0; j<counts[i]; j++) {
+            uint64_t info = infos[i*trace_size + j];
+            unsigned int kind = info & 0xff;
+            if (kind > LACE_TRACE_SUSPEND_END) continue;
+            if (phases[kind][0] == 'B') depth++;
+            if (phases[kind][0] == 'E') {
+                if (depth == 0) continue;
+                depth--;
+            }
+            double ts = (times[i*trace_size + j] - start) / 1000.0;
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":0,\"tid\":%u", names[kind], phases[kind], ts, i);
+            if (phases[kind][0] == 'i') fprintf(file, ",\"s\":\"t\"");
+            if (args[kind] != NULL) fprintf(file, ",\"args\":{\"%s\":%llu}", args[kind], (unsigned long long)(info >> 8));
+            fprintf(file, "}");
+        }
+    }
+    fprintf(file, "\n]}\n");
+
+    free(times);
+    free(infos);
+    free(counts);
+}
+#endif
+
+#if LACE_PROFILE
+/**
+ * All task types, registered by the constructors that TASK_IMPL_n generates
+ */
+static _Atomic(lace_task_type_t*) task_types = NULL;
+static _Atomic(unsigned int) n_task_types = 0;
+
+void
+lace_profile_register(lace_task_type_t *type)
+{
+    type->id = atomic_fetch_add(&n_task_types, 1);
+    lace_task_type_t *head = atomic_load(&task_types);
+    do {
+        type->next = head;
+    } while (!atomic_compare_exchange_weak(&task_types, &head, type));
+}
+
+void
+lace_profile_get(const lace_task_type_t *type, lace_profile_ctr *ctr)
+{
+    lace_pool_t *p = lace_current_pool();
+    memset(ctr, 0, sizeof(lace_profile_ctr));
+    if (type->id >= LACE_PROFILE_TYPES) return;
+    for (unsigned int i=0; i<p->n_workers; i++) {
+        // a worker that did not start yet has no profile
+        if (p->workers_p[i] == NULL) continue;
+        lace_profile_ctr *c = &p->workers_p[i]->profile[type->id];
+        ctr->spawns += c->spawns;
+        ctr->inlined += c->inlined;
+        ctr->stolen += c->stolen;
+        ctr->runs += c->runs;
+        ctr->ns += c->ns;
+    }
+}
+
+void
+lace_profile_reset(void)
+{
+    lace_pool_t *p = lace_current_pool();
+    for (unsigned int i=0; i<p->n_workers; i++) {
+        if (p->workers_p[i] == NULL) continue;
+        memset(p->workers_p[i]->profile, 0, (LACE_PROFILE_TYPES + 1) * sizeof(lace_profile_ctr));
+    }
+}
+
+typedef struct {
+    const char *name;
+    lace_profile_ctr ctr;
+} lace_profile_row;
+
+static int
+lace_profile_row_cmp(const void *a, const void *b)
+{
+    uint64_t x = ((const lace_profile_row*)a)->ctr.ns, y = ((const lace_profile_row*)b)->ctr.ns;
+    return x > y ? -1 : x < y ? 1 : 0;
+}
+
+void
+lace_profile_report(FILE *file)
+{
+    unsigned int n = atomic_load(&n_task_types);
+    lace_profile_row *rows = (lace_profile_row*)malloc((n + 1) * sizeof(lace_profile_row));
+    if (rows == NULL) {
+        fprintf(stderr, "Lace error: Unable to allocate memory for the profile!\n");
+        exit(1);
+    }
+
+    // collect the task types that ran or were spawned, sorted by time
+    unsigned int k = 0;
+    uint64_t total = 0;
+    for (lace_task_type_t *t = atomic_load(&task_types); t != NULL; t = t->next) {
+        if (k == n) break;
+        lace_profile_get(t, &rows[k].ctr);
+        if (rows[k].ctr.runs == 0 && rows[k].ctr.spawns == 0) continue;
+        total += rows[k].ctr.ns;
+        rows[k++].name = t->name;
+    }
+    qsort(rows, k, sizeof(lace_profile_row), lace_profile_row_cmp);
+
+    fprintf(file, "%-24s %12s %12s %12s %7s %12s %10s %6s %12s\n",
+        "task", "spawns", "inlined", "stolen", "stolen%", "runs", "time (ms)", "time%", "grain (ns)");
+    for (unsigned int i=0; i<k; i++) {
+        lace_profile_ctr *c = &rows[i].ctr;
+        fprintf(file, "%-24s %12llu %12llu %12llu %6.2f%% %12llu %10.2f %5.1f%% %12.0f\n", rows[i].name,
+            (unsigned long long)c->spawns, (unsigned long long)c->inlined, (unsigned long long)c->stolen,
+            c->spawns ? 100.0 * c->stolen / c->spawns : 0.0, (unsigned long long)c->runs, c->ns / 1e6,
+            total ? 100.0 * c->ns / total : 0.0, c->runs ? (double)c->ns / c->runs : 0.0);
+    }
+    free(rows);
+}
+#endif
+
+void
+lace_task_elided(WorkerP *w, Task *__dq_head, Task *t)
+{
+    (void)w;
+    (void)__dq_head;
+    (void)t;
+}
+
+/**
+ * Parallel stable mergesort (see lace_sort).
+ * Ranges of at most LACE_SORT_SEQ elements are sorted and merged sequentially, with insertion sort below LACE_SORT_INSERTION.
+ */
+#define LACE_SORT_SEQ 2048
+#define LACE_SORT_INSERTION 16
+
+typedef struct {
+    size_t size;
+    lace_sort_cmp cmp;
+    void *arg;
+} lace_sort_ctx;
+
+/**
+ * Insertion sort of the <n> elements at <low>; <t> has room for one element.
+ */
+static void
+lace_sort_insertion(const lace_sort_ctx *c, char *low, size_t n, char *t)
+{
+    size_t s = c->size;
+    for (size_t i=1; i<n; i++) {
+        char *x = low + i * s;
+        size_t j = i;
+        while (j > 0 && c->cmp(x, low + (j - 1) * s, c->arg) < 0) j--;
+        if (j == i) continue;
+        memcpy(t, x, s);
+        memmove(low + (j + 1) * s, low + j * s, (i - j) * s);
+        memcpy(low + j * s, t, s);
+    }
+}
+
+/**
+ * Merge the sorted ranges <a> and <b> into <dest>; equal elements of <a> come first.
+ */
+static void
+lace_sort_seq_merge(const lace_sort_ctx *c, const char *a, size_t na, const char *b, size_t nb, char *dest)
+{
+    size_t s = c->size;
+    while (na > 0 && nb > 0) {
+        if (c->cmp(b, a, c->arg) < 0) {
+            memcpy(dest, b, s);
+            b += s;
+            nb--;
+        } else {
+            memcpy(dest, a, s);
+            a += s;
+            na--;
+        }
+        dest += s;
+    }
+    memcpy(dest, a, na * s);
+    memcpy(dest + na * s, b, nb * s);
+}
+
+static void
+lace_sort_seq(const lace_sort_ctx *c, char *low, char *tmp, size_t n)
+{
+    if (n <= LACE_SORT_INSERTION) {
+        lace_sort_insertion(c, low, n, tmp);
+        return;
+    }
+    size_t s = c->size, h = n / 2;
+    lace_sort_seq(c, low, tmp, h);
+    lace_sort_seq(c, low + h * s, tmp + h * s, n - h);
+    if (c->cmp(low + h * s, low + (h - 1) * s, c->arg) >= 0) return; // already in order
+    lace_sort_seq_merge(c, low, h, low + h * s, n - h, tmp);
+    memcpy(low, tmp, n * s);
+}
+
+/**
+ * Get the number of elements of the sorted range <a> that come before <v> (<upper> = 0), or before or at <v> (<upper> = 1).
+ */
+static size_t
+lace_sort_bound(const lace_sort_ctx *c, const char *a, size_t n, const char *v, int upper)
+{
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int r = c->cmp(a + mid * c->size, v, c->arg);
+        if (r < 0 || (upper && r == 0)) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+VOID_TASK_6(lace_sort_merge, const lace_sort_ctx*, c, const char*, a, size_t, na, const char*, b, size_t, nb, char*, dest)
+{
+    if (na + nb <= LACE_SORT_SEQ) {
+        lace_sort_seq_merge(c, a, na, b, nb, dest);
+        return;
+    }
+    // split the larger range in the middle, and the other range at the same element,
+    // such that equal elements of <a> stay before those of <b>
+    size_t s = c->size, i, j;
+    if (na >= nb) {
+        i = na / 2;
+        j = lace_sort_bound(c, b, nb, a + i * s, 0);
+    } else {
+        j = nb / 2;
+        i = lace_sort_bound(c, a, na, b + j * s, 1);
+    }
+    SPAWN(lace_sort_merge, c, a, i, b, j, dest);
+    CALL(lace_sort_merge, c, a + i * s, na - i, b + j * s, nb - j, dest + (i + j) * s);
+    SYNC(lace_sort_merge);
+}
+
+VOID_TASK_4(lace_sort_rec, const lace_sort_ctx*, c, char*, low, char*, tmp, size_t, n)
+{
+    if (n <= LACE_SORT_SEQ) {
+        lace_sort_seq(c, low, tmp, n);
+        return;
+    }
+    // sort the quarters in place, merge them pairwise into <tmp>, then merge the halves back
+    size_t s = c->size, q = n / 4;
+    SPAWN(lace_sort_rec, c, low, tmp, q);
+    SPAWN(lace_sort_rec, c, low + q * s, tmp + q * s, q);
+    SPAWN(lace_sort_rec, c, low + 2 * q * s, tmp + 2 * q * s, q);
+    CALL(lace_sort_rec, c, low + 3 * q * s, tmp + 3 * q * s, n - 3 * q);
+    SYNC(lace_sort_rec);
+    SYNC(lace_sort_rec);
+    SYNC(lace_sort_rec);
+    SPAWN(lace_sort_merge, c, low, q, low + q * s, q, tmp);
+    CALL(lace_sort_merge, c, low + 2 * q * s, q, low + 3 * q * s, n - 3 * q, tmp + 2 * q * s);
+    SYNC(lace_sort_merge);
+    CALL(lace_sort_merge, c, tmp, 2 * q, tmp + 2 * q * s, n - 2 * q, low);
+}
+
+void
+lace_sort(void *base, size_t n, size_t size, lace_sort_cmp cmp, void *arg, lace_sort_buffer_t *buf)
+{
+    if (n < 2) return;
+    lace_sort_buffer_t local = { NULL, 0 };
+    if (buf == NULL) buf = &local;
+    if (buf->size < n * size) {
+        free(buf->data);
+        buf->data = malloc(n * size);
+        if (buf->data == NULL) {
+            fprintf(stderr, "Lace error: Unable to allocate memory for sorting!\n");
+            exit(1);
+        }
+        buf->size = n * size;
+    }
+    lace_sort_ctx c = { size, cmp, arg };
+    RUN(lace_sort_rec, &c, (char*)base, (char*)buf->data, n);
+    if (buf == &local) free(local.data);
+}
+
+void
+lace_sort_buffer_free(lace_sort_buffer_t *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->size = 0;
+}
+
+/**
+ * Parallel matrix multiplication (see lace_sgemm and lace_dgemm).
+ * Leaves of at most LACE_GEMM_MC rows and 8 * NR columns of C run sequentially, in panels of depth LACE_GEMM_KC.
+ * The micro-kernel keeps an MR x NR tile of C in registers. It is plain C, written such that the compiler
+ * vectorizes the loop over the NR columns (Lace is compiled with -march=native); a row of a tile is 64 bytes.
+ * GCC would otherwise unroll that loop completely and then vectorize the loop over the depth, which is slow.
+ */
+#define LACE_GEMM_KC 256
+#define LACE_GEMM_MC 64
+
+#if defined(__GNUC__)
+#define LACE_GEMM_VECTOR_LOOP _Pragma("GCC unroll 1")
+#else
+#define LACE_GEMM_VECTOR_LOOP
+#endif
+
+#define LACE_GEMM_DEFINE(P, T, MR, NR)                                                                      \
+typedef struct {                                                                                            \
+    size_t k;                                                                                               \
+    T alpha;                                                                                                \
+    const T *A;                                                                                             \
+    size_t lda;                                                                                             \
+    const T *B;                                                                                             \
+    size_t ldb;                                                                                             \
+    T beta;                                                                                                 \
+    T *C;                                                                                                   \
+    size_t ldc;                                                                                             \
+} lace_##P##gemm_ctx;                                                                                       \
+                                                                                                            \
+/* pack rows i0..i0+m and columns k0..k0+kc of A in panels of MR rows, column by column */                  \
+static void                                                                                                 \
+lace_##P##gemm_pack_a(const lace_##P##gemm_ctx *g, size_t i0, size_t m, size_t k0, size_t kc, T *pa)       \
+{                                                                                                           \
+    for (size_t i=0; i<m; i+=MR) {                                                                          \
+        for (size_t p=0; p<kc; p++) {                                                                       \
+            for (size_t ii=0; ii<MR; ii++) *pa++ = i + ii < m ? g->A[(i0 + i + ii) * g->lda + k0 + p] : 0;  \
+        }                                                                                                   \
+    }                                                                                                       \
+}                                                                                                           \
+                                                                                                            \
+/* pack rows k0..k0+kc and columns j0..j0+n of B in panels of NR columns, row by row */                     \
+static void                                                                                                 \
+lace_##P##gemm_pack_b(const lace_##P##gemm_ctx *g, size_t k0, size_t kc, size_t j0, size_t n, T *pb)       \
+{                                                                                                           \
+    for (size_t j=0; j<n; j+=NR) {                                                                          \
+        for (size_t p=0; p<kc; p++) {                                                                       \
+            const T *b = g->B + (k0 + p) * g->ldb + j0 + j;                                                 \
+            for (size_t jj=0; jj<NR; jj++) *pb++ = j + jj < n ? b[jj] : 0;                                  \
+        }                                                                                                   \
+    }                                                                                                       \
+}                                                                                                           \
+                                                                                                            \
+/* add alpha times the product of a packed panel of A and of B to the <mr> x <nr> tile at <c> */            \
+static inline void                                                                                          \
+lace_##P##gemm_micro(size_t kc, const T *a, const T *b, T alpha, T *c, size_t ldc, size_t mr, size_t nr)   \
+{                                                                                                           \
+    T acc[MR][NR];                                                                                          \
+    for (size_t i=0; i<MR; i++) {                                                                           \
+        for (size_t j=0; j<NR; j++) acc[i][j] = 0;                                                          \
+    }                                                                                                       \
+    for (size_t p=0; p<kc; p++) {                                                                           \
+        for (size_t i=0; i<MR; i++) {                                                                       \
+            T ai = a[p * MR + i];                                                                           \
+            LACE_GEMM_VECTOR_LOOP                                                                           \
+            for (size_t j=0; j<NR; j++) acc[i][j] += ai * b[p * NR + j];                                    \
+        }                                                                                                   \
+    }                                                                                                       \
+    for (size_t i=0; i<mr; i++) {                                                                           \
+        for (size_t j=0; j<nr; j++) c[i * ldc + j] += alpha * acc[i][j];                                    \
+    }                                                                                                       \
+}                                                                                                           \
+                                                                                                            \
+static void                                                                                                 \
+lace_##P##gemm_leaf(WorkerP *__lace_worker, const lace_##P##gemm_ctx *g, size_t i0, size_t j0, size_t m, size_t n) \
+{                                                                                                           \
+    for (size_t i=0; i<m; i++) {                                                                            \
+        T *c = g->C + (i0 + i) * g->ldc + j0;                                                               \
+        if (g->beta == 0) for (size_t j=0; j<n; j++) c[j] = 0;                                              \
+        else if (g->beta != 1) for (size_t j=0; j<n; j++) c[j] *= g->beta;                                  \
+    }                                                                                                       \
+    lace_mark_t mark = LACE_MARK();                                                                         \
+    T *pa = (T*)LACE_ALLOC(sizeof(T) * (m + MR - 1) / MR * MR * LACE_GEMM_KC);                              \
+    T *pb = (T*)LACE_ALLOC(sizeof(T) * (n + NR - 1) / NR * NR * LACE_GEMM_KC);                              \
+    for (size_t k0=0; k0<g->k; k0+=LACE_GEMM_KC) {                                                          \
+        size_t kc = g->k - k0 < LACE_GEMM_KC ? g->k - k0 : LACE_GEMM_KC;                                    \
+        lace_##P##gemm_pack_a(g, i0, m, k0, kc, pa);                                                        \
+        lace_##P##gemm_pack_b(g, k0, kc, j0, n, pb);                                                        \
+        /* a panel of B stays in L1 while it is multiplied with all panels of A */                          \
+        for (size_t j=0; j<n; j+=NR) {                                                                      \
+            for (size_t i=0; i<m; i+=MR) {                                                                  \
+                T *c = g->C + (i0 + i) * g->ldc + j0 + j;                                                   \
+                lace_##P##gemm_micro(kc, pa + i * kc, pb + j * kc, g->alpha, c, g->ldc,                     \
+                                     m - i < MR ? m - i : MR, n - j < NR ? n - j : NR);                     \
+            }                                                                                               \
+        }                                                                                                   \
+    }                                                                                                       \
+    LACE_RELEASE(mark);                                                                                     \
+}                                                                                                           \
+                                                                                                            \
+VOID_TASK_5(lace_##P##gemm_rec, const lace_##P##gemm_ctx*, g, size_t, i0, size_t, j0, size_t, m, size_t, n) \
+{                                                                                                           \
+    if (m <= LACE_GEMM_MC && n <= 8 * NR) {                                                                 \
+        lace_##P##gemm_leaf(__lace_worker, g, i0, j0, m, n);                                                \
+        return;                                                                                             \
+    }                                                                                                       \
+    /* split the dimension that is largest relative to the leaf, at a multiple of the tile size */         \
+    if (m * 8 * NR >= n * LACE_GEMM_MC) {                                                                   \
+        size_t m1 = (m / 2 + MR - 1) / MR * MR;                                                             \
+        SPAWN(lace_##P##gemm_rec, g, i0, j0, m1, n);                                                        \
+        CALL(lace_##P##gemm_rec, g, i0 + m1, j0, m - m1, n);                                                \
+        SYNC(lace_##P##gemm_rec);                                                                           \
+    } else {                                                                                                \
+        size_t n1 = (n / 2 + NR - 1) / NR * NR;                                                             \
+        SPAWN(lace_##P##gemm_rec, g, i0, j0, m, n1);                                                        \
+        CALL(lace_##P##gemm_rec, g, i0, j0 + n1, m, n - n1);                                                \
+        SYNC(lace_##P##gemm_rec);                                                                           \
+    }                                                                                                       \
+}                                                                                                           \
+                                                                                                            \
+void                                                                                                        \
+lace_##P##gemm(size_t m, size_t n, size_t k, T alpha, const T *A, size_t lda, const T *B, size_t ldb,       \
+               T beta, T *C, size_t ldc)                                                                    \
+{                                                                                                           \
+    if (m == 0 || n == 0) return;                                                                           \
+    lace_##P##gemm_ctx g = { k, alpha, A, lda, B, ldb, beta, C, ldc };                                      \
+    RUN(lace_##P##gemm_rec, &g, 0, 0, m, n);                                                                \
+}
+
+LACE_GEMM_DEFINE(s, float, 8, 16)
+LACE_GEMM_DEFINE(d, double, 8, 8)
+
+/**
+ * Called by _RUN_ASYNC functions for tasks that do not fit in a Task.
+ */
+void
+lace_abort_async_too_large(void)
+{
+    fprintf(stderr, "Lace fatal error: RUN_ASYNC and DATAFLOW do not support tasks with more than LACE_TASKSIZE bytes of data! Aborting.\n");
+    exit(-1);
+}
+
+/**
+ * Called by _SPAWN_ELIDABLE functions of tasks that are not elidable.
+ */
+void
+lace_abort_not_elidable(void)
+{
+    fprintf(stderr, "Lace fatal error: SPAWN_ELIDABLE needs a task defined with TASK_ELIDABLE_n or VOID_TASK_ELIDABLE_n! Aborting.\n");
+    exit(-1);
+}
+
+/**
+ * Called when the Task stack is full and cannot grow.
  */
 void
 lace_abort_stack_overflow(void)
@@ -0,0 +1,488 @@
+/*
+ * Copyright 2013-2016 Formal Methods and Tools, University of Twente
+ * Copyright 2016-2017 Tom van Dijk, Johannes Kepler University Linz
+ * Copyright 2019-2021 Tom van Dijk, Formal Methods and Tools, University of Twente
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __LACE_HPP__
+#define __LACE_HPP__
+
+#include <lace.h>
+
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * C++ front-end for Lace.
+ *
+ * Tasks are functors (typically lambdas) that take a lace::worker& as their first parameter.
+ * - w.spawn(f) puts the functor f in the task deque and returns a handle
+ * - w.sync(h) obtains the result of the spawned task (if stolen) or executes it (if not stolen)
+ * - w.drop(h) is like sync, but does not execute the task if it was not stolen
+ * - w.call(f) directly executes f
+ * - lace::run(f, args...) executes f(w, args...) on a Lace worker (like RUN)
+ *
+ * Spawned tasks must be synced (or dropped) in the reverse order of spawning, as with SPAWN and SYNC.
+ * The functor (with its captured state) and its result are stored in the task itself,
+ * or in the overflow arena of the worker if they do not fit in LACE_TASKSIZE bytes.
+ * Move-only functors are supported. Tasks should not throw exceptions.
+ *
+ * Example:
+ *   int fib(lace::worker& w, int n) {
+ *       if (n < 2) return n;
+ *       auto h = w.spawn([n](lace::worker& w) { return fib(w, n-1); });
+ *       int k = fib(w, n-2);
+ *       return w.sync(h) + k;
+ *   }
+ *   int res = lace::run(fib, 42);
+ *
+ * lace::sort is a parallel stable sort for arrays of any trivially copyable type and comparator.
+ */
+
+namespace lace {
+
+class worker;
+
+/**
+ * The result type of running functor F on a worker.
+ */
+template<typename F>
+using result_of_t = decltype(std::declval<F&>()(std::declval<worker&>()));
+
+/**
+ * Handle of a spawned task, returned by worker::spawn.
+ */
+template<typename F>
+struct spawned
+{
+};
+
+namespace detail {
+
+/**
+ * The type used to store a result of type R (char for void).
+ */
+template<typename R> struct storage_of { typedef R type; };
+template<> struct storage_of<void> { typedef char type; };
+
+/**
+ * Store the result of running <f> in <res> (for the non-void case).
+ */
+template<typename R>
+struct invoker
+{
+    template<typename F>
+    static void run(F& f, worker& w, void *res) { new (res) R(f(w)); }
+
+    static R take(void *res)
+    {
+        R *r = static_cast<R*>(res);
+        R value(std::move(*r));
+        r->~R();
+        return value;
+    }
+
+    static void discard(void *res) { static_cast<R*>(res)->~R(); }
+};
+
+template<>
+struct invoker<void>
+{
+    template<typename F>
+    static void run(F& f, worker& w, void *) { f(w); }
+
+    static void take(void *) { }
+
+    static void discard(void *) { }
+};
+
+/**
+ * Check whether the functor F and its result fit in a Task (otherwise they are stored in the overflow arena).
+ */
+template<typename F>
+struct fits
+{
+    typedef typename storage_of<result_of_t<F>>::type RS;
+    static const size_t size = sizeof(F) > sizeof(RS) ? sizeof(F) : sizeof(RS);
+    static const bool value = size <= LACE_TASKSIZE;
+};
+
+/**
+ * Get the storage of the functor F and its result in task <t>.
+ */
+template<typename F>
+void *data_of(Task *t)
+{
+    if (fits<F>::value) return t->d;
+    return reinterpret_cast<lace_task_ptr*>(t)->data;
+}
+
+template<typename F>
+void wrap(WorkerP *w, Task *head, Task *t);
+
+template<typename F>
+struct run_data
+{
+    F *f;
+    void *res;
+};
+
+template<typename F>
+void run_wrap(WorkerP *w, Task *head, Task *t);
+
+} // namespace detail
+
+/**
+ * The context of a running Lace task: the current worker and the head of its task deque.
+ */
+class worker
+{
+public:
+    worker(WorkerP *w, Task *head) : w(w), head(head) { }
+
+    worker(const worker&) = delete;
+    worker& operator=(const worker&) = delete;
+
+    /**
+     * Spawn functor <f>, which is moved or copied into the task deque.
+     */
+    template<typename F>
+    spawned<typename std::decay<F>::type> spawn(F&& f)
+    {
+        typedef typename std::decay<F>::type FT;
+        typedef typename detail::storage_of<result_of_t<FT>>::type RS;
+        // the task deque and the overflow arena align the task data to LACE_COMMON_FIELD_SIZE
+        static_assert(alignof(FT) <= LACE_COMMON_FIELD_SIZE && alignof(RS) <= LACE_COMMON_FIELD_SIZE, "Lace task alignment is too large");
+
+        PR_COUNTTASK(w);
+        if (unlikely(head == w->end)) lace_grow_deque(w);
+        LACE_TRACE_EVENT(w, LACE_TRACE_SPAWN, head - w->dq);
+
+        Task *t = head;
+        t->f = &detail::wrap<FT>;
+        atomic_store_explicit(&t->thief, THIEF_TASK, memory_order_relaxed);
+        void *data = t->d;
+        if (!detail::fits<FT>::value) {
+            data = lace_arena_alloc(w, t, detail::fits<FT>::size);
+            reinterpret_cast<lace_task_ptr*>(t)->data = data;
+        }
+        new (data) FT(std::forward<F>(f));
+        lace_spawn_publish(w, head);
+        head++;
+        return spawned<FT>();
+    }
+
+    /**
+     * Sync the most recently spawned task and return its result.
+     */
+    template<typename F>
+    result_of_t<F> sync(spawned<F>)
+    {
+        typedef result_of_t<F> R;
+        head--;
+        if (lace_sync_stolen(w, head)) return detail::invoker<R>::take(detail::data_of<F>(head));
+        // not stolen: move the functor out of the deque (as tasks spawned by it reuse its slot) and execute it
+        F *fp = reinterpret_cast<F*>(detail::data_of<F>(head));
+        F f(std::move(*fp));
+        fp->~F();
+        worker ctx(w, head);
+        return f(ctx);
+    }
+
+    /**
+     * Sync the most recently spawned task, but do not execute it if it was not stolen.
+     */
+    template<typename F>
+    void drop(spawned<F>)
+    {
+        typedef result_of_t<F> R;
+        head--;
+        if (lace_sync_stolen(w, head)) detail::invoker<R>::discard(detail::data_of<F>(head));
+        else reinterpret_cast<F*>(detail::data_of<F>(head))->~F();
+    }
+
+    /**
+     * Directly execute functor <f>.
+     */
+    template<typename F>
+    result_of_t<F> call(F&& f)
+    {
+        return f(*this);
+    }
+
+    /**
+     * Get the current worker id.
+     */
+    unsigned int id() const { return w->worker; }
+
+    WorkerP *w;
+    Task *head;
+};
+
+namespace detail {
+
+/**
+ * Execute a stolen task: run the functor in the task and replace it by its result.
+ */
+template<typename F>
+void wrap(WorkerP *w, Task *head, Task *t)
+{
+    typedef result_of_t<F> R;
+    void *data = data_of<F>(t);
+    F *fp = reinterpret_cast<F*>(data);
+    F f(std::move(*fp));
+    fp->~F();
+    worker ctx(w, head);
+    invoker<R>::run(f, ctx, data);
+}
+
+/**
+ * Execute a task offered by lace::run: the functor and the result are stored by the caller.
+ */
+template<typename F>
+void run_wrap(WorkerP *w, Task *head, Task *t)
+{
+    typedef result_of_t<F> R;
+    run_data<F> *data = reinterpret_cast<run_data<F>*>(t->d);
+    worker ctx(w, head);
+    invoker<R>::run(*data->f, ctx, data->res);
+}
+
+} // namespace detail
+
+/**
+ * Execute f(w, args...) on a Lace worker and return the result.
+ * From outside Lace threads, this offers the task to the workers and waits until it is done (like RUN).
+ */
+template<typename F, typename... Args>
+auto run(F&& f, Args&&... args) -> decltype(f(std::declval<worker&>(), std::forward<Args>(args)...))
+{
+    typedef decltype(f(std::declval<worker&>(), std::forward<Args>(args)...)) R;
+    auto g = [&](worker& w) -> R { return f(w, std::forward<Args>(args)...); };
+    typedef decltype(g) G;
+
+    typedef typename detail::storage_of<R>::type RS;
+    typename std::aligned_storage<sizeof(RS), alignof(RS)>::type res;
+
+    Task t;
+    t.f = &detail::run_wrap<G>;
+    atomic_store_explicit(&t.thief, THIEF_TASK, memory_order_relaxed);
+    detail::run_data<G> *data = reinterpret_cast<detail::run_data<G>*>(t.d);
+    data->f = &g;
+    data->res = &res;
+    lace_run_task(&t);
+    return detail::invoker<R>::take(&res);
+}
+
+/**
+ * Scratch memory of lace::sort, which can be reused by the next calls.
+ */
+template<typename T>
+class sort_buffer
+{
+public:
+    sort_buffer() : data(nullptr), size(0) { }
+    ~sort_buffer() { std::free(data); }
+
+    sort_buffer(const sort_buffer&) = delete;
+    sort_buffer& operator=(const sort_buffer&) = delete;
+
+    /**
+     * Get room for <n> elements (the contents are not preserved).
+     */
+    T *get(size_t n)
+    {
+        if (n > size) {
+            std::free(data);
+            data = static_cast<T*>(std::malloc(n * sizeof(T)));
+            if (data == nullptr) throw std::bad_alloc();
+            size = n;
+        }
+        return data;
+    }
+
+private:
+    T *data;
+    size_t size;
+};
+
+namespace detail {
+
+/**
+ * The parallel stable mergesort of lace_sort, for elements of type T and comparator Cmp.
+ */
+template<typename T, typename Cmp>
+struct sorter
+{
+    static const size_t seq = 2048;     // sort and merge sequentially up to this many elements
+
+    // sorting networks are not stable, so they are only used where equal elements are identical: not for floating
+    // point, where -0.0 and 0.0 compare equal (and NaN is not ordered at all)
+    static const bool network = (std::is_integral<T>::value || std::is_pointer<T>::value) &&
+                                std::is_same<Cmp, std::less<T>>::value;
+
+    Cmp cmp;
+
+    static void cswap(T& a, T& b)
+    {
+        // branchless, so the compiler can use min/max or conditional moves
+        T x = a, y = b;
+        a = y < x ? y : x;
+        b = y < x ? x : y;
+    }
+
+    static void network8(T *x)
+    {
+        cswap(x[0], x[1]); cswap(x[2], x[3]); cswap(x[4], x[5]); cswap(x[6], x[7]);
+        cswap(x[0], x[2]); cswap(x[1], x[3]); cswap(x[4], x[6]); cswap(x[5], x[7]);
+        cswap(x[1], x[2]); cswap(x[5], x[6]); cswap(x[0], x[4]); cswap(x[3], x[7]);
+        cswap(x[1], x[5]); cswap(x[2], x[6]);
+        cswap(x[1], x[4]); cswap(x[3], x[6]);
+        cswap(x[2], x[4]); cswap(x[3], x[5]);
+        cswap(x[3], x[4]);
+    }
+
+    void insertion(T *low, size_t n)
+    {
+        for (size_t i=1; i<n; i++) {
+            T x = low[i];
+            size_t j = i;
+            for (; j > 0 && cmp(x, low[j-1]); j--) low[j] = low[j-1];
+            low[j] = x;
+        }
+    }
+
+    // merge the sorted ranges <a> and <b> into <dest>; equal elements of <a> come first
+    void seq_merge(const T *a, size_t na, const T *b, size_t nb, T *dest)
+    {
+        while (na > 0 && nb > 0) {
+            if (cmp(*b, *a)) { *dest++ = *b++; nb--; }
+            else { *dest++ = *a++; na--; }
+        }
+        while (na > 0) { *dest++ = *a++; na--; }
+        while (nb > 0) { *dest++ = *b++; nb--; }
+    }
+
+    void small_sort(T *low, size_t n, std::true_type)
+    {
+        if (n == 8) network8(low);
+        else insertion(low, n);
+    }
+
+    void small_sort(T *low, size_t n, std::false_type)
+    {
+        insertion(low, n);
+    }
+
+    void seq_sort(T *low, T *tmp, size_t n)
+    {
+        if (n <= 8) {
+            small_sort(low, n, std::integral_constant<bool, network>());
+            return;
+        }
+        size_t h = n / 2;
+        seq_sort(low, tmp, h);
+        seq_sort(low + h, tmp + h, n - h);
+        if (!cmp(low[h], low[h-1])) return; // already in order
+        seq_merge(low, h, low + h, n - h, tmp);
+        for (size_t i=0; i<n; i++) low[i] = tmp[i];
+    }
+
+    // the number of elements of <a> before <v> (or before or at <v> if <upper>)
+    size_t bound(const T *a, size_t n, const T& v, bool upper)
+    {
+        size_t lo = 0, hi = n;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (upper ? !cmp(v, a[mid]) : cmp(a[mid], v)) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    void merge(worker& w, const T *a, size_t na, const T *b, size_t nb, T *dest)
+    {
+        if (na + nb <= seq) {
+            seq_merge(a, na, b, nb, dest);
+            return;
+        }
+        size_t i, j;
+        if (na >= nb) {
+            i = na / 2;
+            j = bound(b, nb, a[i], false);
+        } else {
+            j = nb / 2;
+            i = bound(a, na, b[j], true);
+        }
+        auto h = w.spawn([this, a, i, b, j, dest](worker& w) { merge(w, a, i, b, j, dest); });
+        merge(w, a + i, na - i, b + j, nb - j, dest + i + j);
+        w.sync(h);
+    }
+
+    void sort(worker& w, T *low, T *tmp, size_t n)
+    {
+        if (n <= seq) {
+            seq_sort(low, tmp, n);
+            return;
+        }
+        size_t q = n / 4;
+        auto h1 = w.spawn([this, low, tmp, q](worker& w) { sort(w, low, tmp, q); });
+        auto h2 = w.spawn([this, low, tmp, q](worker& w) { sort(w, low + q, tmp + q, q); });
+        auto h3 = w.spawn([this, low, tmp, q](worker& w) { sort(w, low + 2 * q, tmp + 2 * q, q); });
+        sort(w, low + 3 * q, tmp + 3 * q, n - 3 * q);
+        w.sync(h3);
+        w.sync(h2);
+        w.sync(h1);
+        auto h = w.spawn([this, low, q, tmp](worker& w) { merge(w, low, q, low + q, q, tmp); });
+        merge(w, low + 2 * q, q, low + 3 * q, n - 3 * q, tmp + 2 * q);
+        w.sync(h);
+        merge(w, tmp, 2 * q, tmp + 2 * q, n - 2 * q, low);
+    }
+};
+
+} // namespace detail
+
+/**
+ * Sort [first, last) with <cmp> in parallel (see lace_sort), from inside a Lace task.
+ * The scratch memory is taken from <buf>, or allocated for this call only if <buf> is nullptr.
+ * For integers and pointers with std::less, the smallest ranges are sorted with a sorting network.
+ */
+template<typename T, typename Cmp = std::less<T>>
+void sort(worker& w, T *first, T *last, Cmp cmp = Cmp(), sort_buffer<T> *buf = nullptr)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "lace::sort requires trivially copyable elements");
+    size_t n = last - first;
+    if (n < 2) return;
+    sort_buffer<T> local;
+    T *tmp = (buf != nullptr ? buf : &local)->get(n);
+    detail::sorter<T, Cmp> s{cmp};
+    s.sort(w, first, tmp, n);
+}
+
+/**
+ * Sort [first, last) with <cmp> in parallel, on the Lace workers (like RUN).
+ */
+template<typename T, typename Cmp = std::less<T>>
+void sort(T *first, T *last, Cmp cmp = Cmp(), sort_buffer<T> *buf = nullptr)
+{
+    run([&](worker& w) { lace::sort(w, first, last, cmp, buf); });
+}
+
+} // namespace lace
+
+#endif
@@ -27,6 +27,7 @@ echo '
 #include <unistd.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h> /* for memcpy */
 #include <pthread.h> /* for pthread_t */
 
 #ifndef __cplusplus
@@ -43,6 +44,8 @@ echo '
 
 #include <lace_config.h>
 
+#include <time.h> /* for clock_gettime */
+
 #ifndef __LACE_H__
 #define __LACE_H__
 
@@ -61,6 +64,7 @@ extern "C" {
  *   set both parameters to 0 for reasonable defaults, using all available cores.
  *
  * After this, you can run tasks using the RUN(...)
+ * or, without blocking the calling thread, using RUN_ASYNC(...)
  *
  * Use lace_suspend and lace_resume to temporarily stop running, or lace_stop to completely stop Lace.
  */
@@ -71,8 +75,26 @@ extern "C" {
  * - Task contains a single Task
  */
 typedef struct _WorkerP WorkerP;
+typedef struct lace_pool lace_pool_t;
 typedef struct _Task Task;
 
+#if LACE_CANCEL
+/**
+ * A cancellation scope (see SCOPE_ENTER). Scopes are nested: cancelling a scope also cancels the scopes inside it.
+ */
+typedef struct _lace_scope {
+    _Atomic(int) cancelled;
+    struct _lace_scope *parent;
+} lace_scope_t;
+#endif
+
+/**
+ * A future holds a task that is run asynchronously (see RUN_ASYNC) and its result.
+ * A completion callback is called by the Lace worker that completed the task.
+ */
+typedef struct _lace_future lace_future_t;
+typedef void (*lace_future_cb)(lace_future_t *future, void *arg);
+
 /**
  * The macro LACE_TYPEDEF_CB(typedefname, taskname, parametertypes) defines
  * a Task for use as a callback function.
@@ -90,21 +112,125 @@ void lace_set_verbosity(int level);
  */
 void lace_set_stacksize(size_t stacksize);
 
+/**
+ * Set the size of the overflow arena of each Lace worker (default: 64 MB with mmap, otherwise 1 MB).
+ * The arena holds the data of spawned tasks that do not fit in LACE_TASKSIZE bytes.
+ * With mmap, the arena only reserves address space and memory is used on demand.
+ */
+void lace_set_arena_size(size_t arena_size);
+
+/**
+ * Set whether the task deques of Lace workers use huge pages, to reduce TLB misses with large deques (only with mmap).
+ * - LACE_HUGE_PAGES_NONE: use normal pages (default)
+ * - LACE_HUGE_PAGES_TRANSPARENT: advise the OS to use transparent huge pages (madvise with MADV_HUGEPAGE)
+ * - LACE_HUGE_PAGES_EXPLICIT: map explicit huge pages (MAP_HUGETLB) from the pool of the OS, or normal pages if that fails.
+ *   The deques are then reserved at once with the size given to lace_start, and they do not grow.
+ * Call this before lace_start.
+ */
+#define LACE_HUGE_PAGES_NONE        0
+#define LACE_HUGE_PAGES_TRANSPARENT 1
+#define LACE_HUGE_PAGES_EXPLICIT    2
+void lace_set_huge_pages(int policy);
+
+/**
+ * Enable or disable releasing memory when Lace is suspended (default: disabled, only with mmap).
+ * Suspended workers then give the unused part of their task deque and overflow arena back to the OS.
+ */
+void lace_set_release_memory(int enabled);
+
+/**
+ * Enable or disable warm restarts (default: disabled).
+ * With warm restart, lace_stop parks the worker threads and keeps their memory, and the next lace_start
+ * reuses them, also with a different number of workers, so restarting Lace takes microseconds instead of milliseconds.
+ * The memory is only reused if lace_start gets the same deque size (with mmap: if the reserved size is the same).
+ * Disabling warm restarts after lace_stop releases the parked threads and their memory.
+ */
+void lace_set_warm_restart(int enabled);
+
 /**
  * Get the program stack size of Lace worker threads.
  * If this returns 0, it uses the default.
  */
 size_t lace_get_stacksize(void);
 
+/**
+ * Set the idle policy of Lace workers.
+ * An idle worker first busy-waits for <spins> failed steal attempts, then yields the CPU
+ * for another <yields> failed steal attempts, and then parks until new work arrives.
+ * Set <spins> to 0 to never park, i.e., to let idle workers busy-wait.
+ */
+void lace_set_backoff(unsigned int spins, unsigned int yields);
+
+/**
+ * Set the victim selection policy of Lace workers (only when Lace uses hwloc).
+ * Idle workers first try to steal from SMT siblings, then from workers sharing the L3 cache,
+ * then from workers on the same NUMA node, and then from remote NUMA nodes.
+ * A worker moves on to the next level after <attempts> failed steal attempts and
+ * starts again with its SMT siblings after a successful steal. Default: 4.
+ * Set <attempts> to 0 to select victims without regard for the topology.
+ */
+void lace_set_steal_locality(unsigned int attempts);
+
+/**
+ * Enable or disable steal-half mode (default: disabled).
+ * In steal-half mode, a thief claims half of the shared tasks of the victim in one atomic operation,
+ * executes the oldest task and offers the others to other workers from its own deque.
+ */
+void lace_set_steal_half(int enabled);
+
 /**
  * Get the number of available PUs (hardware threads)
  */
 unsigned int lace_get_pu_count(void);
 
+/**
+ * Lace pools: each pool has its own workers, deques, queues of external tasks and barriers,
+ * so several libraries in one process can each run their own Lace, for example on disjoint cores.
+ * The methods below (lace_start, lace_stop, RUN, lace_workers, etc.) operate on the current pool:
+ * for a Lace worker its own pool, for other threads the pool selected with lace_set_pool.
+ * The default pool is used when no pool is selected. The other settings (lace_set_*) are shared by all pools,
+ * except lace_set_warm_restart and lace_set_first_core, which apply to the current pool.
+ */
+
+/**
+ * Create a new (stopped) Lace pool.
+ */
+lace_pool_t *lace_pool_create(void);
+
+/**
+ * Destroy a stopped Lace pool. The default pool cannot be destroyed.
+ */
+void lace_pool_destroy(lace_pool_t *pool);
+
+/**
+ * Get the default Lace pool.
+ */
+lace_pool_t *lace_default_pool(void);
+
+/**
+ * Select the pool for the Lace methods called by the current thread (NULL selects the default pool).
+ * Returns the previously selected pool. Call this method from outside Lace threads.
+ */
+lace_pool_t *lace_set_pool(lace_pool_t *pool);
+
+/**
+ * Get the current pool of the calling thread.
+ */
+lace_pool_t *lace_get_pool(void);
+
+/**
+ * Set the first core of the workers of the current pool (default: 0); worker i is pinned to core <core>+i.
+ * Give pools disjoint ranges of cores, so their workers do not compete for the same cores (only with hwloc).
+ * Call this before lace_start.
+ */
+void lace_set_first_core(unsigned int core);
+
 /**
  * Start Lace with <n_workers> workers and a a task deque size of <dqsize> per worker.
  * If <n_workers> is set to 0, automatically detects available cores.
  * If <dqsize> is est to 0, uses a reasonable default value.
+ * When Lace uses mmap, <dqsize> is the initial size and each deque grows on demand;
+ * only the part of the deque that is actually used takes memory.
  */
 void lace_start(unsigned int n_workers, size_t dqsize);
 
@@ -126,6 +252,169 @@ void lace_resume(void);
  */
 void lace_stop(void);
 
+/**
+ * Statistics of a Lace worker, see lace_stats_snapshot.
+ */
+typedef struct {
+    uint64_t steals;            // tasks stolen from other workers
+    uint64_t failed_steals;     // steal attempts that found no work or lost the race with another thief
+    uint64_t leaps;             // tasks stolen from a thief while waiting for its result (leapfrogging)
+    uint64_t splits;            // moves of the split point between the private and the shared part of the deque
+    uint64_t busy_ns;           // time spent executing stolen and external tasks, in nanoseconds
+    uint64_t idle_ns;           // time spent looking for work (including while parked), in nanoseconds
+} lace_stats_t;
+
+/**
+ * Copy the statistics of the first <n> workers to <stats> and return the number of workers.
+ * The statistics are always counted (also without the LACE_COUNT_* options), start at 0 in lace_start,
+ * and can be read from any thread while Lace is running. The busy time of a task is added when it completes.
+ * The first call may wait until 10 ms after the first lace_start, to measure the rate of the clock of the workers.
+ */
+unsigned int lace_stats_snapshot(lace_stats_t *stats, unsigned int n);
+
+/**
+ * Worker-local storage: every worker has its own copy of each registered slot.
+ * The slots are in the memory block of the worker (on its NUMA node, after the worker data and before the deque),
+ * each slot starts on a new cache line, and tasks reach them in O(1) via LACE_WLS.
+ * The slots are zero-initialized when a worker starts.
+ */
+typedef size_t lace_wls_t;
+
+/**
+ * Register a worker-local storage slot of <size> bytes and return it.
+ * Call this before lace_start; the slots apply to all pools that are started afterwards.
+ */
+lace_wls_t lace_wls_register(size_t size);
+
+/**
+ * Get the copy of <slot> of worker <worker> of the current pool, e.g. to combine the copies after RUN,
+ * or NULL if the worker did not start yet.
+ */
+void *lace_wls_get(unsigned int worker, lace_wls_t slot);
+
+/**
+ * A reducer is a worker-local storage slot (the view of each worker) with an identity and an associative combine
+ * function. Tasks update the view of their worker without atomics (see LACE_REDUCER_VIEW), and lace_reducer_reduce
+ * combines the views of all workers after RUN returns. Unlike a Cilk reducer, a view collects the updates of all
+ * tasks that ran on its worker, in no particular order, so combine must be associative and commutative: the result
+ * does not follow the serial order of the program.
+ */
+typedef struct lace_reducer {
+    lace_wls_t slot;
+    size_t size;
+    void (*identity)(void *view);               // set <view> to the identity
+    void (*combine)(void *left, void *right);   // left = left (+) right
+    struct lace_reducer *next;                  // next registered reducer
+} lace_reducer_t;
+
+/**
+ * Register the reducer <r> with views of <size> bytes.
+ * Call this before lace_start. The views are set to the identity when the workers start.
+ */
+void lace_reducer_init(lace_reducer_t *r, size_t size, void (*identity)(void*), void (*combine)(void*, void*));
+
+/**
+ * Register a reducer for the sum, minimum or maximum of int64_t values, or the sum of double values.
+ * Floating-point addition is not associative, so the rounding of the double sum can vary between runs.
+ */
+void lace_reducer_init_sum(lace_reducer_t *r);
+void lace_reducer_init_min(lace_reducer_t *r);
+void lace_reducer_init_max(lace_reducer_t *r);
+void lace_reducer_init_sum_double(lace_reducer_t *r);
+
+/**
+ * A list of intrusive nodes (see lace_list_append), for the list reducer.
+ */
+typedef struct lace_list_node {
+    struct lace_list_node *next;
+} lace_list_node_t;
+
+typedef struct {
+    lace_list_node_t *head, *tail;
+} lace_list_t;
+
+static inline void __attribute__((unused))
+lace_list_append(lace_list_t *list, lace_list_node_t *node)
+{
+    node->next = NULL;
+    if (list->tail != NULL) list->tail->next = node;
+    else list->head = node;
+    list->tail = node;
+}
+
+/**
+ * Register a reducer that concatenates lace_list_t lists. The result contains every appended node once, but
+ * the order of the nodes is unspecified: nodes appended by different tasks can appear in any order.
+ */
+void lace_reducer_init_list(lace_reducer_t *r);
+
+/**
+ * Combine the views of all workers of the current pool into <result> and reset the views to the identity.
+ * Call this from outside Lace threads when no tasks use the reducer, e.g. after RUN.
+ */
+void lace_reducer_reduce(lace_reducer_t *r, void *result);
+
+/**
+ * Allocate <size> bytes from the slabs of the current worker (on its NUMA node when workers are pinned).
+ * Objects of at most LACE_SLAB_MAX bytes come from per-worker free lists of a size class without locks;
+ * larger objects and allocations outside Lace workers use the system allocator.
+ * An object can be freed by any thread with lace_free. Objects freed by another thread than their owner
+ * are pushed on a list of the owner, which takes the whole list at once when it runs out of objects.
+ * Free all objects before the pool is released (lace_stop without warm restart).
+ */
+void *lace_malloc(size_t size);
+void lace_free(void *ptr);
+
+/**
+ * Comparison function for lace_sort: negative if <a> comes before <b>, 0 if equal, positive otherwise.
+ */
+typedef int (*lace_sort_cmp)(const void *a, const void *b, void *arg);
+
+/**
+ * Scratch memory of lace_sort, which can be reused by the next calls (initialize with { NULL, 0 }).
+ */
+typedef struct lace_sort_buffer {
+    void *data;
+    size_t size;
+} lace_sort_buffer_t;
+
+/**
+ * Sort the <n> elements of <size> bytes at <base> with <cmp> (which gets <arg>), in parallel.
+ * The sort is stable; it is the mergesort of the cilksort benchmark: the four quarters are sorted in parallel
+ * and merged by splitting at the median of the two ranges, so merges are parallel as well.
+ * The sort needs <n> * <size> bytes of scratch memory, taken from <buf> (grown if needed) or, if <buf> is NULL,
+ * allocated for this call only. Free <buf> with lace_sort_buffer_free.
+ * This can be used both inside and outside Lace threads. See lace.hpp for a faster C++ version.
+ */
+void lace_sort(void *base, size_t n, size_t size, lace_sort_cmp cmp, void *arg, lace_sort_buffer_t *buf);
+void lace_sort_buffer_free(lace_sort_buffer_t *buf);
+
+/**
+ * Dense matrix multiplication C = alpha * A * B + beta * C, in parallel (as BLAS gemm, for row-major matrices
+ * that are not transposed). A is <m> x <k> with row stride <lda>, B is <k> x <n> with row stride <ldb>, and
+ * C is <m> x <n> with row stride <ldc>. C is divided recursively in halves (Z-order) with SPAWN and SYNC; each leaf
+ * packs panels of A and B on the allocation stack of its worker, such that a panel of B fits in L1 and a panel
+ * of A in L2, and computes small tiles of C in registers. If <beta> is 0, C is not read.
+ * This can be used both inside and outside Lace threads.
+ */
+void lace_sgemm(size_t m, size_t n, size_t k, float alpha, const float *A, size_t lda, const float *B, size_t ldb, float beta, float *C, size_t ldc);
+void lace_dgemm(size_t m, size_t n, size_t k, double alpha, const double *A, size_t lda, const double *B, size_t ldb, double beta, double *C, size_t ldc);
+
+/**
+ * Set the number of entries of the operation cache (default: 0, no cache), rounded down to a power of 2.
+ * The cache is a fixed-size, lock-free hash table that is shared by all workers of a pool, for CALL_MEMO and
+ * LACE_CACHE_GET/LACE_CACHE_PUT. Entries are 64 bytes (one cache line) and inserts are lossy: an insert simply
+ * overwrites the entry of its hash bucket, and is skipped if another worker is writing the same entry.
+ * The cache is allocated and cleared by lace_start, so call this before lace_start.
+ */
+void lace_set_cache_size(size_t entries);
+
+/**
+ * Clear the operation cache, in parallel by all workers (with TOGETHER).
+ * This can be used both inside and outside Lace threads, also while other tasks use the cache.
+ */
+void lace_cache_clear(void);
+
 /**
  * Steal a random task.
  * Only use this from inside a Lace task.
@@ -144,6 +433,21 @@ void lace_barrier(void);
  */
 unsigned int lace_workers(void);
 
+/**
+ * Set the number of active workers to <k> (between 1 and lace_workers()), without restarting Lace.
+ * Workers with an id of <k> or higher retire: they finish their current work and then sleep,
+ * and the active workers no longer steal from them, until they are activated again.
+ * Retired workers still wake up to take part in TOGETHER, NEWFRAME and lace_barrier, so that
+ * all workers are initialized when they are activated again.
+ * Call this method from outside Lace threads. By default, all workers are active.
+ */
+void lace_set_active_workers(unsigned int k);
+
+/**
+ * Retrieve the number of active Lace workers (see lace_set_active_workers)
+ */
+unsigned int lace_active_workers(void);
+
 /**
  * Retrieve whether we are running in a Lace worker. Returns 1 if this is the case, 0 otherwise.
  */
@@ -174,6 +478,35 @@ void lace_run_task(Task *task);
  */
 void lace_run_task_exclusive(Task *task);
 
+/**
+ * Helper function to call from outside Lace threads.
+ * This helper function is used by the _RUNHI methods for the RUNHI() macro.
+ */
+void lace_run_task_high(Task *task);
+
+/**
+ * Helper function to call from outside Lace threads.
+ * This helper function is used by the _RUN_ASYNC methods for the RUN_ASYNC() macro.
+ */
+void lace_run_task_async(lace_future_t *future, lace_future_cb cb, void *arg);
+
+/**
+ * Helper function to offer a task to the Lace workers after its prerequisites are completed.
+ * This helper function is used by the _DATAFLOW methods for the DATAFLOW() macro.
+ */
+void lace_run_task_after(lace_future_t *future, lace_future_t **deps, unsigned int n_deps);
+
+/**
+ * Check if the task of the given future is completed. Returns 1 if this is the case, 0 otherwise.
+ */
+int lace_future_poll(lace_future_t *future);
+
+/**
+ * Wait until the task of the given future is completed.
+ * Outside Lace threads, this blocks the calling thread; Lace workers instead steal tasks while waiting.
+ */
+void lace_future_wait(lace_future_t *future);
+
 /**
  * Helper function to start a new task execution (task frame) on a given task.
  * This helper function is used by the _NEWFRAME methods for the NEWFRAME() macro
@@ -214,17 +547,67 @@ void lace_run_together(Task *task);
  */
 #define SPAWN(f, ...)     ( WRAP(f##_SPAWN, ##__VA_ARGS__), __lace_dq_head++ )
 
+/**
+ * Spawn a task, or run it right away when no other worker wants work (see lace_elide); SYNC then only returns
+ * the result. Only for tasks defined with TASK_ELIDABLE_n or VOID_TASK_ELIDABLE_n, whose SYNC checks for elided
+ * tasks, so the SYNC of other tasks does not pay for that check. Using it for other tasks is a compile error.
+ */
+#define SPAWN_ELIDABLE(f, ...) ( WRAP(f##_SPAWN_ELIDABLE, ##__VA_ARGS__), __lace_dq_head++ )
+
 /**
  * Directly execute a task from inside a Lace thread.
  */
 #define CALL(f, ...)      ( WRAP(f##_CALL, ##__VA_ARGS__) )
 
+/**
+ * Directly execute a task, or return its result from the operation cache if the same task was called
+ * with the same arguments before (see lace_set_cache_size). The task must be deterministic: the cache is
+ * keyed on the task and the bytes of its arguments, so pointer arguments are compared, not what they point to.
+ * Tasks whose arguments take more than 32 bytes or whose result takes more than 8 bytes are always executed.
+ */
+#define CALL_MEMO(f, ...) ( WRAP(f##_CALL_MEMO, ##__VA_ARGS__) )
+
 /**
  * Directly execute a task from outside Lace threads.
  */
 #define RUN(f, ...)    ( f##_RUN ( __VA_ARGS__ ) )
 #define RUNEX(f, ...)    ( f##_RUNEX ( __VA_ARGS__ ) )
 
+/**
+ * Directly execute a task from outside Lace threads, with high priority.
+ * Workers take high-priority tasks before any other work: idle workers, and workers that wait in SYNC
+ * for a stolen task, check for high-priority tasks before they steal from other workers.
+ * Long tasks can use YIELD_NEWFRAME() to let their worker run pending high-priority tasks.
+ * Inside Lace threads, the task is executed immediately.
+ */
+#define RUNHI(f, ...)    ( f##_RUNHI ( __VA_ARGS__ ) )
+
+/**
+ * Offer a task to the Lace workers from outside Lace threads, without waiting for it.
+ * The task, its arguments and its result are stored in the future, which must remain valid until the task is completed.
+ * RUN_ASYNC_CB also sets a callback that the worker calls with the future and <arg> after running the task,
+ * just before the future is completed, so the callback can use ASYNC_RESULT and the submitter can free the future
+ * as soon as lace_future_poll or lace_future_wait reports completion.
+ * Obtain the result with ASYNC_RESULT after lace_future_poll or lace_future_wait reports completion.
+ * Unlike RUN, RUN_ASYNC does not resume suspended workers; tasks are only run while Lace is not suspended.
+ * Inside Lace threads, the task is executed immediately.
+ * Tasks whose data exceeds LACE_TASKSIZE are rejected at compile time with GCC and Clang, and abort at runtime otherwise.
+ */
+#define RUN_ASYNC(f, fut, ...)            ( f##_RUN_ASYNC ( fut, NULL, NULL, ##__VA_ARGS__ ) )
+#define RUN_ASYNC_CB(f, fut, cb, arg, ...)    ( f##_RUN_ASYNC ( fut, cb, arg, ##__VA_ARGS__ ) )
+#define ASYNC_RESULT(f, fut)    ( f##_ASYNC_RESULT ( fut ) )
+
+/**
+ * Offer a task to the Lace workers when the <n_deps> futures in the array <deps> are completed (dataflow).
+ * The prerequisites are futures of RUN_ASYNC or of other DATAFLOW tasks, and must remain valid until this call returns.
+ * The future holds a count of the prerequisites that are not completed yet; the prerequisite that completes last
+ * puts the task in the queue of external tasks of the pool that called DATAFLOW, where any of its workers can take it,
+ * even when the prerequisite is completed in another pool or by the I/O thread. Workers never block on a prerequisite,
+ * so DAGs such as wavefronts and pipelines run without barriers. Obtain the result with ASYNC_RESULT.
+ * This can be used both inside and outside Lace threads. Unlike RUN_ASYNC, dataflow tasks do not wait for RUNEX.
+ */
+#define DATAFLOW(f, fut, deps, n_deps, ...)    ( f##_DATAFLOW ( fut, deps, n_deps, ##__VA_ARGS__ ) )
+
 /**
  * Signal all workers to interrupt their current tasks and instead perform (a personal copy of) the given task.
  */
@@ -240,6 +623,24 @@ void lace_run_together(Task *task);
  */
 #define STEAL_RANDOM()    ( CALL(lace_steal_random) )
 
+/**
+ * Parallel loops over a range of indices.
+ * LACE_FOR_n(NAME, I, ...) { body } defines a task NAME that runs the body for each index I (a size_t) in
+ * a range [from, to), with n extra parameters given as for TASK_n. Run the loop like any task, e.g.,
+ * CALL(NAME, from, to, ...) or RUN(NAME, from, to, ...).
+ * LACE_REDUCE_n(RTYPE, NAME, I, IDENTITY, COMBINE, ...) { body } defines a task NAME whose body returns
+ * a value of type RTYPE for index I; the results are combined with the associative COMBINE(a, b).
+ * The loops split their range lazily: only when a thief is asking for work or when all tasks of the worker
+ * have been stolen, the loop spawns the second half of its remaining range. Without idle workers, the loop
+ * thus runs almost sequentially, without choosing a grain size.
+ *
+ * LACE_WF_FOR_n and LACE_WF_REDUCE_n (experimental) define the same loops, but run them work-first:
+ * before each iteration, the loop offers the rest of its range (its continuation) as one task, like a loop
+ * of SPAWNs in Cilk where thieves steal the continuation of the parent. A thief that steals the continuation
+ * runs the rest of the loop in the same way. Nested loops thus use one deque slot per level of recursion,
+ * instead of one slot per spawned child, at the cost of one spawn and sync per iteration.
+ */
+
 /**
  * Get the current worker id.
  */
@@ -250,6 +651,32 @@ void lace_run_together(Task *task);
  */
 #define LACE_WORKER_PU    ( __lace_worker->pu )
 
+/**
+ * Get a pointer to the copy of worker-local storage slot <slot> of the current worker (see lace_wls_register).
+ */
+#define LACE_WLS(type, slot)    ( (type*)(__lace_worker->wls + (slot)) )
+
+/**
+ * Get a pointer to the view of reducer <r> of the current worker (see lace_reducer_init).
+ */
+#define LACE_REDUCER_VIEW(type, r)    LACE_WLS(type, (r)->slot)
+
+/**
+ * Allocate memory for the current task on the allocation stack of the worker, like alloca, but not on the
+ * program stack, which stays small for deep recursion. LACE_MARK gets the top of the stack and LACE_RELEASE
+ * releases everything allocated since, e.g. after the tasks that use the memory are synced:
+ *   lace_mark_t m = LACE_MARK();
+ *   Node *child = LACE_ALLOC(sizeof(Node));
+ *   SPAWN(search, child); ... SYNC(search);
+ *   LACE_RELEASE(m);
+ * Tasks on a worker are nested, so the allocations form a stack; each task releases what it allocated.
+ * The stack has the size set by lace_set_arena_size and is allocated by the worker on first use.
+ */
+typedef char *lace_mark_t;
+#define LACE_MARK()         ( __lace_worker->stack_top )
+#define LACE_ALLOC(size)    ( lace_stack_alloc(__lace_worker, (size)) )
+#define LACE_RELEASE(m)     ( __lace_worker->stack_top = (m) )
+
 /**
  * Initialize local variables __lace_worker and __lace_dq_head which are required for most Lace functionality.
  * This only works inside a Lace thread.
@@ -257,10 +684,42 @@ void lace_run_together(Task *task);
 #define LACE_VARS WorkerP * __attribute__((unused)) __lace_worker = lace_get_worker(); Task * __attribute__((unused)) __lace_dq_head = lace_get_head(__lace_worker);
 
 /**
- * Check if current tasks must be interrupted, and if so, interrupt.
+ * Interrupt the current tasks to join the new frame of NEWFRAME or TOGETHER.
  */
 void lace_yield(WorkerP *__lace_worker, Task *__lace_dq_head);
-#define YIELD_NEWFRAME() { if (unlikely(atomic_load_explicit(&lace_newframe.t, memory_order_relaxed) != NULL)) lace_yield(__lace_worker, __lace_dq_head); }
+int lace_steal_high(WorkerP *__lace_worker, Task *__lace_dq_head);
+
+/**
+ * Interrupt flags of a worker, set by the thread that starts a new frame (NEWFRAME or TOGETHER)
+ * or submits a high-priority task (RUNHI). Each worker only polls its own flags.
+ */
+#define LACE_INTERRUPT_NEWFRAME 1
+#define LACE_INTERRUPT_HIGH     2
+
+/**
+ * Handle the pending interrupts of the worker: run pending high-priority tasks and join a new frame.
+ * Long tasks can use YIELD_NEWFRAME() to check for interrupts, which only reads the data of the worker itself.
+ */
+void lace_interrupted(WorkerP *__lace_worker, Task *__lace_dq_head);
+#define YIELD_NEWFRAME() { \
+    if (unlikely(atomic_load_explicit(&__lace_worker->interrupt, memory_order_relaxed) != 0)) lace_interrupted(__lace_worker, __lace_dq_head); }
+
+#if LACE_CANCEL
+/**
+ * Cancellation scopes, for speculative work such as search, where the first solution makes the other tasks useless.
+ * - SCOPE_ENTER(s) starts a scope <s> (a lace_scope_t, declared as a local variable of the current task)
+ * - SCOPE_LEAVE() ends the innermost scope, after all tasks spawned in it are synced
+ * - CANCEL() cancels the innermost scope, and lace_cancel(s) cancels scope <s> (from any thread)
+ * - CANCELLED() is true if the innermost scope or an enclosing scope is cancelled
+ * Tasks run in the scope in which they were spawned, also when they are stolen.
+ * Cancelled tasks still run, but they should check CANCELLED() and return early; their results are up to the task.
+ * Thieves do not steal tasks of a cancelled scope, so these tasks return early to their owner instead.
+ */
+#define SCOPE_ENTER(s) lace_scope_enter(__lace_worker, s)
+#define SCOPE_LEAVE() lace_scope_leave(__lace_worker)
+#define CANCEL() lace_cancel(__lace_worker->scope)
+#define CANCELLED() lace_cancelled(__lace_worker)
+#endif
 
 /**
  * True if the given task is stolen, False otherwise.
@@ -284,6 +743,12 @@ void lace_yield(WorkerP *__lace_worker, Task *__lace_dq_head);
 
 /* Some flags that influence Lace behavior */
 
+/* Objects up to LACE_SLAB_MAX bytes are allocated by lace_malloc in LACE_SLAB_CLASSES size classes of
+   16, 32, ..., LACE_SLAB_MAX bytes, from slabs of LACE_SLAB_SIZE bytes */
+#define LACE_SLAB_SIZE 65536
+#define LACE_SLAB_CLASSES 8
+#define LACE_SLAB_MAX (16 << (LACE_SLAB_CLASSES - 1))
+
 #ifndef LACE_LEAP_RANDOM /* Use random leaping when leapfrogging fails */
 #define LACE_LEAP_RANDOM 1
 #endif
@@ -308,11 +773,15 @@ void lace_yield(WorkerP *__lace_worker, Task *__lace_dq_head);
 #define ROUND(x,b) ( (x) + PAD( (x), (b) ) )
 
 /* The size is in bytes. Note that this is without the extra overhead from Lace.
-   The value must be greater than or equal to the maximum size of your tasks.
-   The task size is the maximum of the size of the result or of the sum of the parameter sizes. */
+   The task size is the maximum of the size of the result or of the sum of the parameter sizes.
+   Tasks larger than this value store their data in the overflow arena of the spawning worker. */
 #ifndef LACE_TASKSIZE
+#if LACE_CANCEL
+#define LACE_TASKSIZE ('$k'-1)*P_SZ /* keep tasks at one cacheline, with the extra scope field */
+#else
 #define LACE_TASKSIZE ('$k')*P_SZ
 #endif
+#endif
 
 /* Compiler specific branch prediction optimization */
 #ifndef likely
@@ -323,14 +792,40 @@ void lace_yield(WorkerP *__lace_worker, Task *__lace_dq_head);
 #define unlikely(x)     __builtin_expect((x),0)
 #endif
 
-#if LACE_PIE_TIMES
-/* High resolution timer */
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h> /* for __rdtsc */
+#endif
+
+/**
+ * High resolution timer, in ticks of the cycle counter of the CPU: the time stamp counter on x86
+ * and the virtual counter (cntvct_el0) on aarch64. Other platforms use clock_gettime, with ticks of 1 ns.
+ * The worker statistics use it in the steal loop, as it is much cheaper than clock_gettime.
+ * With LACE_PIE_TIMES, use lace_ticks_to_ns to convert ticks to nanoseconds; the tick rate is calibrated by lace_start.
+ */
 static inline uint64_t gethrtime()
 {
+#if defined(__x86_64__) || defined(__i386__)
     uint32_t hi, lo;
     asm volatile ("rdtsc" : "=a"(lo), "=d"(hi) :: "memory");
     return (uint64_t)hi<<32 | lo;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t t;
+    asm volatile ("isb; mrs %0, cntvct_el0" : "=r"(t) :: "memory");
+    return t;
+#else
+    struct timespec ts_now;
+    clock_gettime(CLOCK_MONOTONIC, &ts_now);
+    return (uint64_t)ts_now.tv_sec * 1000000000ULL + ts_now.tv_nsec;
+#endif
 }
+
+#if LACE_PIE_TIMES
+/**
+ * Convert a number of ticks of gethrtime to nanoseconds (after lace_start).
+ */
+double lace_ticks_to_ns(uint64_t ticks);
 #endif
 
 #if LACE_COUNT_EVENTS
@@ -338,6 +833,68 @@ void lace_count_reset();
 void lace_count_report_file(FILE *file);
 #endif
 
+#if LACE_TRACE
+/**
+ * Set the number of trace events that each worker keeps (default: 65536).
+ * The value is rounded up to a power of 2. Call this before lace_start.
+ */
+void lace_set_trace_size(size_t events);
+
+/**
+ * Write the most recent trace events of all workers to <file> in the Chrome trace event format,
+ * which can be opened with chrome://tracing or https://ui.perfetto.dev.
+ * Call this while Lace is running or suspended, i.e., before lace_stop. Events that workers
+ * overwrite while the trace is being written are skipped.
+ */
+void lace_trace_dump(FILE *file);
+#endif
+
+#if LACE_PROFILE
+/* The number of task types that are profiled; further task types are ignored */
+#ifndef LACE_PROFILE_TYPES
+#define LACE_PROFILE_TYPES 4096
+#endif
+
+/**
+ * A task type in the profile. TASK_IMPL_n defines NAME##_TYPE for each task, which registers itself before main.
+ */
+typedef struct lace_task_type {
+    const char *name;
+    unsigned int id;
+    struct lace_task_type *next;
+} lace_task_type_t;
+
+/**
+ * Profile counters of a task type.
+ * <spawns> counts SPAWNs, <inlined> the spawned tasks that the SYNC ran itself, <stolen> the spawned tasks
+ * that were stolen, and <runs> all executions (also by CALL, by thieves and by RUN).
+ * <ns> is the time spent in the task, excluding the subtasks that it called or synced, and excluding the time
+ * that it waited for stolen subtasks; <ns> divided by <runs> is the grain size.
+ */
+typedef struct {
+    uint64_t spawns, inlined, stolen, runs, ns;
+} lace_profile_ctr;
+
+void lace_profile_register(lace_task_type_t *type);
+
+/**
+ * Sum the profile counters of task type <type> (e.g. &fib_TYPE) over all workers.
+ * Call this when the workers are idle, for example between two RUNs, or after lace_suspend.
+ */
+void lace_profile_get(const lace_task_type_t *type, lace_profile_ctr *ctr);
+
+/**
+ * Write the profile of all task types that ran to <file>, sorted by time, with the average grain size.
+ * Call this when the workers are idle. lace_stop writes the profile to stdout.
+ */
+void lace_profile_report(FILE *file);
+
+/**
+ * Reset the profile counters of all workers. Call this when the workers are idle.
+ */
+void lace_profile_reset(void);
+#endif
+
 #if LACE_COUNT_TASKS
 #define PR_COUNTTASK(s) PR_INC(s,CTR_tasks)
 #else
@@ -347,13 +904,13 @@ void lace_count_report_file(FILE *file);
 #if LACE_COUNT_STEALS
 #define PR_COUNTSTEALS(s,i) PR_INC(s,i)
 #else
-#define PR_COUNTSTEALS(s,i) /* Empty */
+#define PR_COUNTSTEALS(s,i) ((void)0)
 #endif
 
 #if LACE_COUNT_SPLITS
 #define PR_COUNTSPLITS(s,i) PR_INC(s,i)
 #else
-#define PR_COUNTSPLITS(s,i) /* Empty */
+#define PR_COUNTSPLITS(s,i) ((void)0)
 #endif
 
 #if LACE_COUNT_EVENTS
@@ -374,6 +931,10 @@ typedef enum {
     CTR_leaps,       /* Number of succesful leaps */
     CTR_steal_busy,  /* Number of steal busies */
     CTR_leap_busy,   /* Number of leap busies */
+    CTR_level_tries, /* Number of steal attempts per victim level (4 counters) */
+    CTR_level_tries_end = CTR_level_tries+3,
+    CTR_level_steals,/* Number of succesful steals per victim level (4 counters) */
+    CTR_level_steals_end = CTR_level_steals+3,
 #endif
 #ifdef LACE_COUNT_SPLITS
     CTR_split_grow,  /* Number of split right */
@@ -401,9 +962,16 @@ typedef enum {
 #define THIEF_TASK      ((struct _Worker*)0x1)
 #define THIEF_COMPLETED ((struct _Worker*)0x2)
 
+#if LACE_CANCEL
+#define TASK_SCOPE_FIELD _Atomic(struct _lace_scope*) scope;
+#else
+#define TASK_SCOPE_FIELD
+#endif
+
 #define TASK_COMMON_FIELDS(type)                               \
     void (*f)(struct _WorkerP *, struct _Task *, struct type *);  \
-    _Atomic(struct _Worker*) thief;
+    _Atomic(struct _Worker*) thief;                            \
+    TASK_SCOPE_FIELD
 
 struct __lace_common_fields_only { TASK_COMMON_FIELDS(_Task) };
 #define LACE_COMMON_FIELD_SIZE sizeof(struct __lace_common_fields_only)
@@ -419,6 +987,65 @@ typedef struct _Task {
 
 static_assert((sizeof(Task) % LINE_SIZE) == 0, "Task size should be a multiple of LINE_SIZE");
 
+/**
+ * The fields of a future are managed by Lace; use lace_future_poll, lace_future_wait and ASYNC_RESULT.
+ * The field <state> is 0 while pending, 1 when completed, 2 when a thread sleeps until completion.
+ * The futures that wait for this future (see DATAFLOW) are in the list <succ>, which is LACE_SUCC_DONE after completion.
+ */
+struct _lace_future {
+    Task t;                     // the task, its arguments and its result
+    Task *task;                 // the task to run (&t, except for RUN and RUNEX)
+    _Atomic(uint32_t) state;
+    uint32_t async;             // LACE_ASYNC_RUN for RUN_ASYNC, LACE_ASYNC_DATAFLOW for DATAFLOW
+    lace_future_cb cb;          // completion callback (or NULL)
+    void *arg;                  // argument of the completion callback
+    _Atomic(struct _lace_succ *) succ; // futures that wait for this future
+    _Atomic(uint32_t) deps;     // number of prerequisites that are not completed (plus 1 while adding them)
+    lace_pool_t *pool;          // the pool that runs a DATAFLOW task
+};
+
+#define LACE_ASYNC_RUN 1
+#define LACE_ASYNC_DATAFLOW 2
+#define LACE_SUCC_DONE ((struct _lace_succ *)1)
+
+/**
+ * Waiting for file descriptors and timers without blocking the worker.
+ *
+ * A lace_io_t is a future that is completed when the file descriptor <fd> is ready for <events> (as in poll,
+ * e.g. POLLIN or POLLOUT), or when <timeout_ns> nanoseconds have passed (a timer if <fd> is -1; no timeout if
+ * <timeout_ns> is negative). One Lace thread waits for all of them with poll, so the workers do not block.
+ * Then <revents> holds the events that occurred, which is 0 after a timeout.
+ * Use the future <fut> as a DATAFLOW prerequisite to continue with a task when the I/O is ready,
+ * or wait for it with lace_future_wait (see lace_io_wait).
+ */
+typedef struct lace_io {
+    lace_future_t fut;          // completed when ready
+    int fd;
+    short events;
+    short revents;
+    int slot;                   // managed by Lace
+    uint64_t deadline;          // managed by Lace
+    struct lace_io *next;       // managed by Lace
+} lace_io_t;
+
+/**
+ * Start waiting for <fd> (or a timer); <io> must remain valid until its future is completed.
+ */
+void lace_io_submit(lace_io_t *io, int fd, short events, int64_t timeout_ns);
+
+/**
+ * Wait for <fd> (or a timer) and return the events that occurred, or 0 after a timeout.
+ * Inside a Lace thread, the worker steals other tasks while waiting, like lace_future_wait; as the
+ * waiting task stays on the stack of the worker, it continues once the stolen task is completed.
+ * Use this instead of blocking system calls such as read or nanosleep in tasks.
+ */
+short lace_io_wait(int fd, short events, int64_t timeout_ns);
+
+/**
+ * Wait for <ns> nanoseconds without blocking the worker (see lace_io_wait).
+ */
+void lace_sleep(int64_t ns);
+
 /* hopefully packed? */
 typedef union {
     struct {
@@ -439,13 +1066,51 @@ typedef union {
 typedef struct _Worker {
     Task *dq;
     TailSplit ts;
+    uint16_t worker;
     uint8_t allstolen;
 
-    char pad1[PAD(P_SZ+sizeof(TailSplit)+1, LINE_SIZE)];
+    char pad1[PAD(P_SZ+sizeof(TailSplit)+3, LINE_SIZE)];
 
     uint8_t movesplit;
 } Worker;
 
+#if LACE_TRACE
+/**
+ * The kinds of events in the trace of a worker (see lace_trace_dump).
+ */
+typedef enum {
+    LACE_TRACE_SPAWN,           /* arg: deque slot */
+    LACE_TRACE_STEAL_BEGIN,     /* arg: victim */
+    LACE_TRACE_STEAL_END,
+    LACE_TRACE_LEAP_BEGIN,      /* arg: thief of the task being synced */
+    LACE_TRACE_LEAP_END,
+    LACE_TRACE_SYNC_SLOW,       /* arg: deque slot */
+    LACE_TRACE_NEWFRAME_BEGIN,
+    LACE_TRACE_NEWFRAME_END,
+    LACE_TRACE_SUSPEND_BEGIN,
+    LACE_TRACE_SUSPEND_END,
+} lace_trace_kind;
+
+/**
+ * Trace event; <info> holds the kind (lower 8 bits) and the argument.
+ * The fields are atomic, as lace_trace_dump may read them while the worker overwrites them.
+ */
+typedef struct {
+    _Atomic(uint64_t) time;
+    _Atomic(uint64_t) info;
+} lace_trace_entry;
+#endif
+
+/**
+ * Statistics counters of a worker (see lace_stats_snapshot).
+ * Only the worker itself writes them, so LACE_STAT_ADD does not need an atomic read-modify-write.
+ */
+typedef struct {
+    _Atomic(uint64_t) steals, failed_steals, leaps, splits, busy_ticks, idle_ticks; // times in ticks of gethrtime
+} lace_stats_ctr;
+
+#define LACE_STAT_ADD(w, field, k) atomic_store_explicit(&(w)->stats.field, atomic_load_explicit(&(w)->stats.field, memory_order_relaxed) + (k), memory_order_relaxed)
+
 typedef struct _WorkerP {
     Task *dq;                   // same as dq
     Task *split;                // same as dq+ts.ts.split
@@ -455,6 +1120,7 @@ typedef struct _WorkerP {
     uint32_t seed;              // my random seed (for lace_steal_random)
     uint16_t worker;            // what is my worker id?
     uint8_t allstolen;          // my allstolen
+    _Atomic(uint32_t) interrupt; // pending interrupts (LACE_INTERRUPT_*), set by other threads
 
 #if LACE_COUNT_EVENTS
     uint64_t ctr[CTR_MAX];      // counters
@@ -463,30 +1129,234 @@ typedef struct _WorkerP {
 #endif
 
     int16_t pu;                 // my pu (for HWLOC)
+
+    char *arena;                // overflow arena for task data (allocated on first use)
+    char *arena_top;            // first free byte of the arena
+    char *arena_end;            // end of the arena
+    struct _lace_arena_hdr *arena_last; // most recent allocation in the arena
+    char *stack;                // allocation stack for LACE_ALLOC (allocated on first use)
+    char *stack_top;            // first free byte of the allocation stack
+    char *stack_end;            // end of the allocation stack
+    void *slab_free[LACE_SLAB_CLASSES]; // free objects of each size class (see lace_malloc)
+    struct lace_slab *slabs;    // slabs of this worker
+
+    lace_stats_ctr stats;       // statistics (read by lace_stats_snapshot)
+
+    char *wls;                  // my worker-local storage (see LACE_WLS)
+    lace_pool_t *pool;          // my pool
+    _Atomic(unsigned int) *sleeping; // number of parked workers of my pool (read by SPAWN)
+    struct lace_cache_entry *cache; // operation cache of my pool, or NULL (see lace_set_cache_size)
+    uint64_t cache_mask;        // number of entries of the cache minus 1
+
+#if LACE_CANCEL
+    lace_scope_t *scope;        // innermost cancellation scope of the current task
+#endif
+
+#if LACE_TRACE
+    lace_trace_entry *trace;    // ring buffer of trace events
+    uint64_t trace_mask;        // size of the ring buffer minus 1
+    _Atomic(uint64_t) trace_head; // number of recorded events
+#endif
+
+#if LACE_PROFILE
+    lace_profile_ctr *profile;  // profile counters per task type (see lace_profile_report)
+    lace_task_type_t *profile_type; // the type of the running task, or NULL
+    uint64_t profile_time;      // when profile_type started running
+#endif
 } WorkerP;
 
 #define LACE_STOLEN   ((Worker*)0)
 #define LACE_BUSY     ((Worker*)1)
 #define LACE_NOWORK   ((Worker*)2)
 
-void lace_abort_stack_overflow(void) __attribute__((noreturn));
-
-typedef struct
-{
-    _Atomic(Task*) t;
-    char pad[LINE_SIZE-sizeof(Task *)];
-} lace_newframe_t;
-
-extern lace_newframe_t lace_newframe;
-
+#if LACE_TRACE
 /**
- * Make all tasks of the current worker shared.
+ * Record an event in the trace of worker <w>.
+ * Only the worker writes its trace, so the ring buffer needs no locks.
  */
-#define LACE_MAKE_ALL_SHARED() lace_make_all_shared(__lace_worker, __lace_dq_head)
 static inline void __attribute__((unused))
-lace_make_all_shared( WorkerP *w, Task *__lace_dq_head)
+lace_trace_event(WorkerP *w, lace_trace_kind kind, uint64_t arg)
 {
-    if (w->split != __lace_dq_head) {
+    struct timespec ts_now;
+    clock_gettime(CLOCK_MONOTONIC, &ts_now);
+    uint64_t head = atomic_load_explicit(&w->trace_head, memory_order_relaxed);
+    lace_trace_entry *e = &w->trace[head & w->trace_mask];
+    atomic_store_explicit(&e->time, (uint64_t)ts_now.tv_sec * 1000000000ULL + ts_now.tv_nsec, memory_order_relaxed);
+    atomic_store_explicit(&e->info, arg << 8 | kind, memory_order_relaxed);
+    atomic_store_explicit(&w->trace_head, head + 1, memory_order_release);
+}
+#define LACE_TRACE_EVENT(w, kind, arg) lace_trace_event(w, kind, arg)
+#else
+#define LACE_TRACE_EVENT(w, kind, arg) /* Empty */
+#endif
+
+#if LACE_PROFILE
+static inline lace_profile_ctr * __attribute__((unused))
+lace_profile_ctr_of(WorkerP *w, const lace_task_type_t *type)
+{
+    // task types beyond LACE_PROFILE_TYPES share the last (unreported) slot
+    return &w->profile[type->id < LACE_PROFILE_TYPES ? type->id : LACE_PROFILE_TYPES];
+}
+
+/**
+ * Add the time since the last switch to the running task type of <w>, then switch to <type> (NULL: none).
+ * Returns the previous task type.
+ */
+static inline lace_task_type_t * __attribute__((unused))
+lace_profile_switch(WorkerP *w, lace_task_type_t *type)
+{
+    struct timespec ts_now;
+    clock_gettime(CLOCK_MONOTONIC, &ts_now);
+    uint64_t now = (uint64_t)ts_now.tv_sec * 1000000000ULL + ts_now.tv_nsec;
+    lace_task_type_t *prev = w->profile_type;
+    if (prev != NULL) lace_profile_ctr_of(w, prev)->ns += now - w->profile_time;
+    w->profile_type = type;
+    w->profile_time = now;
+    return prev;
+}
+
+#define LACE_PROFILE_DECL(NAME) extern lace_task_type_t NAME##_TYPE;
+#define LACE_PROFILE_IMPL(NAME) lace_task_type_t NAME##_TYPE = { #NAME, 0, NULL }; \
+    static void __attribute__((constructor)) NAME##_REGISTER(void) { lace_profile_register(&NAME##_TYPE); }
+#define LACE_PROFILE_COUNT(w, NAME, field) (lace_profile_ctr_of(w, &NAME##_TYPE)->field++)
+#define LACE_PROFILE_PUSH(w, type) lace_task_type_t *__lace_profile_prev = lace_profile_switch(w, type)
+#define LACE_PROFILE_POP(w) lace_profile_switch(w, __lace_profile_prev)
+#else
+#define LACE_PROFILE_DECL(NAME) /* Empty */
+#define LACE_PROFILE_IMPL(NAME) /* Empty */
+#define LACE_PROFILE_COUNT(w, NAME, field) /* Empty */
+#define LACE_PROFILE_PUSH(w, type) /* Empty */
+#define LACE_PROFILE_POP(w) /* Empty */
+#endif
+
+#if LACE_CANCEL
+static inline void __attribute__((unused))
+lace_scope_enter(WorkerP *w, lace_scope_t *s)
+{
+    atomic_store_explicit(&s->cancelled, 0, memory_order_relaxed);
+    s->parent = w->scope;
+    w->scope = s;
+}
+
+static inline void __attribute__((unused))
+lace_scope_leave(WorkerP *w)
+{
+    w->scope = w->scope->parent;
+}
+
+static inline void __attribute__((unused))
+lace_cancel(lace_scope_t *s)
+{
+    atomic_store_explicit(&s->cancelled, 1, memory_order_relaxed);
+}
+
+static inline int __attribute__((unused))
+lace_cancelled(WorkerP *w)
+{
+    for (lace_scope_t *s = w->scope; s != NULL; s = s->parent) {
+        if (atomic_load_explicit(&s->cancelled, memory_order_relaxed)) return 1;
+    }
+    return 0;
+}
+
+/**
+ * Execute task <t> in cancellation scope <s>, e.g., a stolen task in the scope in which it was spawned.
+ */
+static inline void __attribute__((unused))
+lace_exec_in_scope(WorkerP *w, Task *__dq_head, Task *t, lace_scope_t *s)
+{
+    lace_scope_t *old = w->scope;
+    w->scope = s;
+    t->f(w, __dq_head, t);
+    w->scope = old;
+}
+#define LACE_EXEC_IN_SCOPE(w, head, t, s) lace_exec_in_scope(w, head, t, s)
+#else
+#define LACE_EXEC_IN_SCOPE(w, head, t, s) (t)->f(w, head, t)
+#endif
+
+void lace_abort_stack_overflow(void) __attribute__((noreturn));
+void lace_grow_deque(WorkerP *w);
+
+/**
+ * Header of an allocation in the overflow arena, which holds the data of tasks that do not fit in a Task.
+ * The allocations of a worker form a stack, ordered by the deque slot of the task that owns them.
+ */
+struct _lace_arena_hdr {
+    struct _lace_arena_hdr *prev;
+    Task *slot;
+};
+
+/**
+ * Allocate <size> bytes when the arena is exhausted or not yet allocated (used by lace_arena_alloc).
+ */
+char *lace_arena_alloc_slow(WorkerP *w, size_t size);
+
+/**
+ * Allocate <size> bytes when the allocation stack is exhausted or not yet allocated (used by LACE_ALLOC).
+ */
+char *lace_stack_alloc_slow(WorkerP *w, size_t size);
+
+/**
+ * Tasks with more data than fits in a Task store a pointer to their data instead.
+ */
+typedef struct {
+    TASK_COMMON_FIELDS(_Task)
+    void *data;
+} lace_task_ptr;
+
+/**
+ * The function of tasks that SPAWN_ELIDABLE ran right away. It does nothing, in case a thief steals the task.
+ */
+void lace_task_elided(WorkerP *w, Task *__dq_head, Task *t);
+
+/**
+ * Abort because RUN_ASYNC and DATAFLOW do not support tasks with more than LACE_TASKSIZE bytes of data.
+ * The call is removed for tasks that fit, so with GCC and Clang a call that remains is a compile error.
+ */
+void lace_abort_async_too_large(void) __attribute__((noreturn))
+#ifdef __has_attribute
+#if __has_attribute(error)
+    __attribute__((error("RUN_ASYNC and DATAFLOW do not support tasks with more than LACE_TASKSIZE bytes of data")))
+#endif
+#endif
+    ;
+
+/**
+ * Abort because SPAWN_ELIDABLE is used for a task that is not defined with TASK_ELIDABLE_n or VOID_TASK_ELIDABLE_n.
+ * The call is removed for elidable tasks, so with GCC and Clang a call that remains is a compile error.
+ */
+void lace_abort_not_elidable(void) __attribute__((noreturn))
+#ifdef __has_attribute
+#if __has_attribute(error)
+    __attribute__((error("SPAWN_ELIDABLE needs a task defined with TASK_ELIDABLE_n or VOID_TASK_ELIDABLE_n")))
+#endif
+#endif
+    ;
+
+/**
+ * Set by lace_set_steal_half, read by lace_steal.
+ */
+extern int lace_steal_half;
+
+/**
+ * Execute <k> tasks claimed by one steal, starting with <first> (used by lace_steal).
+ */
+void lace_steal_batch_CALL(WorkerP*, Task*, Task*, unsigned int);
+
+/**
+ * Wake up one parked worker of the pool of worker <w>, if any.
+ */
+void lace_wake_one(WorkerP *w);
+
+/**
+ * Make all tasks of the current worker shared.
+ */
+#define LACE_MAKE_ALL_SHARED() lace_make_all_shared(__lace_worker, __lace_dq_head)
+static inline void __attribute__((unused))
+lace_make_all_shared( WorkerP *w, Task *__lace_dq_head)
+{
+    if (w->split != __lace_dq_head) {
         w->split = __lace_dq_head;
         w->_public->ts.ts.split = __lace_dq_head - w->dq;
     }
@@ -590,16 +1460,39 @@ lace_steal(WorkerP *self, Task *__dq_head, Worker *victim)
         TailSplitNA ts;
         ts.v = victim->ts.v;
         if (ts.ts.tail < ts.ts.split) {
+#if LACE_CANCEL
+            // leave tasks of a cancelled scope to the owner, as they return early anyway
+            // (only the scope of the task itself is checked, as it is read before the task is ours)
+            // The owner may already be reusing the slot, so <scope> can be stale, but it always points to a
+            // scope on the stack of a worker, which stays mapped until lace_stop; a stale answer only makes us
+            // leave a task that we could have stolen, or steal a task that returns early.
+            lace_scope_t *scope = atomic_load_explicit(&victim->dq[ts.ts.tail].scope, memory_order_acquire);
+            if (scope != NULL && atomic_load_explicit(&scope->cancelled, memory_order_relaxed)) {
+                lace_time_event(self, 7);
+                return LACE_NOWORK;
+            }
+#endif
             TailSplitNA ts_new;
             ts_new.v = ts.v;
-            ts_new.ts.tail++;
+            uint32_t k = lace_steal_half ? (ts.ts.split - ts.ts.tail + 1) / 2 : 1;
+            ts_new.ts.tail += k;
             if (atomic_compare_exchange_weak(&victim->ts.v, &ts.v, ts_new.v)) {
                 // Stolen
                 Task *t = &victim->dq[ts.ts.tail];
+                LACE_TRACE_EVENT(self, LACE_TRACE_STEAL_BEGIN, victim->worker);
+                if (k > 1) {
+                    lace_time_event(self, 1);
+                    lace_steal_batch_CALL(self, __dq_head, t, k);
+                    lace_time_event(self, 2);
+                    LACE_TRACE_EVENT(self, LACE_TRACE_STEAL_END, 0);
+                    lace_time_event(self, 8);
+                    return LACE_STOLEN;
+                }
                 atomic_store_explicit(&t->thief, self->_public, memory_order_relaxed);
                 lace_time_event(self, 1);
-                t->f(self, __dq_head, t);
+                LACE_EXEC_IN_SCOPE(self, __dq_head, t, atomic_load_explicit(&t->scope, memory_order_relaxed));
                 lace_time_event(self, 2);
+                LACE_TRACE_EVENT(self, LACE_TRACE_STEAL_END, 0);
                 atomic_store_explicit(&t->thief, THIEF_COMPLETED, memory_order_release);
                 lace_time_event(self, 8);
                 return LACE_STOLEN;
@@ -640,6 +1533,7 @@ lace_shrink_shared(WorkerP *w)
             }
             w->split = w->dq + newsplit;
             PR_COUNTSPLITS(w, CTR_split_shrink);
+            LACE_STAT_ADD(w, splits, 1);
             return 0;
         }
     }
@@ -649,6 +1543,37 @@ lace_shrink_shared(WorkerP *w)
     return 1;
 }
 
+/**
+ * Steal from the thief of <t> until it completes <t>, and from random workers every <random> failed attempts.
+ * Used by lace_leapfrog.
+ */
+static inline void
+lace_leap_wait(WorkerP *__lace_worker, Task *__lace_dq_head, Task *t, int random)
+{
+    Worker *thief = t->thief;
+    int attempts = random;
+    while (thief != THIEF_COMPLETED) {
+        if (unlikely(atomic_load_explicit(&__lace_worker->interrupt, memory_order_relaxed) != 0)) {
+            lace_interrupted(__lace_worker, __lace_dq_head);
+            thief = t->thief;
+            continue;
+        }
+        PR_COUNTSTEALS(__lace_worker, CTR_leap_tries);
+        Worker *res = lace_steal(__lace_worker, __lace_dq_head, thief);
+        if (res == LACE_NOWORK) {
+            YIELD_NEWFRAME();
+            if ((LACE_LEAP_RANDOM) && (--attempts == 0)) { lace_steal_random(); attempts = random; }
+        } else if (res == LACE_STOLEN) {
+            PR_COUNTSTEALS(__lace_worker, CTR_leaps);
+            LACE_STAT_ADD(__lace_worker, leaps, 1);
+        } else if (res == LACE_BUSY) {
+            PR_COUNTSTEALS(__lace_worker, CTR_leap_busy);
+        }
+        atomic_thread_fence(memory_order_acquire);
+        thief = t->thief;
+    }
+}
+
 static inline void
 lace_leapfrog(WorkerP *__lace_worker, Task *__lace_dq_head)
 {
@@ -660,23 +1585,12 @@ lace_leapfrog(WorkerP *__lace_worker, Task *__lace_dq_head)
 
         /* PRE-LEAP: increase head again */
         __lace_dq_head += 1;
+        // the thief may already have completed the task
+        LACE_TRACE_EVENT(__lace_worker, LACE_TRACE_LEAP_BEGIN, thief != THIEF_COMPLETED ? ((Worker*)thief)->worker : 0);
 
         /* Now leapfrog */
-        int attempts = 32;
-        while (thief != THIEF_COMPLETED) {
-            PR_COUNTSTEALS(__lace_worker, CTR_leap_tries);
-            Worker *res = lace_steal(__lace_worker, __lace_dq_head, thief);
-            if (res == LACE_NOWORK) {
-                YIELD_NEWFRAME();
-                if ((LACE_LEAP_RANDOM) && (--attempts == 0)) { lace_steal_random(); attempts = 32; }
-            } else if (res == LACE_STOLEN) {
-                PR_COUNTSTEALS(__lace_worker, CTR_leaps);
-            } else if (res == LACE_BUSY) {
-                PR_COUNTSTEALS(__lace_worker, CTR_leap_busy);
-            }
-            atomic_thread_fence(memory_order_acquire);
-            thief = t->thief;
-        }
+        lace_leap_wait(__lace_worker, __lace_dq_head, t, 32);
+        LACE_TRACE_EVENT(__lace_worker, LACE_TRACE_LEAP_END, 0);
 
         /* POST-LEAP: really pop the finished task */
         /*            no need to decrease __lace_dq_head, since it is a local variable */
@@ -703,6 +1617,248 @@ void lace_drop_slow(WorkerP *w, Task *__dq_head)
     if ((w->allstolen) || (w->split > __dq_head && lace_shrink_shared(w))) lace_leapfrog(w, __dq_head);
 }
 
+/**
+ * Make the task that was just written at __dq_head available to thieves if needed (used by SPAWN).
+ */
+static inline __attribute__((always_inline, unused))
+void lace_spawn_publish(WorkerP *w, Task *__dq_head)
+{
+    TailSplitNA ts;
+    uint32_t head, split, newsplit;
+
+#if LACE_CANCEL
+    atomic_store_explicit(&__dq_head->scope, w->scope, memory_order_release);
+#endif
+
+    /*compiler_barrier();*/
+    atomic_thread_fence(memory_order_acquire);
+
+    Worker *wt = w->_public;
+    if (unlikely(w->allstolen)) {
+        if (wt->movesplit) wt->movesplit = 0;
+        head = __dq_head - w->dq;
+        ts = (TailSplitNA){{head,head+1}};
+        wt->ts.v = ts.v;
+        /*compiler_barrier();*/
+        wt->allstolen = 0;
+        w->split = __dq_head+1;
+        w->allstolen = 0;
+        // the task is now stealable; pairs with the fence in lace_park
+        atomic_thread_fence(memory_order_seq_cst);
+    } else if (unlikely(wt->movesplit)) {
+        head = __dq_head - w->dq;
+        split = w->split - w->dq;
+        newsplit = (split + head + 2)/2;
+        wt->ts.ts.split = newsplit;
+        w->split = w->dq + newsplit;
+        /*compiler_barrier();*/
+        wt->movesplit = 0;
+        PR_COUNTSPLITS(w, CTR_split_grow);
+        LACE_STAT_ADD(w, splits, 1);
+        // more tasks are now stealable; pairs with the fence in lace_park
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+
+    // Otherwise the new task is private, so a worker that parks cannot miss it: only the two branches above make
+    // tasks stealable, and they have a fence. Without the fence, a parked worker can be seen late here, which only
+    // delays its wake-up to a later SPAWN; the owner runs its private tasks itself.
+    if (unlikely(atomic_load_explicit(w->sleeping, memory_order_relaxed) != 0)) lace_wake_one(w);
+}
+
+/**
+ * Sync the task at __dq_head without executing it (used by the C++ front-end and by LACE_WF_FOR loops).
+ * Returns 1 if the task was stolen; then it is completed and its result is in the task.
+ * Returns 0 if the task was not stolen; then it is popped and the caller must execute it (or not).
+ */
+static inline __attribute__((unused))
+int lace_sync_stolen(WorkerP *w, Task *__dq_head)
+{
+    if (likely(0 == w->_public->movesplit)) {
+        if (likely(w->split <= __dq_head)) {
+            atomic_store_explicit(&__dq_head->thief, THIEF_EMPTY, memory_order_relaxed);
+            return 0;
+        }
+    }
+
+    LACE_TRACE_EVENT(w, LACE_TRACE_SYNC_SLOW, __dq_head - w->dq);
+
+    if ((w->allstolen) || (w->split > __dq_head && lace_shrink_shared(w))) {
+        lace_leapfrog(w, __dq_head);
+        return 1;
+    }
+
+    Worker *wt = w->_public;
+    if (wt->movesplit) {
+        Task *t = w->split;
+        size_t diff = __dq_head - t;
+        diff = (diff + 1) / 2;
+        w->split = t + diff;
+        wt->ts.ts.split += diff;
+        /*compiler_barrier();*/
+        wt->movesplit = 0;
+        PR_COUNTSPLITS(w, CTR_split_grow);
+        LACE_STAT_ADD(w, splits, 1);
+    }
+
+    atomic_store_explicit(&__dq_head->thief, THIEF_EMPTY, memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * Check if a LACE_FOR or LACE_REDUCE loop should split off half of its remaining range,
+ * i.e., when a thief asked for more work, or when all our tasks have been stolen.
+ */
+static inline int __attribute__((unused))
+lace_split_wanted(WorkerP *w)
+{
+    return unlikely(w->allstolen || w->_public->movesplit);
+}
+
+/**
+ * True if the current task should SPAWN part of its remaining work, for tasks that split their work lazily.
+ */
+#define LACE_SPLIT_WANTED() lace_split_wanted(__lace_worker)
+
+/**
+ * The operation cache. The key of an entry is an operation (for CALL_MEMO, the address of the WRAP function of
+ * the task) and LACE_CACHE_KEY words (for CALL_MEMO, the bytes of the arguments). Entries are updated with a
+ * sequence lock: <status> is odd while a worker writes the entry and is incremented by 2 by every write, so a
+ * reader that sees the same even <status> before and after reading the entry has read a consistent entry.
+ */
+#define LACE_CACHE_KEY 4
+
+typedef struct lace_cache_entry {
+    _Atomic(uint64_t) status;
+    _Atomic(uint64_t) op;
+    _Atomic(uint64_t) key[LACE_CACHE_KEY];
+    _Atomic(uint64_t) res;
+} __attribute__((aligned(LINE_SIZE))) lace_cache_entry_t;
+
+static inline uint64_t __attribute__((unused))
+lace_cache_hash(uint64_t op, const uint64_t *key)
+{
+    uint64_t h = op * 0x9e3779b97f4a7c15ULL;
+    for (int i=0; i<LACE_CACHE_KEY; i++) h = (h ^ key[i]) * 0xbf58476d1ce4e5b9ULL;
+    return h ^ (h >> 29);
+}
+
+/**
+ * Look up <op> with <key> in the operation cache; returns 1 and sets <res> if found.
+ */
+static inline int __attribute__((unused))
+lace_cache_get(WorkerP *w, uint64_t op, const uint64_t *key, uint64_t *res)
+{
+    if (w->cache == NULL) return 0;
+    lace_cache_entry_t *e = w->cache + (lace_cache_hash(op, key) & w->cache_mask);
+    uint64_t s = atomic_load_explicit(&e->status, memory_order_acquire);
+    if (s & 1) return 0;
+    if (atomic_load_explicit(&e->op, memory_order_relaxed) != op) return 0;
+    for (int i=0; i<LACE_CACHE_KEY; i++) {
+        if (atomic_load_explicit(&e->key[i], memory_order_relaxed) != key[i]) return 0;
+    }
+    uint64_t r = atomic_load_explicit(&e->res, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&e->status, memory_order_relaxed) != s) return 0;
+    *res = r;
+    return 1;
+}
+
+/**
+ * Store the result <res> of <op> with <key> in the operation cache, unless another worker is writing the entry.
+ */
+static inline void __attribute__((unused))
+lace_cache_put(WorkerP *w, uint64_t op, const uint64_t *key, uint64_t res)
+{
+    if (w->cache == NULL) return;
+    lace_cache_entry_t *e = w->cache + (lace_cache_hash(op, key) & w->cache_mask);
+    uint64_t s = atomic_load_explicit(&e->status, memory_order_relaxed);
+    if (s & 1) return;
+    if (!atomic_compare_exchange_strong_explicit(&e->status, &s, s + 1, memory_order_relaxed, memory_order_relaxed)) return;
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&e->op, op, memory_order_relaxed);
+    for (int i=0; i<LACE_CACHE_KEY; i++) atomic_store_explicit(&e->key[i], key[i], memory_order_relaxed);
+    atomic_store_explicit(&e->res, res, memory_order_relaxed);
+    atomic_store_explicit(&e->status, s + 2, memory_order_release);
+}
+
+/**
+ * Use the operation cache from inside a Lace task, for tasks that check the cache themselves (e.g., before
+ * spawning their children). <key> is an array of LACE_CACHE_KEY words; <op> must be nonzero and unique per operation.
+ */
+#define LACE_CACHE_GET(op, key, res)    lace_cache_get(__lace_worker, (op), (key), (res))
+#define LACE_CACHE_PUT(op, key, res)    lace_cache_put(__lace_worker, (op), (key), (res))
+
+/* SPAWN_ELIDABLE runs tasks right away when there are at least this many private tasks below the new task */
+#ifndef LACE_ELIDE_DEPTH
+#define LACE_ELIDE_DEPTH 8
+#endif
+
+/**
+ * Check if SPAWN_ELIDABLE can run the task at <head> right away, i.e., when no thief asked for more work,
+ * no worker is parked, and enough private tasks are left that can be shared when a thief asks.
+ */
+static inline int __attribute__((unused))
+lace_elide(WorkerP *w, Task *head)
+{
+    // (allstolen is not checked, as it implies that there are no private tasks)
+    return head - w->split >= LACE_ELIDE_DEPTH && head != w->end && !w->_public->movesplit &&
+           atomic_load_explicit(w->sleeping, memory_order_relaxed) == 0;
+}
+
+/**
+ * Mark the task at <head> as a task that SPAWN_ELIDABLE runs right away; it receives the result.
+ * The task may become shared while it runs, or later, and then stolen; then the thief runs lace_task_elided.
+ */
+static inline void __attribute__((unused))
+lace_elided(WorkerP *w, Task *head)
+{
+    head->f = &lace_task_elided;
+#if LACE_CANCEL
+    atomic_store_explicit(&head->scope, w->scope, memory_order_release);
+#endif
+    atomic_store_explicit(&head->thief, THIEF_TASK, memory_order_relaxed);
+    (void)w;
+}
+
+/**
+ * Allocate <size> bytes in the overflow arena for the task in deque slot <slot> (used by SPAWN).
+ * The data of tasks in slots at or above <slot> is no longer used, since these tasks have been synced
+ * or dropped, so their allocations are released first. Stolen tasks are only synced after the thief
+ * is done, so the data of a stolen task stays valid while the thief uses it.
+ */
+static inline __attribute__((unused))
+void *lace_arena_alloc(WorkerP *w, Task *slot, size_t size)
+{
+    struct _lace_arena_hdr *h = w->arena_last;
+    char *top = w->arena_top;
+    while (h != NULL && h->slot >= slot) {
+        top = (char *)h;
+        h = h->prev;
+    }
+    size = (sizeof(struct _lace_arena_hdr) + size + LACE_COMMON_FIELD_SIZE - 1) & ~(size_t)(LACE_COMMON_FIELD_SIZE - 1);
+    if (unlikely((size_t)(w->arena_end - top) < size)) top = lace_arena_alloc_slow(w, size);
+    struct _lace_arena_hdr *nh = (struct _lace_arena_hdr *)top;
+    nh->prev = h;
+    nh->slot = slot;
+    w->arena_last = nh;
+    w->arena_top = top + size;
+    return nh + 1;
+}
+
+/**
+ * Allocate <size> bytes on the allocation stack of worker <w> (used by LACE_ALLOC).
+ */
+static inline __attribute__((unused))
+void *lace_stack_alloc(WorkerP *w, size_t size)
+{
+    size = (size + 15) & ~(size_t)15;
+    char *top = w->stack_top;
+    // the top is NULL until the stack is allocated (also after releasing a mark taken before)
+    if (unlikely(top == NULL || (size_t)(w->stack_end - top) < size)) top = lace_stack_alloc_slow(w, size);
+    w->stack_top = top + size;
+    return top;
+}
+
 static inline __attribute__((unused))
 void lace_drop(WorkerP *w, Task *__dq_head)
 {
@@ -729,6 +1885,7 @@ if ((r)); then
   TASK_INIT="$TASK_INIT t->d.args.arg_$r = arg_$r;"
   TASK_GET_FROM_t="$TASK_GET_FROM_t, t->d.args.arg_$r"
   CALL_ARGS="$CALL_ARGS, arg_$r"
+  BODY_ARGS="$BODY_ARGS, ARG_$r"
   FUN_ARGS="$FUN_ARGS, ATYPE_$r arg_$r"
   WORK_ARGS="$WORK_ARGS, ATYPE_$r ARG_$r"
   ARGS_STRUCT="struct { $TASK_FIELDS } args;"
@@ -745,7 +1902,11 @@ for isvoid in 0 1; do
 if (( isvoid==0 )); then
   DEF_MACRO="#define TASK_$r(RTYPE, NAME$MACRO_ARGS) \
              TASK_DECL_$r(RTYPE, NAME$DECL_ARGS) TASK_IMPL_$r(RTYPE, NAME$MACRO_ARGS)"
-  DECL_MACRO="#define TASK_DECL_$r(RTYPE, NAME$DECL_ARGS)"
+  ELIDABLE_MACRO="#define TASK_ELIDABLE_$r(RTYPE, NAME$MACRO_ARGS) \
+             TASK_ELIDABLE_DECL_$r(RTYPE, NAME$DECL_ARGS) TASK_IMPL_$r(RTYPE, NAME$MACRO_ARGS)"
+  DECL_WRAPPERS="#define TASK_DECL_$r(RTYPE, NAME$DECL_ARGS) LACE_TASK_DECL_$r(0, RTYPE, NAME$DECL_ARGS)
+#define TASK_ELIDABLE_DECL_$r(RTYPE, NAME$DECL_ARGS) LACE_TASK_DECL_$r(1, RTYPE, NAME$DECL_ARGS)"
+  DECL_MACRO="#define LACE_TASK_DECL_$r(ELIDABLE, RTYPE, NAME$DECL_ARGS)"
   IMPL_MACRO="#define TASK_IMPL_$r(RTYPE, NAME$MACRO_ARGS)"
   RTYPE="RTYPE"
   RES_FIELD="$RTYPE res;"
@@ -754,10 +1915,47 @@ if (( isvoid==0 )); then
   UNION="union { $ARGS_STRUCT $RTYPE res; } d;"
   SS_RETURN="return "
   SS_RETURN2=""
+  CALL_SAVE="RTYPE __lace_res ="
+  CALL_RETURN="return __lace_res;"
+  if ((r)); then
+    MEMO_KEY="memcpy(__lace_key, &t->d.args, sizeof(t->d.args) <= sizeof(__lace_key) ? sizeof(t->d.args) : sizeof(__lace_key));"
+    MEMO_ARGS_SIZE="sizeof(t->d.args)"
+  else
+    MEMO_KEY=""
+    MEMO_ARGS_SIZE="0"
+  fi
+  CALL_MEMO="
+/* CALL_MEMO: the key is the bytes of the arguments, the result is stored as a 64-bit word */
+static inline __attribute__((unused))
+RTYPE NAME##_CALL_MEMO(WorkerP *w, Task *__dq_head $FUN_ARGS)
+{
+    TD_##NAME _d, *t = &_d;
+    uint64_t __lace_key[LACE_CACHE_KEY] = {0}, __lace_val = 0;
+    RTYPE __lace_res;
+    if ($MEMO_ARGS_SIZE > sizeof(__lace_key) || sizeof(RTYPE) > sizeof(uint64_t) || w->cache == NULL) {
+        return NAME##_CALL(w, __dq_head $CALL_ARGS);
+    }
+    memset(&t->d, 0, sizeof(t->d)); /* so the padding between arguments is zero */
+    $TASK_INIT
+    $MEMO_KEY
+    if (lace_cache_get(w, (uint64_t)(uintptr_t)&NAME##_WRAP, __lace_key, &__lace_val)) {
+        memcpy(&__lace_res, &__lace_val, sizeof(RTYPE) <= sizeof(uint64_t) ? sizeof(RTYPE) : sizeof(uint64_t));
+        return __lace_res;
+    }
+    __lace_res = NAME##_CALL(w, __dq_head $CALL_ARGS);
+    memcpy(&__lace_val, &__lace_res, sizeof(RTYPE) <= sizeof(uint64_t) ? sizeof(RTYPE) : sizeof(uint64_t));
+    lace_cache_put(w, (uint64_t)(uintptr_t)&NAME##_WRAP, __lace_key, __lace_val);
+    return __lace_res;
+}
+"
 else
   DEF_MACRO="#define VOID_TASK_$r(NAME$MACRO_ARGS) \
              VOID_TASK_DECL_$r(NAME$DECL_ARGS) VOID_TASK_IMPL_$r(NAME$MACRO_ARGS)"
-  DECL_MACRO="#define VOID_TASK_DECL_$r(NAME$DECL_ARGS)"
+  ELIDABLE_MACRO="#define VOID_TASK_ELIDABLE_$r(NAME$MACRO_ARGS) \
+             VOID_TASK_ELIDABLE_DECL_$r(NAME$DECL_ARGS) VOID_TASK_IMPL_$r(NAME$MACRO_ARGS)"
+  DECL_WRAPPERS="#define VOID_TASK_DECL_$r(NAME$DECL_ARGS) LACE_VOID_TASK_DECL_$r(0, NAME$DECL_ARGS)
+#define VOID_TASK_ELIDABLE_DECL_$r(NAME$DECL_ARGS) LACE_VOID_TASK_DECL_$r(1, NAME$DECL_ARGS)"
+  DECL_MACRO="#define LACE_VOID_TASK_DECL_$r(ELIDABLE, NAME$DECL_ARGS)"
   IMPL_MACRO="#define VOID_TASK_IMPL_$r(NAME$MACRO_ARGS)"
   RTYPE="void"
   SAVE_RVAL=""
@@ -765,6 +1963,9 @@ else
   if ((r)); then UNION="union { $ARGS_STRUCT } d;"; else UNION=""; fi
   SS_RETURN=""
   SS_RETURN2="return;"
+  CALL_SAVE=""
+  CALL_RETURN=""
+  CALL_MEMO=""
 fi
 
 # Write down the macro for the task declaration
@@ -772,13 +1973,30 @@ fi
 echo "$DECL_MACRO
 
 typedef struct _TD_##NAME {
-  TASK_COMMON_FIELDS(_TD_##NAME)
+  TASK_COMMON_FIELDS(_Task)
   $UNION
 } TD_##NAME;
 
-static_assert(sizeof(TD_##NAME) <= sizeof(Task), \"TD_\" #NAME \" is too large, set LACE_TASKSIZE to a higher value!\");
+LACE_PROFILE_DECL(NAME)
 
-void NAME##_WRAP(WorkerP *, Task *, TD_##NAME *);
+/* Get the data of the task in <t>, which is stored in the overflow arena if it does not fit in a Task */
+static inline __attribute__((unused))
+TD_##NAME *NAME##_DATA(Task *t)
+{
+    if (sizeof(TD_##NAME) <= sizeof(Task)) return (TD_##NAME *)t;
+    return (TD_##NAME *)((lace_task_ptr *)t)->data;
+}
+
+/* Prepare the task in <t> for tasks that are run by the caller, storing the data in <d> if it does not fit */
+static inline __attribute__((unused))
+TD_##NAME *NAME##_DATA_AT(Task *t, TD_##NAME *d)
+{
+    if (sizeof(TD_##NAME) <= sizeof(Task)) return (TD_##NAME *)t;
+    ((lace_task_ptr *)t)->data = d;
+    return d;
+}
+
+void NAME##_WRAP(WorkerP *, Task *, Task *);
 $RTYPE NAME##_CALL(WorkerP *, Task * $FUN_ARGS);
 static inline $RTYPE NAME##_SYNC(WorkerP *, Task *);
 static $RTYPE NAME##_SYNC_SLOW(WorkerP *, Task *);
@@ -787,49 +2005,45 @@ static inline __attribute__((unused))
 void NAME##_SPAWN(WorkerP *w, Task *__dq_head $FUN_ARGS)
 {
     PR_COUNTTASK(w);
+    LACE_PROFILE_COUNT(w, NAME, spawns);
 
-    TD_##NAME *t;
-    TailSplitNA ts;
-    uint32_t head, split, newsplit;
+    TD_##NAME *t __attribute__((unused));
 
-    if (__dq_head == w->end) lace_abort_stack_overflow();
+    if (unlikely(__dq_head == w->end)) lace_grow_deque(w);
+    LACE_TRACE_EVENT(w, LACE_TRACE_SPAWN, __dq_head - w->dq);
 
-    t = (TD_##NAME *)__dq_head;
-    t->f = &NAME##_WRAP;
-    atomic_store_explicit(&t->thief, THIEF_TASK, memory_order_relaxed);
+    __dq_head->f = &NAME##_WRAP;
+    atomic_store_explicit(&__dq_head->thief, THIEF_TASK, memory_order_relaxed);
+    if (sizeof(TD_##NAME) <= sizeof(Task)) t = (TD_##NAME *)__dq_head;
+    else t = (TD_##NAME *)(((lace_task_ptr *)__dq_head)->data = lace_arena_alloc(w, __dq_head, sizeof(TD_##NAME)));
     $TASK_INIT
-    /*compiler_barrier();*/
-    atomic_thread_fence(memory_order_acquire);
+    lace_spawn_publish(w, __dq_head);
+}
 
-    Worker *wt = w->_public;
-    if (unlikely(w->allstolen)) {
-        if (wt->movesplit) wt->movesplit = 0;
-        head = __dq_head - w->dq;
-        ts = (TailSplitNA){{head,head+1}};
-        wt->ts.v = ts.v;
-        /*compiler_barrier();*/
-        wt->allstolen = 0;
-        w->split = __dq_head+1;
-        w->allstolen = 0;
-    } else if (unlikely(wt->movesplit)) {
-        head = __dq_head - w->dq;
-        split = w->split - w->dq;
-        newsplit = (split + head + 2)/2;
-        wt->ts.ts.split = newsplit;
-        w->split = w->dq + newsplit;
-        /*compiler_barrier();*/
-        wt->movesplit = 0;
-        PR_COUNTSPLITS(w, CTR_split_grow);
+static inline __attribute__((unused))
+void NAME##_SPAWN_ELIDABLE(WorkerP *w, Task *__dq_head $FUN_ARGS)
+{
+    if (!ELIDABLE) lace_abort_not_elidable();
+    if (sizeof(TD_##NAME) <= sizeof(Task) && likely(lace_elide(w, __dq_head))) {
+        TD_##NAME *t __attribute__((unused)) = (TD_##NAME *)__dq_head;
+        LACE_PROFILE_COUNT(w, NAME, spawns);
+        LACE_PROFILE_COUNT(w, NAME, inlined);
+        lace_elided(w, __dq_head);
+        $SAVE_RVAL NAME##_CALL(w, __dq_head + 1 $CALL_ARGS);
+    } else {
+        NAME##_SPAWN(w, __dq_head $CALL_ARGS);
     }
 }
+$CALL_MEMO
 
 static inline __attribute__((unused))
 $RTYPE NAME##_NEWFRAME($FUN_ARGS_NC)
 {
     Task _t;
-    TD_##NAME *t = (TD_##NAME *)&_t;
-    t->f = &NAME##_WRAP;
-    atomic_store_explicit(&t->thief, THIEF_TASK, memory_order_relaxed);
+    TD_##NAME _d;
+    TD_##NAME *t __attribute__((unused)) = NAME##_DATA_AT(&_t, &_d);
+    _t.f = &NAME##_WRAP;
+    atomic_store_explicit(&_t.thief, THIEF_TASK, memory_order_relaxed);
     $TASK_INIT
     lace_run_newframe(&_t);
     return $RETURN_RES;
@@ -839,9 +2053,10 @@ static inline __attribute__((unused))
 void NAME##_TOGETHER($FUN_ARGS_NC)
 {
     Task _t;
-    TD_##NAME *t = (TD_##NAME *)&_t;
-    t->f = &NAME##_WRAP;
-    atomic_store_explicit(&t->thief, THIEF_TASK, memory_order_relaxed);
+    TD_##NAME _d;
+    TD_##NAME *t __attribute__((unused)) = NAME##_DATA_AT(&_t, &_d);
+    _t.f = &NAME##_WRAP;
+    atomic_store_explicit(&_t.thief, THIEF_TASK, memory_order_relaxed);
     $TASK_INIT
     lace_run_together(&_t);
 }
@@ -850,34 +2065,86 @@ static inline __attribute__((unused))
 $RTYPE NAME##_RUN($FUN_ARGS_NC)
 {
     Task _t;
-    TD_##NAME *t = (TD_##NAME *)&_t;
-    t->f = &NAME##_WRAP;
-    atomic_store_explicit(&t->thief, THIEF_TASK, memory_order_relaxed);
+    TD_##NAME _d;
+    TD_##NAME *t __attribute__((unused)) = NAME##_DATA_AT(&_t, &_d);
+    _t.f = &NAME##_WRAP;
+    atomic_store_explicit(&_t.thief, THIEF_TASK, memory_order_relaxed);
     $TASK_INIT
     lace_run_task(&_t);
     return $RETURN_RES;
 }
 
+static inline __attribute__((unused))
+$RTYPE NAME##_RUNHI($FUN_ARGS_NC)
+{
+    Task _t;
+    TD_##NAME _d;
+    TD_##NAME *t __attribute__((unused)) = NAME##_DATA_AT(&_t, &_d);
+    _t.f = &NAME##_WRAP;
+    atomic_store_explicit(&_t.thief, THIEF_TASK, memory_order_relaxed);
+    $TASK_INIT
+    lace_run_task_high(&_t);
+    return $RETURN_RES;
+}
+
 static inline __attribute__((unused))
 $RTYPE NAME##_RUNEX($FUN_ARGS_NC)
 {
     Task _t;
-    TD_##NAME *t = (TD_##NAME *)&_t;
-    t->f = &NAME##_WRAP;
-    atomic_store_explicit(&t->thief, THIEF_TASK, memory_order_relaxed);
+    TD_##NAME _d;
+    TD_##NAME *t __attribute__((unused)) = NAME##_DATA_AT(&_t, &_d);
+    _t.f = &NAME##_WRAP;
+    atomic_store_explicit(&_t.thief, THIEF_TASK, memory_order_relaxed);
     $TASK_INIT
     lace_run_task_exclusive(&_t);
     return $RETURN_RES;
 }
 
+static inline __attribute__((unused))
+lace_future_t *NAME##_RUN_ASYNC(lace_future_t *fut, lace_future_cb cb, void *arg $FUN_ARGS)
+{
+    if (sizeof(TD_##NAME) > sizeof(Task)) lace_abort_async_too_large();
+    TD_##NAME *t __attribute__((unused)) = (TD_##NAME *)&fut->t;
+    fut->t.f = &NAME##_WRAP;
+    atomic_store_explicit(&fut->t.thief, THIEF_TASK, memory_order_relaxed);
+    $TASK_INIT
+    lace_run_task_async(fut, cb, arg);
+    return fut;
+}
+
+static inline __attribute__((unused))
+lace_future_t *NAME##_DATAFLOW(lace_future_t *fut, lace_future_t **deps, unsigned int n_deps $FUN_ARGS)
+{
+    if (sizeof(TD_##NAME) > sizeof(Task)) lace_abort_async_too_large();
+    TD_##NAME *t __attribute__((unused)) = (TD_##NAME *)&fut->t;
+    fut->t.f = &NAME##_WRAP;
+    atomic_store_explicit(&fut->t.thief, THIEF_TASK, memory_order_relaxed);
+    $TASK_INIT
+    lace_run_task_after(fut, deps, n_deps);
+    return fut;
+}
+
+static inline __attribute__((unused))
+$RTYPE NAME##_ASYNC_RESULT(lace_future_t *fut)
+{
+    TD_##NAME *t = NAME##_DATA(&fut->t);
+    (void)t;
+    return $RETURN_RES;
+}
+
 static __attribute__((noinline))
 $RTYPE NAME##_SYNC_SLOW(WorkerP *w, Task *__dq_head)
 {
-    TD_##NAME *t;
+    TD_##NAME *t __attribute__((unused));
+
+    LACE_TRACE_EVENT(w, LACE_TRACE_SYNC_SLOW, __dq_head - w->dq);
 
     if ((w->allstolen) || (w->split > __dq_head && lace_shrink_shared(w))) {
+        LACE_PROFILE_COUNT(w, NAME, stolen);
+        LACE_PROFILE_PUSH(w, NULL);
         lace_leapfrog(w, __dq_head);
-        t = (TD_##NAME *)__dq_head;
+        LACE_PROFILE_POP(w);
+        t = NAME##_DATA(__dq_head);
         return $RETURN_RES;
     }
 
@@ -893,12 +2160,15 @@ $RTYPE NAME##_SYNC_SLOW(WorkerP *w, Task *__dq_head)
         /*compiler_barrier();*/
         wt->movesplit = 0;
         PR_COUNTSPLITS(w, CTR_split_grow);
+        LACE_STAT_ADD(w, splits, 1);
     }
 
     /*compiler_barrier();*/
 
-    t = (TD_##NAME *)__dq_head;
-    atomic_store_explicit(&t->thief, THIEF_EMPTY, memory_order_relaxed);
+    t = NAME##_DATA(__dq_head);
+    atomic_store_explicit(&__dq_head->thief, THIEF_EMPTY, memory_order_relaxed);
+    if (ELIDABLE && __dq_head->f == &lace_task_elided) return $RETURN_RES;
+    LACE_PROFILE_COUNT(w, NAME, inlined);
     ${SS_RETURN}NAME##_CALL(w, __dq_head $TASK_GET_FROM_t);
 }
 
@@ -907,10 +2177,18 @@ $RTYPE NAME##_SYNC(WorkerP *w, Task *__dq_head)
 {
     /* assert (__dq_head > 0); */  /* Commented out because we assume contract */
 
+    /* a task that SPAWN_ELIDABLE ran right away, and that is still private (else see NAME##_SYNC_SLOW) */
+    if (ELIDABLE && likely(w->split <= __dq_head) && __dq_head->f == &lace_task_elided) {
+        TD_##NAME *t __attribute__((unused)) = (TD_##NAME *)__dq_head;
+        atomic_store_explicit(&__dq_head->thief, THIEF_EMPTY, memory_order_relaxed);
+        return $RETURN_RES;
+    }
+
     if (likely(0 == w->_public->movesplit)) {
         if (likely(w->split <= __dq_head)) {
-            TD_##NAME *t = (TD_##NAME *)__dq_head;
-            atomic_store_explicit(&t->thief, THIEF_EMPTY, memory_order_relaxed);
+            TD_##NAME *t __attribute__((unused)) = NAME##_DATA(__dq_head);
+            atomic_store_explicit(&__dq_head->thief, THIEF_EMPTY, memory_order_relaxed);
+            LACE_PROFILE_COUNT(w, NAME, inlined);
             ${SS_RETURN}NAME##_CALL(w, __dq_head $TASK_GET_FROM_t);
             ${SS_RETURN2}
         }
@@ -926,8 +2204,11 @@ echo ""
 
 (\
 echo "$IMPL_MACRO
-void NAME##_WRAP(WorkerP *w, Task *__dq_head, TD_##NAME *t __attribute__((unused)))
+LACE_PROFILE_IMPL(NAME)
+
+void NAME##_WRAP(WorkerP *w, Task *__dq_head, Task *_t)
 {
+    TD_##NAME *t __attribute__((unused)) = NAME##_DATA(_t);
     $SAVE_RVAL NAME##_CALL(w, __dq_head $TASK_GET_FROM_t);
 }
 
@@ -937,7 +2218,11 @@ $RTYPE NAME##_WORK(WorkerP *__lace_worker, Task *__lace_dq_head $DECL_ARGS);
 /* NAME##_WORK is inlined in NAME##_CALL and the parameter __lace_in_task will disappear */
 $RTYPE NAME##_CALL(WorkerP *w, Task *__dq_head $FUN_ARGS)
 {
-    ${SS_RETURN}NAME##_WORK(w, __dq_head $CALL_ARGS);
+    LACE_PROFILE_COUNT(w, NAME, runs);
+    LACE_PROFILE_PUSH(w, &NAME##_TYPE);
+    $CALL_SAVE NAME##_WORK(w, __dq_head $CALL_ARGS);
+    LACE_PROFILE_POP(w);
+    $CALL_RETURN
 }
 
 static inline __attribute__((always_inline))
@@ -946,12 +2231,135 @@ $RTYPE NAME##_WORK(WorkerP *__lace_worker __attribute__((unused)), Task *__lace_
 
 echo ""
 
+echo "$DECL_WRAPPERS"
 echo $DEF_MACRO
+echo $ELIDABLE_MACRO
 
 echo ""
 
 done
 
+# Create LACE_FOR and LACE_REDUCE macros, which use two task parameters for the range
+if (( r+2 <= k )); then
+
+(\
+echo "#define LACE_FOR_$r(NAME, I$MACRO_ARGS)
+static inline __attribute__((always_inline))
+void NAME##_BODY(WorkerP *, Task *, size_t $DECL_ARGS);
+
+VOID_TASK_$((r+2))(NAME, size_t, __lace_from, size_t, __lace_to$MACRO_ARGS)
+{
+    int __lace_spawned = 0;
+    while (__lace_from < __lace_to) {
+        if (lace_split_wanted(__lace_worker) && __lace_to - __lace_from > 1) {
+            size_t __lace_mid = __lace_from + (__lace_to - __lace_from) / 2;
+            SPAWN(NAME, __lace_mid, __lace_to$BODY_ARGS);
+            __lace_to = __lace_mid;
+            __lace_spawned++;
+        }
+        NAME##_BODY(__lace_worker, __lace_dq_head, __lace_from++$BODY_ARGS);
+    }
+    while (__lace_spawned--) SYNC(NAME);
+}
+
+static inline __attribute__((always_inline))
+void NAME##_BODY(WorkerP *__lace_worker __attribute__((unused)), Task *__lace_dq_head __attribute__((unused)), size_t I $WORK_ARGS)" \
+) | awk '{printf "%-86s\\\n", $0 }'
+
+echo ""
+
+(\
+echo "#define LACE_REDUCE_$r(RTYPE, NAME, I, IDENTITY, COMBINE$MACRO_ARGS)
+static inline __attribute__((always_inline))
+RTYPE NAME##_BODY(WorkerP *, Task *, size_t $DECL_ARGS);
+
+TASK_$((r+2))(RTYPE, NAME, size_t, __lace_from, size_t, __lace_to$MACRO_ARGS)
+{
+    RTYPE __lace_res = (IDENTITY);
+    int __lace_spawned = 0;
+    while (__lace_from < __lace_to) {
+        if (lace_split_wanted(__lace_worker) && __lace_to - __lace_from > 1) {
+            size_t __lace_mid = __lace_from + (__lace_to - __lace_from) / 2;
+            SPAWN(NAME, __lace_mid, __lace_to$BODY_ARGS);
+            __lace_to = __lace_mid;
+            __lace_spawned++;
+        }
+        __lace_res = COMBINE(__lace_res, NAME##_BODY(__lace_worker, __lace_dq_head, __lace_from++$BODY_ARGS));
+    }
+    /* the most recently spawned range is adjacent to ours, so this combines the results in order */
+    while (__lace_spawned--) __lace_res = COMBINE(__lace_res, SYNC(NAME));
+    return __lace_res;
+}
+
+static inline __attribute__((always_inline))
+RTYPE NAME##_BODY(WorkerP *__lace_worker __attribute__((unused)), Task *__lace_dq_head __attribute__((unused)), size_t I $WORK_ARGS)" \
+) | awk '{printf "%-86s\\\n", $0 }'
+
+echo ""
+
+(\
+echo "#define LACE_WF_FOR_$r(NAME, I$MACRO_ARGS)
+static inline __attribute__((always_inline))
+void NAME##_BODY(WorkerP *, Task *, size_t $DECL_ARGS);
+
+VOID_TASK_$((r+2))(NAME, size_t, __lace_from, size_t, __lace_to$MACRO_ARGS)
+{
+    while (__lace_from < __lace_to) {
+        size_t __lace_i = __lace_from++;
+        if (__lace_from == __lace_to) {
+            NAME##_BODY(__lace_worker, __lace_dq_head, __lace_i$BODY_ARGS);
+            break;
+        }
+        /* offer the rest of the loop (our continuation) to thieves, and run iteration __lace_i */
+        SPAWN(NAME, __lace_from, __lace_to$BODY_ARGS);
+        NAME##_BODY(__lace_worker, __lace_dq_head, __lace_i$BODY_ARGS);
+        /* if a thief took the continuation, then it also ran the rest of the loop */
+        __lace_dq_head--;
+        if (lace_sync_stolen(__lace_worker, __lace_dq_head)) break;
+    }
+}
+
+static inline __attribute__((always_inline))
+void NAME##_BODY(WorkerP *__lace_worker __attribute__((unused)), Task *__lace_dq_head __attribute__((unused)), size_t I $WORK_ARGS)" \
+) | awk '{printf "%-86s\\\n", $0 }'
+
+echo ""
+
+(\
+echo "#define LACE_WF_REDUCE_$r(RTYPE, NAME, I, IDENTITY, COMBINE$MACRO_ARGS)
+static inline __attribute__((always_inline))
+RTYPE NAME##_BODY(WorkerP *, Task *, size_t $DECL_ARGS);
+
+TASK_$((r+2))(RTYPE, NAME, size_t, __lace_from, size_t, __lace_to$MACRO_ARGS)
+{
+    RTYPE __lace_res = (IDENTITY);
+    while (__lace_from < __lace_to) {
+        size_t __lace_i = __lace_from++;
+        if (__lace_from == __lace_to) {
+            __lace_res = COMBINE(__lace_res, NAME##_BODY(__lace_worker, __lace_dq_head, __lace_i$BODY_ARGS));
+            break;
+        }
+        /* offer the rest of the loop (our continuation) to thieves, and run iteration __lace_i */
+        SPAWN(NAME, __lace_from, __lace_to$BODY_ARGS);
+        __lace_res = COMBINE(__lace_res, NAME##_BODY(__lace_worker, __lace_dq_head, __lace_i$BODY_ARGS));
+        /* if a thief took the continuation, then it also ran the rest of the loop */
+        __lace_dq_head--;
+        if (lace_sync_stolen(__lace_worker, __lace_dq_head)) {
+            __lace_res = COMBINE(__lace_res, NAME##_DATA(__lace_dq_head)->d.res);
+            break;
+        }
+    }
+    return __lace_res;
+}
+
+static inline __attribute__((always_inline))
+RTYPE NAME##_BODY(WorkerP *__lace_worker __attribute__((unused)), Task *__lace_dq_head __attribute__((unused)), size_t I $WORK_ARGS)" \
+) | awk '{printf "%-86s\\\n", $0 }'
+
+echo ""
+
+fi
+
 done
 
 echo "
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+static atomic_int together_count = 0;
+
+VOID_TASK_0(count_together)
+{
+    together_count += 1;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    lace_start(n_workers, 0);
+    printf("Testing lace_set_active_workers with %u workers...\n", lace_workers());
+
+    // shrink and grow the number of active workers
+    for (int round=0; round<2; round++) {
+        for (int i=0; i<2*n_workers; i++) {
+            unsigned int k = i < n_workers ? (unsigned int)(n_workers-i) : (unsigned int)(i-n_workers+1);
+            lace_set_active_workers(k);
+            if (lace_active_workers() != k) {
+                fprintf(stderr, "wrong number of active workers!\n");
+                return 1;
+            }
+
+            if (RUN(pfib, 20) != 6765) {
+                fprintf(stderr, "wrong result for pfib with %u active workers!\n", k);
+                return 1;
+            }
+
+            // retired workers also run TOGETHER tasks
+            together_count = 0;
+            TOGETHER(count_together);
+            if (together_count != n_workers) {
+                fprintf(stderr, "wrong number of workers in TOGETHER with %u active workers!\n", k);
+                return 1;
+            }
+        }
+    }
+
+    // out of range values are clamped
+    lace_set_active_workers(0);
+    if (lace_active_workers() != 1) return 1;
+    lace_set_active_workers(n_workers+1);
+    if (lace_active_workers() != (unsigned int)n_workers) return 1;
+
+    lace_stop();
+
+    return 0;
+}
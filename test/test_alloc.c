@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lace.h>
+
+// build a tree of depth <depth> on the allocation stack, and check it after the children are synced
+TASK_2(int, tree, int, depth, int*, value)
+{
+    *value = depth;
+    if (depth == 0) return 1;
+    lace_mark_t mark = LACE_MARK();
+    int *left = LACE_ALLOC(sizeof(int));
+    int *right = LACE_ALLOC(sizeof(int));
+    SPAWN(tree, depth-1, left);
+    int n = CALL(tree, depth-1, right);
+    n += SYNC(tree);
+    if (*left != depth-1 || *right != depth-1) n = -1000000;
+    LACE_RELEASE(mark);
+    if (LACE_MARK() != mark) n = -1000000;
+    return n + 1;
+}
+
+#define N_OBJECTS 20000
+
+static int *objects[N_OBJECTS];
+
+// allocate objects of various sizes on all workers
+VOID_TASK_2(alloc_objects, int, from, int, to)
+{
+    if (to - from == 1) {
+        size_t size = sizeof(int) * (1 + from % 700);
+        objects[from] = lace_malloc(size);
+        for (size_t i=0; i<size/sizeof(int); i++) objects[from][i] = from;
+        return;
+    }
+    int mid = (from + to) / 2;
+    SPAWN(alloc_objects, from, mid);
+    CALL(alloc_objects, mid, to);
+    SYNC(alloc_objects);
+}
+
+// free the objects in a different order, so many are freed by another worker than their owner
+VOID_TASK_3(free_objects, int, from, int, to, int*, errors)
+{
+    if (to - from == 1) {
+        int k = N_OBJECTS - 1 - from;
+        size_t size = sizeof(int) * (1 + k % 700);
+        for (size_t i=0; i<size/sizeof(int); i++) if (objects[k][i] != k) __atomic_fetch_add(errors, 1, __ATOMIC_RELAXED);
+        lace_free(objects[k]);
+        return;
+    }
+    int mid = (from + to) / 2;
+    SPAWN(free_objects, from, mid, errors);
+    CALL(free_objects, mid, to, errors);
+    SYNC(free_objects);
+}
+
+VOID_TASK_1(check_objects, int*, errors)
+{
+    CALL(alloc_objects, 0, N_OBJECTS);
+    // all objects are distinct
+    for (int i=0; i<N_OBJECTS; i++) {
+        size_t size = sizeof(int) * (1 + i % 700);
+        for (size_t j=0; j<size/sizeof(int); j++) if (objects[i][j] != i) __atomic_fetch_add(errors, 1, __ATOMIC_RELAXED);
+    }
+    CALL(free_objects, 0, N_OBJECTS, errors);
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing LACE_ALLOC and lace_malloc with %u workers...\n", lace_workers());
+
+        // the second time, the stack is allocated but the first mark was taken before
+        for (int k=0; k<2; k++) {
+            int value;
+            if (RUN(tree, 16, &value) != (1<<17)-1 || value != 16) {
+                fprintf(stderr, "wrong allocation stack!\n");
+                return 1;
+            }
+        }
+
+        for (int k=0; k<3; k++) {
+            int errors = 0;
+            RUN(check_objects, &errors);
+            if (errors != 0) {
+                fprintf(stderr, "wrong objects!\n");
+                return 1;
+            }
+        }
+
+        // objects allocated outside Lace threads
+        void *p = lace_malloc(100);
+        memset(p, 1, 100);
+        if (((uintptr_t)p & 15) != 0) {
+            fprintf(stderr, "misaligned object!\n");
+            return 1;
+        }
+        lace_free(p);
+
+        lace_stop();
+    }
+
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+static atomic_int callbacks = 0;
+static atomic_int errors = 0;
+
+static void
+count_cb(lace_future_t *fut, void *arg)
+{
+    if (ASYNC_RESULT(pfib, fut) != 610) errors += 1;
+    if (arg != &callbacks) errors += 1;
+    callbacks += 1;
+}
+
+TASK_0(int, nested_async)
+{
+    // inside a Lace thread, the task is executed immediately
+    lace_future_t fut;
+    RUN_ASYNC(pfib, &fut, 15);
+    if (!lace_future_poll(&fut)) errors += 1;
+    lace_future_wait(&fut);
+    return ASYNC_RESULT(pfib, &fut);
+}
+
+#define N_FUTURES 100
+
+void
+runtests(int n_workers)
+{
+    lace_start(n_workers, 0);
+    printf("Testing RUN_ASYNC with %u workers...\n", lace_workers());
+
+    static lace_future_t futs[N_FUTURES];
+    callbacks = 0;
+    for (int i=0; i<N_FUTURES; i++) {
+        if (i%2) RUN_ASYNC_CB(pfib, &futs[i], count_cb, &callbacks, 15);
+        else RUN_ASYNC(pfib, &futs[i], 15);
+    }
+
+    // RUN still works while asynchronous tasks are in flight
+    if (RUN(pfib, 20) != 6765) errors += 1;
+
+    for (int i=0; i<N_FUTURES; i++) {
+        lace_future_wait(&futs[i]);
+        if (!lace_future_poll(&futs[i])) errors += 1;
+        if (ASYNC_RESULT(pfib, &futs[i]) != 610) errors += 1;
+    }
+
+    // callbacks run before completion, so all of them are done
+    if (callbacks != N_FUTURES/2) errors += 1;
+
+    // a future can be freed as soon as it is completed, also with a callback that reads it
+    for (int i=0; i<N_FUTURES; i++) {
+        lace_future_t *fut = (lace_future_t*)malloc(sizeof(lace_future_t));
+        RUN_ASYNC_CB(pfib, fut, count_cb, &callbacks, 15);
+        lace_future_wait(fut);
+        free(fut);
+    }
+    if (callbacks != N_FUTURES/2 + N_FUTURES) errors += 1;
+
+    if (RUN(nested_async) != 610) errors += 1;
+
+    lace_stop();
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    for (int i=1; i<=n_workers; i++) runtests(i);
+
+    if (errors != 0) {
+        fprintf(stderr, "%d errors!\n", (int)errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include <lace.h>
+
+#define ROUNDS 20
+
+static atomic_int arrived[ROUNDS];
+static atomic_int failed;
+
+/**
+ * Each worker arrives in every round and checks that all workers arrived before the barrier completed.
+ */
+VOID_TASK_0(phases)
+{
+    for (int r=0; r<ROUNDS; r++) {
+        atomic_fetch_add(&arrived[r], 1);
+        lace_barrier();
+        if (atomic_load(&arrived[r]) != (int)lace_workers()) atomic_store(&failed, 1);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 9; // three leaves and a root
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing the barrier with %u workers...\n", lace_workers());
+        for (int k=0; k<2; k++) {
+            for (int r=0; r<ROUNDS; r++) atomic_store(&arrived[r], 0);
+            TOGETHER(phases);
+            if (atomic_load(&failed)) {
+                fprintf(stderr, "barrier completed before all workers arrived!\n");
+                return 1;
+            }
+        }
+        lace_stop();
+    }
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include <lace.h>
+
+#if LACE_CANCEL
+static atomic_long visited;
+
+/**
+ * Search a binary tree of depth <depth> for the leaf with number <target>.
+ */
+TASK_3(int, search, long, node, int, depth, long, target)
+{
+    if (CANCELLED()) return 0;
+    if (depth == 0) {
+        atomic_fetch_add(&visited, 1);
+        if (node != target) return 0;
+        CANCEL();
+        return 1;
+    }
+    SPAWN(search, 2*node, depth-1, target);
+    int found = CALL(search, 2*node+1, depth-1, target);
+    return SYNC(search) + found;
+}
+
+/**
+ * Run the search in a scope, inside an outer scope that is cancelled first if <cancel_outer> is set.
+ */
+TASK_3(int, run_search, int, depth, long, target, int, cancel_outer)
+{
+    lace_scope_t outer, inner;
+    SCOPE_ENTER(&outer);
+    if (cancel_outer) CANCEL();
+    SCOPE_ENTER(&inner);
+    int found = CALL(search, 0, depth, target);
+    SCOPE_LEAVE();
+    SCOPE_LEAVE();
+    return found;
+}
+#endif
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+#if LACE_CANCEL
+    const int depth = 18;
+    const long leaves = 1L << depth;
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing cancellation with %u workers...\n", lace_workers());
+
+        // the last leaf is visited first by the owner, the first leaf last (unless it is stolen)
+        long targets[2] = { leaves-1, 0 };
+        for (int k=0; k<2; k++) {
+            atomic_store(&visited, 0);
+            int found = RUN(run_search, depth, targets[k], 0);
+            if (found != 1) {
+                fprintf(stderr, "found the target %d times!\n", found);
+                return 1;
+            }
+            if (k == 0 && i == 1 && atomic_load(&visited) != 1) {
+                fprintf(stderr, "visited %ld leaves after the first solution!\n", atomic_load(&visited)-1);
+                return 1;
+            }
+        }
+
+        // cancelling the outer scope also cancels the inner scope
+        atomic_store(&visited, 0);
+        if (RUN(run_search, depth, leaves-1, 1) != 0 || atomic_load(&visited) != 0) {
+            fprintf(stderr, "the inner scope was not cancelled!\n");
+            return 1;
+        }
+
+        lace_stop();
+    }
+#else
+    (void)n_workers;
+    printf("Lace is built without LACE_CANCEL.\n");
+    return 77; // skipped, see SKIP_RETURN_CODE in CMakeLists.txt
+#endif
+
+    return 0;
+}
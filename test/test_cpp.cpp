@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <lace.hpp>
+
+static int
+fib(lace::worker& w, int n)
+{
+    if (n < 2) return n;
+    auto h = w.spawn([n](lace::worker& w) { return fib(w, n-1); });
+    int k = fib(w, n-2);
+    return w.sync(h) + k;
+}
+
+/**
+ * A move-only functor, which is moved into the task deque without heap allocation.
+ */
+struct owned_sum
+{
+    std::unique_ptr<long> value;
+    int n;
+
+    long operator()(lace::worker& w);
+};
+
+long
+owned_sum::operator()(lace::worker& w)
+{
+    if (n == 0) return 0;
+    auto h = w.spawn(owned_sum{std::unique_ptr<long>(new long(n-1)), n-1});
+    return *value + w.sync(h);
+}
+
+/**
+ * A functor that is larger than LACE_TASKSIZE, which is stored in the overflow arena.
+ */
+struct big_sum
+{
+    long values[32];
+    int n;
+
+    long operator()(lace::worker& w)
+    {
+        if (n == 0) return 0;
+        big_sum next = *this;
+        next.n = n-1;
+        auto h = w.spawn(next);
+        return values[n % 32] + w.sync(h);
+    }
+};
+
+struct record
+{
+    int key;
+    int index;
+};
+
+/**
+ * Sort random numbers and records (stable), compared to the sequential order.
+ */
+static bool
+test_sort(size_t n)
+{
+    std::vector<long> v(n);
+    unsigned long x = 1;
+    for (size_t i=0; i<n; i++) v[i] = (long)((x = x * 6364136223846793005UL + 1442695040888963407UL) >> 33);
+    lace::sort_buffer<long> buf;
+    lace::sort(v.data(), v.data() + n, std::less<long>(), &buf);
+    for (size_t i=1; i<n; i++) if (v[i-1] > v[i]) return false;
+
+    std::vector<record> r(n);
+    for (size_t i=0; i<n; i++) r[i] = record{ (int)(v[(i * 7919) % n] % 100), (int)i };
+    lace::sort(r.data(), r.data() + n, [](const record& a, const record& b) { return a.key < b.key; });
+    for (size_t i=1; i<n; i++) {
+        if (r[i-1].key > r[i].key) return false;
+        if (r[i-1].key == r[i].key && r[i-1].index > r[i].index) return false;
+    }
+
+    // -0.0 and 0.0 are equal, so the sort keeps the zeros in their original order
+    // (64 elements, so the smallest ranges have 8 elements, the size of the sorting network for integers)
+    std::vector<double> d(64);
+    for (size_t i=0; i<64; i++) {
+        long k = v[(i * 7919) % n];
+        d[i] = k % 3 == 0 ? (double)(k % 100) : (k & 1) ? -0.0 : 0.0;
+    }
+    std::vector<double> e(d);
+    lace::sort(e.data(), e.data() + 64);
+    size_t z = 0;
+    for (size_t i=0; i<64; i++) {
+        if (d[i] != 0.0) continue;
+        while (e[z] != 0.0) z++;
+        if (std::signbit(e[z++]) != std::signbit(d[i])) return false;
+    }
+    return true;
+}
+
+static std::atomic<int> counter(0);
+
+/**
+ * Void tasks, drop and call.
+ */
+static void
+count(lace::worker& w, int n)
+{
+    if (n == 0) {
+        counter++;
+        return;
+    }
+    auto h1 = w.spawn([n](lace::worker& w) { count(w, n-1); });
+    auto h2 = w.spawn([n](lace::worker& w) { count(w, n-1); });
+    auto h3 = w.spawn([](lace::worker&) { return 1; });
+    w.drop(h3);
+    w.call([n](lace::worker& w) { count(w, n-1); });
+    w.sync(h2);
+    w.sync(h1);
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing the C++ front-end with %u workers...\n", lace_workers());
+
+        if (lace::run(fib, 25) != 75025) {
+            fprintf(stderr, "wrong result for fib!\n");
+            return 1;
+        }
+
+        long res = lace::run([](lace::worker& w) { return owned_sum{std::unique_ptr<long>(new long(1000)), 1000}(w); });
+        if (res != 500500) {
+            fprintf(stderr, "wrong result for owned_sum!\n");
+            return 1;
+        }
+
+        res = lace::run([](lace::worker& w) {
+            big_sum b;
+            for (int k=0; k<32; k++) b.values[k] = k;
+            b.n = 1000;
+            return b(w);
+        });
+        if (res != 15412) { // the sum of n % 32 for n in 1..1000
+            fprintf(stderr, "wrong result for big_sum!\n");
+            return 1;
+        }
+
+        if (!test_sort(100) || !test_sort(100000)) {
+            fprintf(stderr, "wrong result for sort!\n");
+            return 1;
+        }
+
+        counter = 0;
+        lace::run(count, 10);
+        if (counter != 59049) { // 3^10
+            fprintf(stderr, "wrong result for count!\n");
+            return 1;
+        }
+
+        lace_stop();
+    }
+
+    return 0;
+}
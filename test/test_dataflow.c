@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include <lace.h>
+
+#define N 24
+
+static int64_t grid[N][N];
+static lace_future_t futs[N][N];
+static atomic_int errors = 0;
+
+// a cell of the wavefront depends on the cells above and to the left
+TASK_2(int64_t, cell, int, i, int, j)
+{
+    if (i == 0 || j == 0) return grid[i][j] = 1;
+    // the prerequisites must be completed before the task runs
+    if (!lace_future_poll(&futs[i-1][j]) || !lace_future_poll(&futs[i][j-1])) errors += 1;
+    return grid[i][j] = (grid[i-1][j] + grid[i][j-1]) % 1000000007;
+}
+
+static void
+wavefront(void)
+{
+    for (int i=0; i<N; i++) {
+        for (int j=0; j<N; j++) {
+            lace_future_t *deps[2];
+            unsigned int n = 0;
+            if (i > 0) deps[n++] = &futs[i-1][j];
+            if (j > 0) deps[n++] = &futs[i][j-1];
+            DATAFLOW(cell, &futs[i][j], deps, n, i, j);
+        }
+    }
+}
+
+static int64_t
+expected(int i, int j)
+{
+    static int64_t seq[N][N];
+    for (int x=0; x<=i; x++) {
+        for (int y=0; y<=j; y++) {
+            seq[x][y] = (x == 0 || y == 0) ? 1 : (seq[x-1][y] + seq[x][y-1]) % 1000000007;
+        }
+    }
+    return seq[i][j];
+}
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    SPAWN(pfib, n-1);
+    int k = CALL(pfib, n-2);
+    return SYNC(pfib) + k;
+}
+
+TASK_1(int, in_pool, lace_pool_t*, pool)
+{
+    return lace_get_pool() == pool;
+}
+
+TASK_2(int, add, lace_future_t*, a, lace_future_t*, b)
+{
+    return ASYNC_RESULT(pfib, a) + ASYNC_RESULT(pfib, b);
+}
+
+TASK_0(int, nested_dataflow)
+{
+    // inside a Lace thread, with prerequisites that are already completed
+    lace_future_t a, b, c;
+    RUN_ASYNC(pfib, &a, 15);
+    RUN_ASYNC(pfib, &b, 16);
+    lace_future_t *deps[2] = { &a, &b };
+    DATAFLOW(add, &c, deps, 2, &a, &b);
+    lace_future_wait(&c);
+    return ASYNC_RESULT(add, &c);
+}
+
+VOID_TASK_0(nested_wavefront)
+{
+    wavefront();
+    lace_future_wait(&futs[N-1][N-1]);
+}
+
+void
+runtests(int n_workers)
+{
+    lace_start(n_workers, 0);
+    printf("Testing DATAFLOW with %u workers...\n", lace_workers());
+
+    // submitted from outside Lace; only the last cell is awaited, the others complete before it
+    wavefront();
+    lace_future_wait(&futs[N-1][N-1]);
+    if (ASYNC_RESULT(cell, &futs[N-1][N-1]) != expected(N-1, N-1)) errors += 1;
+    for (int i=0; i<N; i++) {
+        for (int j=0; j<N; j++) {
+            if (!lace_future_poll(&futs[i][j])) errors += 1;
+        }
+    }
+
+    // submitted from inside a task
+    RUN(nested_wavefront);
+    if (ASYNC_RESULT(cell, &futs[N-1][N-1]) != expected(N-1, N-1)) errors += 1;
+
+    // prerequisites that are completed before DATAFLOW, and no prerequisites at all
+    if (RUN(nested_dataflow) != 610 + 987) errors += 1;
+    lace_future_t a, b;
+    RUN_ASYNC(pfib, &a, 20);
+    lace_future_wait(&a);
+    lace_future_t *deps[1] = { &a };
+    DATAFLOW(add, &b, deps, 1, &a, &a);
+    lace_future_wait(&b);
+    if (ASYNC_RESULT(add, &b) != 2 * 6765) errors += 1;
+    DATAFLOW(pfib, &b, NULL, 0, 20);
+    lace_future_wait(&b);
+    if (ASYNC_RESULT(pfib, &b) != 6765) errors += 1;
+
+    lace_stop();
+}
+
+// a prerequisite in the default pool releases a dataflow task of a second pool
+void
+runpools(int n_workers)
+{
+    lace_pool_t *pool = lace_pool_create();
+    lace_set_pool(pool);
+    lace_start(n_workers, 0);
+    lace_set_pool(NULL);
+    lace_start(n_workers, 0);
+    printf("Testing DATAFLOW across two pools with %u workers...\n", lace_workers());
+
+    lace_future_t a, b;
+    RUN_ASYNC(pfib, &a, 20);
+    lace_future_t *deps[1] = { &a };
+    lace_set_pool(pool);
+    DATAFLOW(in_pool, &b, deps, 1, pool);
+    lace_future_wait(&b);
+    if (ASYNC_RESULT(in_pool, &b) != 1) errors += 1;
+    lace_stop();
+    lace_set_pool(NULL);
+    lace_future_wait(&a);
+    lace_stop();
+    lace_pool_destroy(pool);
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    for (int i=1; i<=n_workers; i++) runtests(i);
+    runpools(n_workers);
+
+    if (errors != 0) {
+        fprintf(stderr, "%d errors!\n", (int)errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lace.h>
+
+TASK_1(int, leaf, int, n)
+{
+    return n;
+}
+
+/**
+ * Spawn 8 tasks at each level of a deep recursion, so the deque holds 8 tasks per level.
+ */
+TASK_1(int, deep, int, n)
+{
+    if (n == 0) return 0;
+    for (int i=0; i<8; i++) SPAWN(leaf, 1);
+    int res = CALL(deep, n-1);
+    for (int i=0; i<8; i++) res += SYNC(leaf);
+    return res;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+#if LACE_USE_MMAP
+    for (int i=1; i<=n_workers; i++) {
+        // start with a tiny deque, which must grow to hold 40000 tasks
+        lace_start(i, 16);
+        printf("Testing deque growth with %u workers...\n", lace_workers());
+        for (int k=0; k<3; k++) {
+            int res = RUN(deep, 5000);
+            if (res != 40000) {
+                fprintf(stderr, "wrong result %d!\n", res);
+                return 1;
+            }
+        }
+        lace_stop();
+    }
+#else
+    (void)n_workers;
+    printf("Lace does not use mmap, the task deque cannot grow.\n");
+#endif
+
+    return 0;
+}
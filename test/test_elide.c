@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sched.h>
+
+#include <lace.h>
+
+TASK_ELIDABLE_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN_ELIDABLE(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+// mixes SPAWN_ELIDABLE and SPAWN, with several tasks in flight
+VOID_TASK_ELIDABLE_2(tree, int, d, long*, sum)
+{
+    if (d == 0) {
+        __atomic_fetch_add(sum, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    SPAWN_ELIDABLE(tree, d-1, sum);
+    SPAWN(tree, d-1, sum);
+    SPAWN_ELIDABLE(tree, d-1, sum);
+    SYNC(tree);
+    SYNC(tree);
+    SYNC(tree);
+}
+
+// the elided tasks become shared when a thief asks for work while they are still in the deque
+TASK_1(long, slow, long, n)
+{
+    long s = 0;
+    for (long i=0; i<n; i++) {
+        s += i;
+        if (i % 1000 == 0) sched_yield();
+    }
+    return s;
+}
+
+TASK_ELIDABLE_1(long, deep, int, d)
+{
+    if (d == 0) return CALL(slow, 10000);
+    SPAWN_ELIDABLE(deep, d-1);
+    SPAWN_ELIDABLE(deep, d-1);
+    long a = SYNC(deep);
+    return a + SYNC(deep);
+}
+
+TASK_ELIDABLE_1(long, quick, long, x)
+{
+    return x;
+}
+
+// an elided slot that is made shared and stolen must be a no-op for the thief
+TASK_0(long, steal_elided)
+{
+    for (long i=0; i<LACE_ELIDE_DEPTH+1; i++) SPAWN(quick, i);
+    SPAWN_ELIDABLE(quick, 1000);
+    Task *slot = __lace_dq_head - 1;
+    int elided = slot->f == &lace_task_elided;
+    LACE_MAKE_ALL_SHARED();
+    if (lace_workers() > 1) {
+        for (int k=0; k<100000 && !TASK_IS_STOLEN(slot); k++) sched_yield();
+    }
+    long s = SYNC(quick);
+    if (elided && s != 1000) return -1;
+    for (long i=0; i<LACE_ELIDE_DEPTH+1; i++) s += SYNC(quick);
+    return s;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing SPAWN_ELIDABLE with %u workers...\n", lace_workers());
+
+        for (int k=0; k<10; k++) {
+            if (RUN(pfib, 25) != 75025) {
+                fprintf(stderr, "wrong result for pfib!\n");
+                return 1;
+            }
+            long sum = 0;
+            RUN(tree, 10, &sum);
+            if (sum != 59049) {
+                fprintf(stderr, "wrong result for tree: %ld!\n", sum);
+                return 1;
+            }
+        }
+        const long expect = 1000 + LACE_ELIDE_DEPTH * (LACE_ELIDE_DEPTH + 1) / 2;
+        for (int k=0; k<100; k++) {
+            if (RUN(steal_elided) != expect) {
+                fprintf(stderr, "wrong result for steal_elided!\n");
+                return 1;
+            }
+        }
+        if (RUN(deep, 12) != 4096L * 49995000L) {
+            fprintf(stderr, "wrong result for deep!\n");
+            return 1;
+        }
+
+        lace_stop();
+    }
+
+    return 0;
+}
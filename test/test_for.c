@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lace.h>
+
+#define N 100000
+
+LACE_FOR_1(fill, i, long*, arr)
+{
+    arr[i] = (long)i * 2;
+}
+
+#define ADD(a, b) ((a) + (b))
+
+LACE_REDUCE_1(long, sum, i, 0, ADD, long*, arr)
+{
+    return arr[i];
+}
+
+/**
+ * A non-commutative reduction: the combined range must be contiguous and in order.
+ */
+typedef struct { long first, last; int ok; } range_t;
+
+static range_t
+concat(range_t a, range_t b)
+{
+    if (a.first == -1) return b;
+    if (b.first == -1) return a;
+    return (range_t){ a.first, b.last, a.ok && b.ok && a.last + 1 == b.first };
+}
+
+static const range_t empty = { -1, -1, 1 };
+
+LACE_REDUCE_0(range_t, ordered, i, empty, concat)
+{
+    return (range_t){ (long)i, (long)i, 1 };
+}
+
+/**
+ * Nested loops: the body of a loop can run other loops.
+ */
+LACE_REDUCE_1(long, inner, j, 0, ADD, size_t, row)
+{
+    return (long)(row * j);
+}
+
+LACE_REDUCE_1(long, outer, i, 0, ADD, size_t, n)
+{
+    return CALL(inner, 0, n, i);
+}
+
+/**
+ * The same loops, run work-first: thieves steal the rest of the loop.
+ */
+LACE_WF_FOR_1(wf_fill, i, long*, arr)
+{
+    arr[i] = (long)i * 3;
+}
+
+LACE_WF_REDUCE_1(long, wf_sum, i, 0, ADD, long*, arr)
+{
+    return arr[i];
+}
+
+LACE_WF_REDUCE_0(range_t, wf_ordered, i, empty, concat)
+{
+    return (range_t){ (long)i, (long)i, 1 };
+}
+
+LACE_WF_REDUCE_1(long, wf_inner, j, 0, ADD, size_t, row)
+{
+    return (long)(row * j);
+}
+
+LACE_WF_REDUCE_1(long, wf_outer, i, 0, ADD, size_t, n)
+{
+    return CALL(wf_inner, 0, n, i);
+}
+
+TASK_0(int, run_loops)
+{
+    long *arr = malloc(sizeof(long) * N);
+    int errors = 0;
+
+    CALL(fill, 0, N, arr);
+    for (long i=0; i<N; i++) if (arr[i] != i*2) errors++;
+
+    if (CALL(sum, 0, N, arr) != (long)N * (N-1)) errors++;
+    if (CALL(sum, 10, 10, arr) != 0) errors++; // empty range
+
+    range_t r = CALL(ordered, 0, N);
+    if (!r.ok || r.first != 0 || r.last != N-1) errors++;
+
+    // sum of i*j for i,j < 500 is (500*499/2)^2
+    if (CALL(outer, 0, 500, 500) != 124750L*124750L) errors++;
+
+    CALL(wf_fill, 0, N, arr);
+    for (long i=0; i<N; i++) if (arr[i] != i*3) errors++;
+
+    if (CALL(wf_sum, 0, N, arr) != (long)N * (N-1) / 2 * 3) errors++;
+    if (CALL(wf_sum, 10, 10, arr) != 0) errors++; // empty range
+
+    r = CALL(wf_ordered, 0, N);
+    if (!r.ok || r.first != 0 || r.last != N-1) errors++;
+
+    if (CALL(wf_outer, 0, 500, 500) != 124750L*124750L) errors++;
+
+    free(arr);
+    return errors;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing LACE_FOR, LACE_REDUCE and their work-first variants with %u workers...\n", lace_workers());
+        for (int k=0; k<5; k++) {
+            if (RUN(run_loops) != 0) {
+                fprintf(stderr, "wrong results!\n");
+                return 1;
+            }
+        }
+        lace_stop();
+    }
+
+    return 0;
+}
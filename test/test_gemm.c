@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <lace.h>
+
+static unsigned long rng = 1;
+
+static double
+next(void)
+{
+    rng = rng * 6364136223846793005UL + 1442695040888963407UL;
+    return (double)(long)(rng >> 54) / 64.0 - 8.0;
+}
+
+// C = alpha * A * B + beta * C with the naive triple loop
+static void
+naive(size_t m, size_t n, size_t k, double alpha, const double *A, size_t lda, const double *B, size_t ldb,
+      double beta, double *C, size_t ldc)
+{
+    for (size_t i=0; i<m; i++) {
+        for (size_t j=0; j<n; j++) {
+            double s = 0;
+            for (size_t p=0; p<k; p++) s += A[i * lda + p] * B[p * ldb + j];
+            C[i * ldc + j] = alpha * s + (beta == 0 ? 0 : beta * C[i * ldc + j]);
+        }
+    }
+}
+
+static int
+test_dgemm(size_t m, size_t n, size_t k, double alpha, double beta)
+{
+    // use row strides larger than the matrices to check that lda, ldb and ldc are respected
+    size_t lda = k + 3, ldb = n + 5, ldc = n + 1;
+    double *A = (double*)malloc(sizeof(double) * (m * lda + 1));
+    double *B = (double*)malloc(sizeof(double) * (k * ldb + 1));
+    double *C = (double*)malloc(sizeof(double) * (m * ldc + 1));
+    double *D = (double*)malloc(sizeof(double) * (m * ldc + 1));
+    for (size_t i=0; i<m * lda; i++) A[i] = next();
+    for (size_t i=0; i<k * ldb; i++) B[i] = next();
+    for (size_t i=0; i<m * ldc; i++) C[i] = D[i] = beta == 0 ? NAN : next();
+
+    lace_dgemm(m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+    naive(m, n, k, alpha, A, lda, B, ldb, beta, D, ldc);
+
+    int ok = 1;
+    for (size_t i=0; i<m; i++) {
+        for (size_t j=0; j<n; j++) {
+            double x = C[i * ldc + j], y = D[i * ldc + j];
+            if (!(fabs(x - y) <= 1e-9 * (1 + fabs(y)))) ok = 0;
+        }
+        // padding between rows is not touched
+        for (size_t j=n; j<ldc; j++) if (!(C[i * ldc + j] == D[i * ldc + j] || beta == 0)) ok = 0;
+    }
+    if (!ok) fprintf(stderr, "dgemm %zux%zux%zu alpha=%g beta=%g failed\n", m, n, k, alpha, beta);
+    free(A);
+    free(B);
+    free(C);
+    free(D);
+    return ok;
+}
+
+static int
+test_sgemm(size_t n)
+{
+    float *A = (float*)malloc(sizeof(float) * n * n);
+    float *B = (float*)malloc(sizeof(float) * n * n);
+    float *C = (float*)malloc(sizeof(float) * n * n);
+    // A is a permutation matrix, so C is exactly a permutation of the rows of B
+    for (size_t i=0; i<n * n; i++) A[i] = 0;
+    for (size_t i=0; i<n; i++) A[i * n + (i * 7 + 3) % n] = 1;
+    for (size_t i=0; i<n * n; i++) B[i] = (float)(i % 1000);
+
+    lace_sgemm(n, n, n, 1, A, n, B, n, 0, C, n);
+
+    int ok = 1;
+    for (size_t i=0; i<n; i++) {
+        size_t r = (i * 7 + 3) % n;
+        for (size_t j=0; j<n; j++) if (C[i * n + j] != B[r * n + j]) ok = 0;
+    }
+    if (!ok) fprintf(stderr, "sgemm %zu failed\n", n);
+    free(A);
+    free(B);
+    free(C);
+    return ok;
+}
+
+TASK_0(int, gemm_inside)
+{
+    // lace_dgemm from inside a task
+    return test_dgemm(100, 90, 80, 1, 0);
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing lace_dgemm and lace_sgemm with %u workers...\n", lace_workers());
+
+        int ok = 1;
+        ok &= test_dgemm(1, 1, 1, 1, 0);
+        ok &= test_dgemm(3, 5, 7, 2, 0.5);
+        ok &= test_dgemm(64, 64, 256, 1, 1);
+        ok &= test_dgemm(65, 129, 257, -1, 0);
+        ok &= test_dgemm(200, 37, 600, 0.5, -2);
+        ok &= test_dgemm(37, 300, 19, 1, 0);
+        ok &= test_dgemm(50, 60, 0, 1, 3);
+        ok &= test_dgemm(0, 10, 10, 1, 0);
+        ok &= test_sgemm(301);
+        ok &= RUN(gemm_inside);
+        if (!ok) return 1;
+
+        lace_stop();
+    }
+
+    return 0;
+}
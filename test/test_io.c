@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <lace.h>
+
+static atomic_int errors = 0;
+
+static double
+wctime(void)
+{
+    struct timespec tv;
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+    return tv.tv_sec + 1E-9 * tv.tv_nsec;
+}
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    SPAWN(pfib, n-1);
+    int k = CALL(pfib, n-2);
+    return SYNC(pfib) + k;
+}
+
+TASK_1(int, read_byte, int, fd)
+{
+    char c = 0;
+    if (read(fd, &c, 1) != 1) errors += 1;
+    return c;
+}
+
+// waits for the pipe inside a worker; the worker runs other tasks meanwhile
+TASK_1(int, wait_pipe, int, fd)
+{
+    if (!(lace_io_wait(fd, POLLIN, -1) & POLLIN)) errors += 1;
+    return CALL(read_byte, fd);
+}
+
+TASK_1(int, in_pool, lace_pool_t*, pool)
+{
+    return lace_get_pool() == pool;
+}
+
+TASK_0(int, sleep_task)
+{
+    double t = wctime();
+    lace_sleep(5000000);
+    return wctime() - t >= 0.005;
+}
+
+void
+runtests(int n_workers)
+{
+    lace_start(n_workers, 0);
+    printf("Testing lace_io with %u workers...\n", lace_workers());
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        errors += 1;
+        return;
+    }
+
+    // timers, outside and inside Lace
+    double t = wctime();
+    lace_sleep(2000000);
+    if (wctime() - t < 0.002) errors += 1;
+    if (!RUN(sleep_task)) errors += 1;
+
+    // timeout without events
+    if (lace_io_wait(fds[0], POLLIN, 1000000) != 0) errors += 1;
+
+    // a file descriptor that is ready already
+    if (!(lace_io_wait(fds[1], POLLOUT, -1) & POLLOUT)) errors += 1;
+
+    // a dataflow task after an I/O future
+    lace_io_t io;
+    lace_future_t fut;
+    lace_io_submit(&io, fds[0], POLLIN, -1);
+    lace_future_t *deps[1] = { &io.fut };
+    DATAFLOW(read_byte, &fut, deps, 1, fds[0]);
+    if (write(fds[1], "a", 1) != 1) errors += 1;
+    lace_future_wait(&fut);
+    if (ASYNC_RESULT(read_byte, &fut) != 'a') errors += 1;
+
+    // while a task waits for the pipe, its worker (even the only one) runs other tasks
+    lace_future_t waiter, work;
+    RUN_ASYNC(wait_pipe, &waiter, fds[0]);
+    lace_sleep(1000000);
+    RUN_ASYNC(pfib, &work, 20);
+    lace_future_wait(&work);
+    if (ASYNC_RESULT(pfib, &work) != 6765) errors += 1;
+    if (lace_future_poll(&waiter)) errors += 1;
+    if (write(fds[1], "b", 1) != 1) errors += 1;
+    lace_future_wait(&waiter);
+    if (ASYNC_RESULT(wait_pipe, &waiter) != 'b') errors += 1;
+
+    close(fds[0]);
+    close(fds[1]);
+    lace_stop();
+}
+
+// the I/O thread offers a dataflow task to the pool that created it, not to the default pool
+void
+runpool(int n_workers)
+{
+    lace_pool_t *pool = lace_pool_create();
+    lace_set_pool(pool);
+    lace_start(n_workers, 0);
+    printf("Testing lace_io in a second pool with %u workers...\n", lace_workers());
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        errors += 1;
+        return;
+    }
+
+    lace_io_t io;
+    lace_future_t fut;
+    lace_io_submit(&io, fds[0], POLLIN, -1);
+    lace_future_t *deps[1] = { &io.fut };
+    DATAFLOW(in_pool, &fut, deps, 1, pool);
+    if (write(fds[1], "c", 1) != 1) errors += 1;
+    lace_future_wait(&fut);
+    if (ASYNC_RESULT(in_pool, &fut) != 1) errors += 1;
+
+    close(fds[0]);
+    close(fds[1]);
+    lace_stop();
+    lace_set_pool(NULL);
+    lace_pool_destroy(pool);
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    for (int i=1; i<=n_workers; i++) runtests(i);
+    runpool(n_workers);
+
+    if (errors != 0) {
+        fprintf(stderr, "%d errors!\n", (int)errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lace.h>
+
+// without the cache, this takes fib(n) calls
+TASK_1(long, mfib, int, n)
+{
+    if (n < 2) return n;
+    long a = CALL_MEMO(mfib, n-1);
+    long b = CALL_MEMO(mfib, n-2);
+    return a + b;
+}
+
+// binomial coefficients, with two arguments and a double result
+TASK_2(double, binom, int, n, int, k)
+{
+    if (k == 0 || k == n) return 1.0;
+    return CALL_MEMO(binom, n-1, k-1) + CALL_MEMO(binom, n-1, k);
+}
+
+// lattice paths in parallel, checking the cache before spawning
+TASK_2(long, paths, int, x, int, y)
+{
+    if (x == 0 || y == 0) return 1;
+    uint64_t key[LACE_CACHE_KEY] = { (uint64_t)x, (uint64_t)y, 0, 0 };
+    uint64_t res;
+    if (LACE_CACHE_GET((uint64_t)(uintptr_t)&paths_WRAP, key, &res)) return (long)res;
+    SPAWN(paths, x-1, y);
+    long a = CALL(paths, x, y-1);
+    long b = SYNC(paths);
+    LACE_CACHE_PUT((uint64_t)(uintptr_t)&paths_WRAP, key, (uint64_t)(a + b));
+    return a + b;
+}
+
+// clears the cache while a thief may be using it for the spawned task
+TASK_0(int, clear_while_used)
+{
+    SPAWN(paths, 12, 12);
+    lace_cache_clear();
+    long b = CALL(paths, 11, 13);
+    long a = SYNC(paths);
+    return a == 2704156 && b == 2496144;
+}
+
+static int calls = 0;
+
+TASK_1(long, counted, long, x)
+{
+    calls++;
+    return x * 2;
+}
+
+// 40 bytes of arguments do not fit in the key, so this is always executed
+TASK_5(long, counted5, long, a, long, b, long, c, long, d, long, e)
+{
+    calls++;
+    return a + b + c + d + e;
+}
+
+TASK_0(int, test_counted)
+{
+    calls = 0;
+    if (CALL_MEMO(counted, 21) != 42 || CALL_MEMO(counted, 21) != 42) return 0;
+    int expect = __lace_worker->cache != NULL ? 1 : 2;
+    if (calls != expect) return 0;
+    lace_cache_clear();
+    if (CALL_MEMO(counted, 21) != 42 || calls != expect + 1) return 0;
+    calls = 0;
+    if (CALL_MEMO(counted5, 1, 2, 3, 4, 5) != 15 || CALL_MEMO(counted5, 1, 2, 3, 4, 5) != 15) return 0;
+    return calls == 2;
+}
+
+static int
+test(void)
+{
+    if (RUN(mfib, 90) != 2880067194370816120L) {
+        fprintf(stderr, "wrong result for mfib!\n");
+        return 0;
+    }
+    if (RUN(binom, 60, 30) != 118264581564861424.0) {
+        fprintf(stderr, "wrong result for binom!\n");
+        return 0;
+    }
+    if (RUN(paths, 12, 12) != 2704156) {
+        fprintf(stderr, "wrong result for paths!\n");
+        return 0;
+    }
+    if (!RUN(clear_while_used)) {
+        fprintf(stderr, "wrong result while clearing the cache!\n");
+        return 0;
+    }
+    if (!RUN(test_counted)) {
+        fprintf(stderr, "wrong number of calls!\n");
+        return 0;
+    }
+    return 1;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    lace_set_cache_size(1 << 16);
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing the operation cache with %u workers...\n", lace_workers());
+        if (!test()) return 1;
+        lace_stop();
+    }
+
+    // without a cache, CALL_MEMO just calls the task (paths and mfib would take too long)
+    lace_set_cache_size(0);
+    lace_start(n_workers, 0);
+    printf("Testing without the operation cache...\n");
+    if (RUN(binom, 20, 10) != 184756.0 || !RUN(test_counted)) {
+        fprintf(stderr, "wrong result without the cache!\n");
+        return 1;
+    }
+    lace_stop();
+
+    return 0;
+}
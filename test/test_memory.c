@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+TASK_1(long, leaf, long, i)
+{
+    return i;
+}
+
+/**
+ * Spawn <n> tasks at once, so the deque grows beyond its initial size.
+ */
+TASK_1(long, wide, long, n)
+{
+    for (long i=0; i<n; i++) SPAWN(leaf, i);
+    long sum = 0;
+    for (long i=0; i<n; i++) sum += SYNC(leaf);
+    return sum;
+}
+
+static int
+run_all(void)
+{
+    if (RUN(pfib, 25) != 75025) {
+        fprintf(stderr, "wrong result for pfib!\n");
+        return 1;
+    }
+    const long n = 100000;
+    if (RUN(wide, n) != n*(n-1)/2) {
+        fprintf(stderr, "wrong result for wide!\n");
+        return 1;
+    }
+    return 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    const int policies[3] = { LACE_HUGE_PAGES_NONE, LACE_HUGE_PAGES_TRANSPARENT, LACE_HUGE_PAGES_EXPLICIT };
+
+    lace_set_release_memory(1);
+    for (int p=0; p<3; p++) {
+        lace_set_huge_pages(policies[p]);
+#if LACE_USE_MMAP
+        // with explicit huge pages, the deques do not grow, so they must fit all tasks of wide
+        size_t dqsize = policies[p] == LACE_HUGE_PAGES_EXPLICIT ? 1<<17 : 1024;
+#else
+        // without mmap, the deques do not grow
+        size_t dqsize = 1<<17;
+#endif
+        lace_start(n_workers, dqsize);
+        printf("Testing huge page policy %d with %u workers...\n", policies[p], lace_workers());
+        if (run_all()) return 1;
+        // the released memory is mapped again when the workers continue
+        lace_suspend();
+        lace_resume();
+        if (run_all()) return 1;
+        lace_stop();
+    }
+
+    return 0;
+}
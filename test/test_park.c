@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+VOID_TASK_0(test_together)
+{
+    lace_barrier();
+}
+
+static void
+idle(void)
+{
+    // give the workers time to go through spin and yield and park
+    struct timespec ts = { 0, 50*1000*1000 };
+    nanosleep(&ts, NULL);
+}
+
+static void
+check(int res)
+{
+    if (res != 6765) {
+        fprintf(stderr, "wrong result: %d\n", res);
+        exit(1);
+    }
+}
+
+void
+runtests(int n_workers)
+{
+    lace_start(n_workers, 0);
+    printf("Testing parking with %u workers...\n", lace_workers());
+
+    for (int i=0; i<5; i++) {
+        idle();
+        check(RUN(pfib, 20));
+        idle();
+        TOGETHER(test_together);
+        idle();
+        check(NEWFRAME(pfib, 20));
+        idle();
+        lace_suspend();
+        lace_resume();
+    }
+
+    idle();
+    lace_stop();
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    // park after only a few failed steal attempts
+    lace_set_backoff(100, 10);
+
+    for (int i=1; i<=n_workers; i++) {
+        runtests(i);
+    }
+
+    return 0;
+}
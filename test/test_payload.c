@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lace.h>
+
+/**
+ * A task argument and result that does not fit in a Task, so it is stored in the overflow arena.
+ */
+typedef struct {
+    long v[16];
+} vec_t;
+
+TASK_1(int, leaf, int, n)
+{
+    return n;
+}
+
+/**
+ * Sum <a> over all leaves of a binary tree of depth <depth>, adding 1 to each element at each right branch.
+ * Small tasks are spawned and dropped in between, so tasks in the arena and in the deque are interleaved.
+ */
+TASK_2(vec_t, vsum, vec_t, a, int, depth)
+{
+    if (depth == 0) return a;
+    vec_t b = a;
+    for (int i=0; i<16; i++) b.v[i] += 1;
+    SPAWN(vsum, b, depth-1);
+    SPAWN(leaf, 1);
+    DROP();
+    vec_t l = CALL(vsum, a, depth-1);
+    vec_t r = SYNC(vsum);
+    for (int i=0; i<16; i++) l.v[i] += r.v[i];
+    return l;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    const int depth = 14;
+    vec_t a;
+    for (int i=0; i<16; i++) a.v[i] = i;
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing tasks larger than LACE_TASKSIZE with %u workers...\n", lace_workers());
+        for (int k=0; k<3; k++) {
+            vec_t res = RUN(vsum, a, depth);
+            for (int j=0; j<16; j++) {
+                long expected = (a.v[j] << depth) + ((long)depth << (depth-1));
+                if (res.v[j] != expected) {
+                    fprintf(stderr, "wrong result %ld instead of %ld!\n", res.v[j], expected);
+                    return 1;
+                }
+            }
+        }
+        lace_stop();
+    }
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+/**
+ * Check that a task runs in the pool of the thread that started it.
+ */
+TASK_1(int, in_pool, lace_pool_t*, pool)
+{
+    return lace_get_pool() == pool ? 1 : 0;
+}
+
+typedef struct {
+    lace_pool_t *pool;
+    unsigned int n_workers;
+    int failed;
+} client_t;
+
+/**
+ * Each client thread starts and stops its own pool a few times, and runs tasks in it.
+ */
+static void*
+client(void *arg)
+{
+    client_t *c = (client_t*)arg;
+    lace_set_pool(c->pool);
+    for (int i=0; i<10; i++) {
+        lace_start(c->n_workers, 0);
+        if (lace_workers() != c->n_workers) c->failed = 1;
+        if (RUN(pfib, 20) != 6765) c->failed = 1;
+        if (RUN(in_pool, c->pool) != 1) c->failed = 1;
+        lace_stop();
+    }
+    return NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+    unsigned int n_workers = 2;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    printf("Testing two Lace pools with %u and %u workers...\n", n_workers, n_workers + 1);
+
+    client_t clients[2];
+    clients[0].pool = lace_pool_create();
+    clients[0].n_workers = n_workers;
+    clients[0].failed = 0;
+    clients[1].pool = lace_pool_create();
+    clients[1].n_workers = n_workers + 1;
+    clients[1].failed = 0;
+
+    // the second pool uses the cores after those of the first pool
+    lace_set_pool(clients[1].pool);
+    lace_set_first_core(n_workers);
+    lace_set_pool(NULL);
+
+    // meanwhile the default pool runs in the main thread
+    lace_start(1, 0);
+
+    pthread_t threads[2];
+    for (int i=0; i<2; i++) pthread_create(&threads[i], NULL, client, &clients[i]);
+
+    if (lace_get_pool() != lace_default_pool() || lace_workers() != 1) {
+        fprintf(stderr, "wrong pool in the main thread!\n");
+        return 1;
+    }
+    if (RUN(pfib, 20) != 6765 || RUN(in_pool, lace_default_pool()) != 1) {
+        fprintf(stderr, "wrong result in the default pool!\n");
+        return 1;
+    }
+
+    for (int i=0; i<2; i++) pthread_join(threads[i], NULL);
+    lace_stop();
+
+    for (int i=0; i<2; i++) {
+        if (clients[i].failed) {
+            fprintf(stderr, "wrong result in pool %d!\n", i);
+            return 1;
+        }
+    }
+
+    // a pool with warm restarts keeps its workers until it is destroyed
+    lace_set_pool(clients[0].pool);
+    lace_set_warm_restart(1);
+    lace_start(n_workers, 0);
+    if (RUN(pfib, 15) != 610) {
+        fprintf(stderr, "wrong result after selecting a pool again!\n");
+        return 1;
+    }
+    lace_stop();
+    lace_set_pool(NULL);
+
+    lace_pool_destroy(clients[0].pool);
+    lace_pool_destroy(clients[1].pool);
+
+    return 0;
+}
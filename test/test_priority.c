@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+static atomic_int stop = 0;
+
+/**
+ * A long background job that only ends when the main thread says so.
+ * It occupies one worker, but lets it run high-priority tasks with YIELD_NEWFRAME.
+ */
+TASK_0(int, background)
+{
+    while (atomic_load(&stop) == 0) YIELD_NEWFRAME();
+    return 1;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+        if (n_workers > 4) n_workers = 4;
+    }
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing RUNHI with %u workers...\n", lace_workers());
+
+        lace_future_t futs[4];
+        atomic_store(&stop, 0);
+        for (int k=0; k<i; k++) RUN_ASYNC(background, &futs[k]);
+
+        // all workers are busy with background jobs, which would block a normal RUN
+        for (int k=0; k<10; k++) {
+            if (RUNHI(pfib, 15) != 610) {
+                fprintf(stderr, "wrong result for pfib!\n");
+                return 1;
+            }
+        }
+
+        atomic_store(&stop, 1);
+        for (int k=0; k<i; k++) lace_future_wait(&futs[k]);
+
+        lace_stop();
+    }
+
+    return 0;
+}
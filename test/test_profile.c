@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+VOID_TASK_2(count_leaves, int, n, int*, leaves)
+{
+    if (n == 0) {
+        __atomic_fetch_add(leaves, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    SPAWN(count_leaves, n-1, leaves);
+    SPAWN(count_leaves, n-1, leaves);
+    SYNC(count_leaves);
+    SYNC(count_leaves);
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+#if LACE_PROFILE
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing the profile with %u workers...\n", lace_workers());
+
+        if (RUN(pfib, 20) != 6765) {
+            fprintf(stderr, "wrong result for pfib!\n");
+            return 1;
+        }
+        int leaves = 0;
+        RUN(count_leaves, 10, &leaves);
+
+        // pfib(20) runs 2*fib(21)-1 times (once by RUN), and spawns once for each of the fib(21)-1 inner calls
+        lace_profile_ctr c;
+        lace_profile_get(&pfib_TYPE, &c);
+        if (c.runs != 21891 || c.spawns != 10945 || c.inlined + c.stolen != c.spawns || c.ns == 0) {
+            fprintf(stderr, "wrong profile for pfib: %llu runs, %llu spawns, %llu inlined, %llu stolen!\n",
+                (unsigned long long)c.runs, (unsigned long long)c.spawns,
+                (unsigned long long)c.inlined, (unsigned long long)c.stolen);
+            return 1;
+        }
+        lace_profile_get(&count_leaves_TYPE, &c);
+        if (leaves != 1024 || c.runs != 2047 || c.spawns != 2046 || c.inlined + c.stolen != c.spawns) {
+            fprintf(stderr, "wrong profile for count_leaves!\n");
+            return 1;
+        }
+
+        FILE *f = tmpfile();
+        lace_profile_report(f);
+        long size = ftell(f);
+        rewind(f);
+        char *buf = (char*)calloc(size + 1, 1);
+        if (fread(buf, 1, size, f) != (size_t)size || strstr(buf, "pfib") == NULL || strstr(buf, "count_leaves") == NULL) {
+            fprintf(stderr, "wrong profile report!\n");
+            return 1;
+        }
+        free(buf);
+        fclose(f);
+
+        lace_profile_reset();
+        lace_profile_get(&pfib_TYPE, &c);
+        if (c.runs != 0 || c.ns != 0) {
+            fprintf(stderr, "profile not reset!\n");
+            return 1;
+        }
+
+        lace_stop();
+    }
+#else
+    (void)n_workers;
+    printf("Lace is built without LACE_PROFILE.\n");
+    return 77; // skipped, see SKIP_RETURN_CODE in CMakeLists.txt
+#endif
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+static double
+wctime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + 1E-9 * ts.tv_nsec);
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    printf("Testing warm restarts with up to %d workers...\n", n_workers);
+
+    lace_set_warm_restart(1);
+
+    // restart with a different number of workers each time, so the pool shrinks and grows
+    double t_begin = wctime();
+    for (int i=0; i<100; i++) {
+        unsigned int k = 1 + (i % n_workers);
+        lace_start(k, 0);
+        if (lace_workers() != k) {
+            fprintf(stderr, "wrong number of workers!\n");
+            return 1;
+        }
+        if (RUN(pfib, 15) != 610) {
+            fprintf(stderr, "wrong result for pfib with %u workers!\n", k);
+            return 1;
+        }
+        lace_stop();
+    }
+    printf("Time per warm start/stop: %f us\n", (wctime() - t_begin) * 1E4);
+
+    // a different deque size releases the pool and starts again
+    lace_start(n_workers, 2000);
+    if (RUN(pfib, 20) != 6765) {
+        fprintf(stderr, "wrong result for pfib after changing the deque size!\n");
+        return 1;
+    }
+    lace_stop();
+
+    // release the parked pool, then start again without warm restarts
+    lace_set_warm_restart(0);
+    lace_start(n_workers, 0);
+    if (RUN(pfib, 20) != 6765) {
+        fprintf(stderr, "wrong result for pfib after releasing the pool!\n");
+        return 1;
+    }
+    lace_stop();
+
+    return 0;
+}
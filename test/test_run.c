@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+static atomic_int in_exclusive = 0;
+static atomic_int in_shared = 0;
+static atomic_int errors = 0;
+
+TASK_1(int, shared_fib, int, n)
+{
+    in_shared += 1;
+    if (in_exclusive) errors += 1;
+    int res = CALL(pfib, n);
+    in_shared -= 1;
+    return res;
+}
+
+TASK_1(int, exclusive_fib, int, n)
+{
+    in_exclusive = 1;
+    if (in_shared) errors += 1;
+    int res = CALL(pfib, n);
+    in_exclusive = 0;
+    return res;
+}
+
+static void*
+submitter(void *arg)
+{
+    int id = (int)(size_t)arg;
+    for (int i=0; i<200; i++) {
+        int res = (id == 0 && i%10 == 0) ? RUNEX(exclusive_fib, 15) : RUN(shared_fib, 15);
+        if (res != 610) errors += 1;
+    }
+    return NULL;
+}
+
+void
+runtests(int n_workers, int n_threads)
+{
+    lace_start(n_workers, 0);
+    printf("Testing %d submitters with %u workers...\n", n_threads, lace_workers());
+
+    pthread_t threads[n_threads];
+    for (int i=0; i<n_threads; i++) pthread_create(&threads[i], NULL, submitter, (void*)(size_t)i);
+    for (int i=0; i<n_threads; i++) pthread_join(threads[i], NULL);
+
+    lace_stop();
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    for (int i=1; i<=n_workers; i++) {
+        runtests(i, 1);
+        runtests(i, 16);
+    }
+
+    if (errors != 0) {
+        fprintf(stderr, "%d errors!\n", (int)errors);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lace.h>
+
+typedef struct {
+    int key;
+    int index;
+    char payload[20];
+} record;
+
+static int
+cmp_long(const void *a, const void *b, void *arg)
+{
+    long x = *(const long*)a, y = *(const long*)b;
+    (void)arg;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static int
+cmp_key(const void *a, const void *b, void *arg)
+{
+    int x = ((const record*)a)->key, y = ((const record*)b)->key;
+    (*(int*)arg)++;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static unsigned long rng = 1;
+
+static long
+next(void)
+{
+    rng = rng * 6364136223846793005UL + 1442695040888963407UL;
+    return (long)(rng >> 33);
+}
+
+TASK_1(int, sort_inside, size_t, n)
+{
+    // lace_sort from inside a task
+    long *a = (long*)malloc(sizeof(long) * n);
+    for (size_t i=0; i<n; i++) a[i] = n - i;
+    lace_sort(a, n, sizeof(long), cmp_long, NULL, NULL);
+    int ok = 1;
+    for (size_t i=0; i<n; i++) if (a[i] != (long)(i + 1)) ok = 0;
+    free(a);
+    return ok;
+}
+
+static int
+test_longs(size_t n, lace_sort_buffer_t *buf)
+{
+    long *a = (long*)malloc(sizeof(long) * n);
+    long sum = 0;
+    for (size_t i=0; i<n; i++) sum += a[i] = next() % 1000000;
+    lace_sort(a, n, sizeof(long), cmp_long, NULL, buf);
+    int ok = 1;
+    for (size_t i=0; i<n; i++) {
+        if (i > 0 && a[i-1] > a[i]) ok = 0;
+        sum -= a[i];
+    }
+    free(a);
+    return ok && sum == 0;
+}
+
+static int
+test_records(size_t n)
+{
+    // few distinct keys, to check that the sort is stable
+    record *r = (record*)malloc(sizeof(record) * n);
+    for (size_t i=0; i<n; i++) {
+        r[i].key = next() % 50;
+        r[i].index = (int)i;
+    }
+    int calls = 0;
+    lace_sort(r, n, sizeof(record), cmp_key, &calls, NULL);
+    int ok = calls > 0 || n < 2;
+    for (size_t i=1; i<n; i++) {
+        if (r[i-1].key > r[i].key) ok = 0;
+        if (r[i-1].key == r[i].key && r[i-1].index > r[i].index) ok = 0;
+    }
+    free(r);
+    return ok;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    static const size_t sizes[] = { 0, 1, 2, 17, 2048, 2049, 10000, 1000000 };
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing lace_sort with %u workers...\n", lace_workers());
+
+        // the buffer is reused by all calls
+        lace_sort_buffer_t buf = { NULL, 0 };
+        for (size_t k=0; k<sizeof(sizes)/sizeof(sizes[0]); k++) {
+            if (!test_longs(sizes[k], &buf) || !test_records(sizes[k])) {
+                fprintf(stderr, "wrong result for %zu elements!\n", sizes[k]);
+                return 1;
+            }
+        }
+        lace_sort_buffer_free(&buf);
+
+        if (!RUN(sort_inside, 100000)) {
+            fprintf(stderr, "wrong result inside a task!\n");
+            return 1;
+        }
+
+        lace_stop();
+    }
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    lace_stats_t before[64], after[64];
+
+    for (int i=1; i<=n_workers && i<=64; i++) {
+        lace_start(i, 0);
+        printf("Testing worker statistics with %u workers...\n", lace_workers());
+
+        if (lace_stats_snapshot(before, 64) != lace_workers()) {
+            fprintf(stderr, "wrong number of workers!\n");
+            return 1;
+        }
+
+        for (int k=0; k<10; k++) {
+            if (RUN(pfib, 20) != 6765) {
+                fprintf(stderr, "wrong result for pfib!\n");
+                return 1;
+            }
+        }
+
+        lace_stats_snapshot(after, 64);
+        uint64_t busy = 0;
+        for (int w=0; w<i; w++) {
+            // all counters only increase
+            if (after[w].steals < before[w].steals || after[w].failed_steals < before[w].failed_steals ||
+                after[w].leaps < before[w].leaps || after[w].splits < before[w].splits ||
+                after[w].busy_ns < before[w].busy_ns || after[w].idle_ns < before[w].idle_ns) {
+                fprintf(stderr, "statistics of worker %d decreased!\n", w);
+                return 1;
+            }
+            busy += after[w].busy_ns - before[w].busy_ns;
+        }
+
+        // the RUN tasks are executed by the workers, so they must have been busy
+        if (busy == 0) {
+            fprintf(stderr, "workers were never busy!\n");
+            return 1;
+        }
+
+        lace_stop();
+    }
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lace.h>
+
+/**
+ * Wide fan-out: spawn <width> children per node, like uts2-lace
+ */
+TASK_2(long, fanout, int, depth, int, width)
+{
+    if (depth == 0) return 1;
+    for (int i=0; i<width; i++) SPAWN(fanout, depth-1, width);
+    long res = 1;
+    for (int i=0; i<width; i++) res += SYNC(fanout);
+    return res;
+}
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    lace_set_steal_half(1);
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing steal-half with %u workers...\n", lace_workers());
+        for (int k=0; k<5; k++) {
+            // 1 + 8 + 64 + ... + 8^6 nodes
+            if (RUN(fanout, 6, 8) != 299593) {
+                fprintf(stderr, "wrong result for fanout!\n");
+                return 1;
+            }
+            if (RUN(pfib, 25) != 75025) {
+                fprintf(stderr, "wrong result for pfib!\n");
+                return 1;
+            }
+        }
+        lace_stop();
+    }
+
+    return 0;
+}
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include <lace.h>
 
@@ -22,6 +24,19 @@ TASK_1(int, pfib, int, n)
     return m+k;
 }
 
+static atomic_int errors = 0;
+
+// RUN from other threads while the main thread suspends and resumes the workers
+static void*
+submitter(void *arg)
+{
+    (void)arg;
+    for (int i=0; i<200; i++) {
+        if (RUN(pfib, 15) != 610) errors += 1;
+    }
+    return NULL;
+}
+
 double wctime() 
 {
     struct timespec tv;
@@ -54,6 +69,14 @@ runtests(int n_workers)
 
     printf("Time suspend + resume avg: %f sec\n", time/10);
 
+    pthread_t threads[2];
+    for (int i=0; i<2; i++) pthread_create(&threads[i], NULL, submitter, NULL);
+    for (int i=0; i<100; i++) {
+        lace_suspend();
+        lace_resume();
+    }
+    for (int i=0; i<2; i++) pthread_join(threads[i], NULL);
+
     lace_stop();
 }
 
@@ -72,5 +95,10 @@ main (int argc, char *argv[])
         runtests(i);
     }
 
+    if (errors != 0) {
+        fprintf(stderr, "%d errors!\n", (int)errors);
+        return 1;
+    }
+
     return 0;
 }
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lace.h>
+
+TASK_1(int, pfib, int, n)
+{
+    if (n<2) return n;
+    int m,k;
+    SPAWN(pfib, n-1);
+    k = CALL(pfib, n-2);
+    m = SYNC(pfib);
+    return m+k;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+#if LACE_TRACE
+    // a small trace, so it wraps around
+    lace_set_trace_size(1000);
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing tracing with %u workers...\n", lace_workers());
+
+        if (RUN(pfib, 20) != 6765) {
+            fprintf(stderr, "wrong result for pfib!\n");
+            return 1;
+        }
+
+        lace_suspend();
+        FILE *f = tmpfile();
+        lace_trace_dump(f);
+        lace_resume();
+        lace_stop();
+
+        long size = ftell(f);
+        rewind(f);
+        char *buf = malloc(size+1);
+        if (fread(buf, 1, size, f) != (size_t)size) {
+            fprintf(stderr, "unable to read the trace!\n");
+            return 1;
+        }
+        buf[size] = 0;
+        fclose(f);
+
+        if (strncmp(buf, "{\"traceEvents\":[", 16) != 0 || strstr(buf, "\"name\":\"spawn\"") == NULL ||
+            strstr(buf, "\"name\":\"suspend\"") == NULL || strcmp(buf + size - 4, "\n]}\n") != 0) {
+            fprintf(stderr, "unexpected trace!\n");
+            return 1;
+        }
+        free(buf);
+    }
+#else
+    (void)n_workers;
+    printf("Lace is built without LACE_TRACE.\n");
+    return 77; // skipped, see SKIP_RETURN_CODE in CMakeLists.txt
+#endif
+
+    return 0;
+}
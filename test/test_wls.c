@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <lace.h>
+
+static lace_wls_t counter_slot, marker_slot;
+static lace_reducer_t sum, min, max, total, list;
+
+typedef struct {
+    lace_list_node_t node;
+    int value;
+} item_t;
+
+static item_t items[1000];
+
+// count the leaves in worker-local storage, and reduce their values
+VOID_TASK_2(visit, int, from, int, to)
+{
+    if (to - from == 1) {
+        (*LACE_WLS(int64_t, counter_slot))++;
+        *LACE_REDUCER_VIEW(int64_t, &sum) += from;
+        int64_t *mn = LACE_REDUCER_VIEW(int64_t, &min), *mx = LACE_REDUCER_VIEW(int64_t, &max);
+        if (from < *mn) *mn = from;
+        if (from > *mx) *mx = from;
+        *LACE_REDUCER_VIEW(double, &total) += 0.5;
+        items[from].value = from;
+        lace_list_append(LACE_REDUCER_VIEW(lace_list_t, &list), &items[from].node);
+        return;
+    }
+    int mid = (from + to) / 2;
+    SPAWN(visit, from, mid);
+    CALL(visit, mid, to);
+    SYNC(visit);
+}
+
+TASK_0(int, check_marker)
+{
+    // each worker has its own zero-initialized slot on its own cache line
+    int64_t *marker = LACE_WLS(int64_t, marker_slot);
+    if (*marker != 0 && *marker != LACE_WORKER_ID + 1) return 0;
+    *marker = LACE_WORKER_ID + 1;
+    return ((uintptr_t)marker % 64) == 0;
+}
+
+int
+main (int argc, char *argv[])
+{
+    int n_workers = 4;
+
+    if (argc > 1) {
+        n_workers = atoi(argv[1]);
+    }
+
+    counter_slot = lace_wls_register(sizeof(int64_t));
+    marker_slot = lace_wls_register(sizeof(int64_t));
+    if (marker_slot - counter_slot < 64) {
+        fprintf(stderr, "slots share a cache line!\n");
+        return 1;
+    }
+    lace_reducer_init_sum(&sum);
+    lace_reducer_init_min(&min);
+    lace_reducer_init_max(&max);
+    lace_reducer_init_sum_double(&total);
+    lace_reducer_init_list(&list);
+
+    for (int i=1; i<=n_workers; i++) {
+        lace_start(i, 0);
+        printf("Testing worker-local storage and reducers with %u workers...\n", lace_workers());
+
+        for (int k=0; k<10; k++) {
+            if (!RUN(check_marker)) {
+                fprintf(stderr, "wrong worker-local storage!\n");
+                return 1;
+            }
+        }
+
+        for (int k=0; k<3; k++) {
+            RUN(visit, 0, 1000);
+
+            int64_t count = 0;
+            for (unsigned int w=0; w<lace_workers(); w++) {
+                int64_t *c = (int64_t*)lace_wls_get(w, counter_slot);
+                if (c != NULL) {
+                    count += *c;
+                    *c = 0;
+                }
+            }
+            if (count != 1000) {
+                fprintf(stderr, "wrong count %lld!\n", (long long)count);
+                return 1;
+            }
+
+            int64_t s, mn, mx;
+            double t;
+            lace_list_t l;
+            lace_reducer_reduce(&sum, &s);
+            lace_reducer_reduce(&min, &mn);
+            lace_reducer_reduce(&max, &mx);
+            lace_reducer_reduce(&total, &t);
+            lace_reducer_reduce(&list, &l);
+            if (s != 999*1000/2 || mn != 0 || mx != 999 || t != 500.0) {
+                fprintf(stderr, "wrong reduction %lld %lld %lld %f!\n", (long long)s, (long long)mn, (long long)mx, t);
+                return 1;
+            }
+
+            // every item is in the list exactly once, in no particular order
+            static char seen[1000];
+            int n = 0;
+            for (int j=0; j<1000; j++) seen[j] = 0;
+            for (lace_list_node_t *node = l.head; node != NULL; node = node->next) {
+                int v = ((item_t*)node)->value;
+                if (seen[v]++) {
+                    fprintf(stderr, "item %d appears twice!\n", v);
+                    return 1;
+                }
+                n++;
+            }
+            if (n != 1000) {
+                fprintf(stderr, "wrong list length %d!\n", n);
+                return 1;
+            }
+        }
+
+        lace_stop();
+    }
+
+    return 0;
+}